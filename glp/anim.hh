@@ -6,32 +6,52 @@ namespace glp {
 
 namespace Animation {
 
+// keys of one channel stored as separate time and value arrays
 template <typename T>
-struct Key {
-    T value;
-    float time;
+struct Channel {
+    std::vector<float> times;
+    std::vector<T> values;
+
+    // packed channels keep 3 uint16 per key instead of values: smallest three
+    // quaternions, or vectors quantized within range_min and range_extent
+    std::vector<uint16_t> packed;
+    glm::vec3 range_min {0.0f};
+    glm::vec3 range_extent {0.0f};
+
+    inline size_t size() const { return times.size(); }
+    inline bool is_packed() const { return !packed.empty(); }
+    inline void resize(size_t n) { times.resize(n); values.resize(n); }
+    inline void add(const T& value, float time) { values.push_back(value); times.push_back(time); }
+
+    inline T get(size_t i) const { return is_packed() ? unpack(i) : values[i]; }
+
+    // quantizes values into packed and frees them
+    void pack();
+    T unpack(size_t i) const;
 };
 
+template <> void Channel<glm::vec3>::pack();
+template <> glm::vec3 Channel<glm::vec3>::unpack(size_t i) const;
+template <> void Channel<glm::quat>::pack();
+template <> glm::quat Channel<glm::quat>::unpack(size_t i) const;
+
 struct Node {
     std::string name;
     int bone_index {-1};
     glm::mat4 local_transform {glm::mat4(1.0f)};
     std::vector<Node*> children;
 
-    std::vector<Key<glm::vec3>> positions;
-    std::vector<Key<glm::quat>> rotations;
-    std::vector<Key<glm::vec3>> scales;
+    Channel<glm::vec3> positions;
+    Channel<glm::quat> rotations;
+    Channel<glm::vec3> scales;
 
     void update(float time);
 #ifdef USE_ASSIMP
     void assimp_set_keys(const aiNodeAnim* channel);
 #endif
 
-    int get_position_index(float time);
-    int get_rotation_index(float time);
-    int get_scale_index(float time);
-
-    float get_scale_factor(float last, float next, float time);
+    // key before time, clamped to the channel, and the blend factor to the next key
+    static size_t get_index(const std::vector<float>& times, float time, float& factor);
 
     glm::mat4 interpolate_position(float time);
     glm::mat4 interpolate_rotation(float time);
@@ -41,29 +61,37 @@ struct Node {
 class Animation {
     private:
         std::string name;
+        // file the animation was loaded from
+        std::string path;
         float duration;
         float ticks_per_second;
 
-        Node* root_node;
+        Node* root_node {nullptr};
 
 #ifdef USE_ASSIMP
-        void read_assimp_hierarchy(Node* dest, const aiNode* src, const Model& m);
+        void read_assimp_hierarchy(Node* dest, const aiNode* src, const ModelData& m);
 #endif
         void clear_nodes(Node* parent);
         void serialize_nodes(Node* parent, std::stringstream& s);
-        void deserialize_nodes(Node*& parent, const Model& m, std::stringstream& s);
-        void deserialize_data(const Model& m, std::stringstream& s);
+        void deserialize_nodes(Node*& parent, const ModelData& m, std::istream& s);
+        void deserialize_data(const ModelData& m, std::istream& s);
+        void deserialize_binary(const ModelData& m, std::istream& s);
 
     public:
         inline const std::string& get_name() const { return name; }
         inline const float& get_duration() const { return duration; }
         inline const float& get_tps() const { return ticks_per_second; }
         inline Node* get_root_node() const { return root_node; }
+        inline const std::string& get_path() const { return path; }
+        // exchanges keys and hierarchy with a newer load of the same file, animators
+        // playing this animation pick the new keys up on their next update
+        void swap(Animation& other);
         Node* find_node(Node* root, const std::string& name);
 
         std::stringstream serialize_data();
+        std::string serialize_binary();
 
-        Animation(const std::string& path, const Model& model);
+        Animation(const std::string& path, const ModelData& model);
         Animation() {};
         ~Animation();
 
@@ -80,10 +108,11 @@ class Animator {
         void calc_bone_transform(Node* node, glm::mat4 parent);
 
     public:
-        inline const std::vector<glm::mat4> get_bone_matrices() const { return bone_mat; }
+        inline const std::vector<glm::mat4>& get_bone_matrices() const { return bone_mat; }
 
         inline Animation* get_animation() { return current_animation; }
 
+        // advances the pose, get_bone_matrices() goes to the shader's pose uniform
         void update(float dt);
         void play_animation(Animation* animation);
         
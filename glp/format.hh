@@ -0,0 +1,385 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <string>
+
+namespace glp {
+
+namespace format {
+
+// binary assets start with a non-printable byte so they can be told apart
+// from the text formats by peeking a single character of the stream
+constexpr char BINARY_MARK                      = '\x89';
+
+constexpr char MODEL_MAGIC[4]                   = {BINARY_MARK, 'G', 'L', 'M'};
+constexpr uint32_t MODEL_VERSION                = 4;
+
+constexpr char ANIM_MAGIC[4]                    = {BINARY_MARK, 'G', 'L', 'A'};
+constexpr uint32_t ANIM_VERSION                 = 2;
+
+constexpr char SCENE_MAGIC[4]                   = {BINARY_MARK, 'G', 'L', 'S'};
+constexpr uint32_t SCENE_VERSION                = 1;
+
+constexpr char TEXTURE_MAGIC[4]                 = {BINARY_MARK, 'G', 'L', 'T'};
+constexpr uint32_t TEXTURE_VERSION              = 2;
+
+constexpr char PAK_MAGIC[4]                     = {BINARY_MARK, 'G', 'L', 'P'};
+constexpr uint32_t PAK_VERSION                  = 1;
+
+constexpr size_t MAX_MATERIAL_TEXTURES          = 6;
+constexpr size_t BLOB_ALIGNMENT                 = 16;
+
+struct StringRef {
+    uint32_t offset;
+    uint32_t size;
+};
+
+// .model layout:
+// header | mesh table | material table | bone table | lod table | string table | blobs
+// blob offsets are relative to blobs_offset and aligned to BLOB_ALIGNMENT
+struct ModelHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t mesh_count;
+    uint32_t material_count;
+    uint32_t bone_count;
+    uint32_t strings_size;
+    uint64_t blobs_offset;
+    uint64_t blobs_size;
+
+    // since version 4, older headers end here and have no lod table
+    uint32_t lod_count;
+    uint32_t pad;
+};
+
+constexpr size_t MODEL_HEADER_V3_SIZE           = 40;
+
+// MeshEntry::flags, describe how vertices are laid out in the vertex blob
+enum VertexFlags : uint32_t {
+    // joints and weights are stored, static meshes leave them out
+    VERTEX_SKINNED              = 1 << 0,
+    // 10-10-10-2 snorm normals, half float uvs, uint8 joints, unorm8 weights
+    VERTEX_COMPACT              = 1 << 1,
+    // unorm16 positions, dequantized with position_scale and position_offset
+    VERTEX_QUANTIZED_POSITION   = 1 << 2,
+    // unorm16 weights instead of unorm8 with VERTEX_COMPACT
+    VERTEX_WEIGHTS16            = 1 << 3,
+};
+
+struct MeshEntry {
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t material;
+    uint32_t flags;
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+
+    // since version 3, version 2 entries end here and always hold
+    // full float VERTEX_SKINNED vertices
+    float position_offset[3];
+    float position_scale[3];
+    uint32_t vertex_stride;
+    // 2 or 4 bytes per index, 0 is read as 4
+    uint32_t index_size;
+};
+
+constexpr size_t MESH_ENTRY_V2_SIZE             = 32;
+
+struct MaterialEntry {
+    float ambient[3];
+    float diffuse[3];
+    float specular[3];
+    float shininess;
+    float albedo[3];
+    float metallic;
+    float roughness;
+
+    int8_t diffuse_id;
+    int8_t specular_id;
+    int8_t metallic_id;
+    int8_t roughness_id;
+    int8_t ao_id;
+    int8_t normal_id;
+    uint8_t texture_count;
+    uint8_t pad;
+
+    StringRef textures[MAX_MATERIAL_TEXTURES];
+};
+
+struct BoneEntry {
+    StringRef name;
+    float offset[16];
+};
+
+// simplified index lists drawn with the mesh's vertices, sorted by mesh and
+// from fine to coarse; error is the object space distance they deviate by
+struct LodEntry {
+    uint32_t mesh;
+    uint32_t index_count;
+    float error;
+    uint32_t pad;
+    uint64_t index_offset;
+};
+
+// .anim layout:
+// header | node table | string table | blobs
+// nodes are stored depth first, parents before their children; every channel
+// is an array of times followed by an array of values, positions and scales
+// as 3 floats and rotations as x, y, z, w; packed channels instead store
+// 3 uint16 per key, after a float range min[3] and extent[3] for vectors
+struct AnimHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t node_count;
+    uint32_t strings_size;
+    StringRef name;
+    float duration;
+    float ticks_per_second;
+    uint64_t blobs_offset;
+    uint64_t blobs_size;
+};
+
+enum AnimChannelFlags : uint32_t {
+    ANIM_CHANNEL_PACKED         = 1 << 0,
+};
+
+struct AnimChannel {
+    uint32_t count;
+    uint32_t flags;
+    uint64_t offset;
+};
+
+struct AnimNodeEntry {
+    StringRef name;
+    // index of the parent node, -1 for the root
+    int32_t parent;
+    uint32_t pad;
+    AnimChannel positions;
+    AnimChannel rotations;
+    AnimChannel scales;
+};
+
+// .scene layout:
+// header | model table | object table | string table
+// every model path is stored once and objects refer to it by index into the
+// model table, -1 for objects without a model; paths are relative to the scene
+struct SceneHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t model_count;
+    uint32_t object_count;
+    uint32_t strings_size;
+
+    float camera_fov;
+    float camera_near;
+    float camera_far;
+    float camera_position[3];
+    float player_speed;
+
+    float fog_color[3];
+    float fog_near;
+    float fog_far;
+
+    // 0 directional, 1 point
+    uint32_t light_type;
+    float light_position[3];
+    float light_direction[3];
+    float light_ambient[3];
+    float light_diffuse[3];
+    float light_specular[3];
+    float light_linear;
+    float light_quadratic;
+};
+
+// SceneObject::shape, extents are box half extents or the sphere radius in x
+enum SceneShape : uint32_t {
+    SCENE_SHAPE_BOX             = 0,
+    SCENE_SHAPE_SPHERE          = 1,
+    // box around the model's bounds, sized when the scene is loaded
+    SCENE_SHAPE_MODEL           = 2,
+};
+
+struct SceneObject {
+    int32_t model;
+    uint32_t shape;
+    float mass;
+    float position[3];
+    float rotation[4];
+    float extents[3];
+};
+
+// .tex layout:
+// header | level table | level data
+// levels go from the full size down to 1x1 and are uploaded as they are stored,
+// rows are tightly packed; offsets are relative to data_offset. block compressed
+// levels are rows of 4x4 blocks, partial blocks at the edges are padded
+enum TextureFormat : uint32_t {
+    TEXTURE_RGB8                = 0,
+    TEXTURE_RGBA8               = 1,
+    // opaque dxt1 blocks
+    TEXTURE_BC1                 = 2,
+    // dxt5: bc1 color and interpolated alpha
+    TEXTURE_BC3                 = 3,
+    // two interpolated channels, for normal maps with z rebuilt in the shader
+    TEXTURE_BC5                 = 4,
+    TEXTURE_BC7                 = 5,
+    TEXTURE_ETC2_RGB            = 6,
+    // eac alpha followed by etc2 color
+    TEXTURE_ETC2_RGBA           = 7,
+};
+
+enum TextureFlags : uint32_t {
+    // color data, levels were filtered in linear space
+    TEXTURE_SRGB                = 1 << 0,
+};
+
+struct TextureHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t format;
+    uint32_t flags;
+    uint32_t width;
+    uint32_t height;
+    uint32_t level_count;
+    uint32_t pad;
+    uint64_t data_offset;
+};
+
+struct TextureLevel {
+    uint32_t width;
+    uint32_t height;
+    uint64_t offset;
+    uint64_t size;
+};
+
+// .pak layout:
+// header | entries sorted by path hash | string table | file data
+// entry paths are relative to the packed directory with '/' separators,
+// data offsets are relative to data_offset and aligned to BLOB_ALIGNMENT
+struct PakHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t strings_size;
+    uint64_t data_offset;
+};
+
+struct PakEntry {
+    uint64_t hash;
+    StringRef path;
+    uint64_t offset;
+    uint64_t size;
+};
+
+static_assert(sizeof(ModelHeader) == 48);
+static_assert(sizeof(MeshEntry) == 64);
+static_assert(sizeof(MaterialEntry) == 116);
+static_assert(sizeof(BoneEntry) == 72);
+static_assert(sizeof(LodEntry) == 24);
+static_assert(sizeof(AnimHeader) == 48);
+static_assert(sizeof(AnimChannel) == 16);
+static_assert(sizeof(AnimNodeEntry) == 64);
+static_assert(sizeof(SceneHeader) == 140);
+static_assert(sizeof(SceneObject) == 52);
+static_assert(sizeof(TextureHeader) == 40);
+static_assert(sizeof(TextureLevel) == 24);
+static_assert(sizeof(PakHeader) == 24);
+static_assert(sizeof(PakEntry) == 32);
+
+// interpolation weights out of 64 of bc7 2, 3 and 4 bit indices
+constexpr int BC7_WEIGHTS2[4]                   = {0, 21, 43, 64};
+constexpr int BC7_WEIGHTS3[8]                   = {0, 9, 18, 27, 37, 46, 55, 64};
+constexpr int BC7_WEIGHTS4[16]                  = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// etc1/etc2 intensity modifiers by table and pixel index
+constexpr int ETC_MODIFIERS[8][4] = {
+    {2, 8, -2, -8}, {5, 17, -5, -17}, {9, 29, -9, -29}, {13, 42, -13, -42},
+    {18, 60, -18, -60}, {24, 80, -24, -80}, {33, 106, -33, -106}, {47, 183, -47, -183},
+};
+// etc2 t and h mode distances
+constexpr int ETC_DISTANCES[8]                  = {3, 6, 11, 16, 23, 32, 41, 64};
+// eac alpha modifiers by table and pixel index, scaled by the block's multiplier
+constexpr int EAC_MODIFIERS[16][8] = {
+    {-3, -6, -9, -15, 2, 5, 8, 14}, {-3, -7, -10, -13, 2, 6, 9, 12},
+    {-2, -5, -8, -13, 1, 4, 7, 12}, {-2, -4, -6, -13, 1, 3, 5, 12},
+    {-3, -6, -8, -12, 2, 5, 7, 11}, {-3, -7, -9, -11, 2, 6, 8, 10},
+    {-4, -7, -8, -11, 3, 6, 7, 10}, {-3, -5, -8, -11, 2, 4, 7, 10},
+    {-2, -6, -8, -10, 1, 5, 7, 9}, {-2, -5, -8, -10, 1, 4, 7, 9},
+    {-2, -4, -8, -10, 1, 3, 7, 9}, {-2, -5, -7, -10, 1, 4, 6, 9},
+    {-3, -4, -7, -10, 2, 3, 6, 9}, {-1, -2, -3, -10, 0, 1, 2, 9},
+    {-4, -6, -8, -9, 3, 5, 7, 8}, {-3, -5, -7, -9, 2, 4, 6, 8},
+};
+
+// bytes of a 4x4 block, 0 for formats that are not block compressed
+inline uint32_t texture_block_size(uint32_t format) {
+    switch(format) {
+        case TEXTURE_BC1:
+        case TEXTURE_ETC2_RGB:
+            return 8;
+        case TEXTURE_BC3:
+        case TEXTURE_BC5:
+        case TEXTURE_BC7:
+        case TEXTURE_ETC2_RGBA:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+inline bool is_binary(std::istream& s) {
+    return s.peek() == static_cast<unsigned char>(BINARY_MARK);
+}
+
+inline bool check_magic(const char* magic, const char (&expected)[4]) {
+    return std::memcmp(magic, expected, 4) == 0;
+}
+
+template <typename T>
+inline void write(std::string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+inline void write(std::string& out, const T* values, size_t count) {
+    out.append(reinterpret_cast<const char*>(values), count*sizeof(T));
+}
+
+inline void align(std::string& out, size_t base=0) {
+    out.resize(base + (out.size()-base+BLOB_ALIGNMENT-1)/BLOB_ALIGNMENT*BLOB_ALIGNMENT, '\0');
+}
+
+template <typename T>
+inline bool read(std::istream& s, T& value) {
+    return static_cast<bool>(s.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+template <typename T>
+inline bool read(std::istream& s, T* values, size_t count) {
+    return static_cast<bool>(s.read(reinterpret_cast<char*>(values), count*sizeof(T)));
+}
+
+// sections are read in file order so the same reader works on streams
+// that cannot seek backwards; pos tracks how many bytes were consumed
+inline bool skip_to(std::istream& s, uint64_t& pos, uint64_t target) {
+    if(target < pos) return false;
+    s.ignore(target-pos);
+    pos = target;
+    return static_cast<bool>(s);
+}
+
+inline StringRef add_string(std::string& table, const std::string& str) {
+    StringRef ref {static_cast<uint32_t>(table.size()), static_cast<uint32_t>(str.size())};
+    table += str;
+    return ref;
+}
+
+inline std::string get_string(const std::string& table, const StringRef& ref) {
+    if(static_cast<size_t>(ref.offset)+ref.size > table.size()) return {};
+    return table.substr(ref.offset, ref.size);
+}
+
+}
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "model.hh"
+#include "material.hh"
+#include "anim.hh"
+
+namespace glp {
+
+// Loads assets in the background: file reads, decompression, parsing and
+// image decoding run on worker threads, while every GL call is queued and
+// executed on the main thread by process_uploads() within a time budget.
+// Futures become ready once the asset is fully uploaded.
+class Loader {
+    private:
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()>> jobs;
+        std::mutex jobs_mutex;
+        std::condition_variable jobs_cv;
+        bool stopping {false};
+
+        std::deque<std::function<void()>> uploads;
+        std::mutex uploads_mutex;
+
+        void work();
+        void push_job(std::function<void()> job);
+        void push_upload(std::function<void()> upload);
+
+    public:
+        // release_cpu_data frees mesh vertices and indices once uploaded except on
+        // the meshes keep picks, see Model
+        std::shared_future<Model*> load_model(const std::string& path, Shader* shader, ShadingType shading_t,
+                bool release_cpu_data=false, KeepMeshData keep={});
+        // textures come from the TextureCache, release() them when done
+        std::shared_future<Texture*> load_texture(const std::string& path);
+        std::shared_future<Animation::Animation*> load_animation(const std::string& path, const Model* model);
+
+        // runs queued GL uploads until budget_ms is spent, returns how many ran
+        size_t process_uploads(float budget_ms);
+
+        size_t pending_uploads();
+
+        Loader(size_t threads=std::thread::hardware_concurrency());
+        // finishes every queued load and runs its uploads, so it has to be called
+        // on the GL thread; the assets of futures nobody collected belong to the
+        // caller to free like any other
+        ~Loader();
+
+        Loader(const Loader&) = delete;
+        Loader& operator=(const Loader&) = delete;
+};
+
+template <typename T>
+inline bool is_ready(const std::shared_future<T>& f) {
+    return f.valid() && f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+}
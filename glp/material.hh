@@ -1,5 +1,9 @@
 #pragma once
 
+#include <map>
+#include <mutex>
+
+#include "format.hh"
 #include "shader.hh"
 
 namespace glp {
@@ -8,21 +12,106 @@ struct Texture {
     GLuint id{0};
     std::string path{};
 
-    Texture(const std::string& path);
-    Texture(const unsigned char* strliteral, const unsigned int len);
+    // decoded pixels waiting for upload(), freed once they are on the GPU
+    unsigned char* pixels {nullptr};
+    int width {0}, height {0}, component {0};
+
+    // mip chain of a .tex container, uploaded level by level instead of pixels
+    std::vector<format::TextureLevel> levels;
+    std::string level_data;
+    // format::TextureFormat of the levels, block compressed ones are decoded to
+    // rgba8 at upload when GL lacks the format
+    uint32_t level_format {format::TEXTURE_RGB8};
+
+    void upload();
+    inline bool uploaded() const { return id != 0; }
+    // bytes of all levels, pixels count a third more for the generated mipmaps
+    size_t size() const;
+    // swaps GL texture and image with other, which keeps the old ones until it is
+    // deleted; the handle stays valid for everything that refers to it
+    void replace(Texture& other);
+
+    Texture(const std::string& path, bool upload_now=true);
+    Texture(const unsigned char* strliteral, const unsigned int len, bool upload_now=true);
     ~Texture();
 
     Texture(const Texture&) = delete;
     Texture& operator=(const Texture&) = delete;
 };
 
+// decodes one level of a block compressed format::TextureFormat into tightly packed
+// rgba8; false for other formats and the bc7 modes glp-conv does not write
+bool decode_blocks(uint32_t format, const unsigned char* data, uint32_t width, uint32_t height, unsigned char* rgba);
+
+struct TextureCacheStats {
+    size_t hits {0};
+    size_t misses {0};
+    size_t evictions {0};
+    size_t resident {0};
+    size_t resident_bytes {0};
+};
+
+// Process-wide, reference counted texture storage. Textures are keyed by the
+// hash of their file contents, with canonical paths mapped onto those keys,
+// so the same image is decoded and uploaded once no matter how many models,
+// fonts or materials use it.
+class TextureCache {
+    private:
+        struct Entry {
+            Texture* texture;
+            size_t refs;
+            size_t bytes;
+        };
+
+        std::map<uint64_t, Entry> entries;
+        std::map<std::string, uint64_t> paths;
+        std::map<const Texture*, uint64_t> owners;
+        TextureCacheStats stats {};
+        std::mutex mutex;
+
+        Texture* find(uint64_t hash, const std::string& key);
+        Texture* insert(Texture* tex, uint64_t hash, const std::string& key);
+
+        TextureCache() {}
+
+    public:
+        static TextureCache& get();
+
+        Texture* acquire(const std::string& path, bool upload_now=true);
+        Texture* acquire(const unsigned char* data, const unsigned int len, const std::string& key, bool upload_now=true);
+        // adds a reference to a texture owned by the cache, false for any other texture
+        bool retain(const Texture* tex);
+        void release(const Texture* tex);
+        // rekeys a texture whose contents were replaced in place by a reload
+        void update(const Texture* tex, uint64_t hash, size_t bytes);
+
+        TextureCacheStats get_stats();
+
+        TextureCache(const TextureCache&) = delete;
+        TextureCache& operator=(const TextureCache&) = delete;
+};
+
 enum class ShadingType {
     PHONG,
     PBR,
 };
 
+// texture units the builtin shaders' material samplers are fixed to
+enum MaterialUnit : GLint {
+    DIFFUSE_UNIT,
+    NORMAL_UNIT,
+    SPECULAR_UNIT,
+    METALLIC_UNIT,
+    ROUGHNESS_UNIT,
+    AO_UNIT,
+};
+
 struct Material {
     std::vector<Texture*> textures;
+#ifndef __vita__
+    // std140 MaterialBlock of the builtin shaders, made by upload()
+    UniformBuffer* block {nullptr};
+#endif
 
     glm::vec3 ambient;
     glm::vec3 diffuse;
@@ -42,10 +131,23 @@ struct Material {
 
     int8_t normal_id {-1};
 
+    // writes the colors, factors and which textures exist into the material's
+    // uniform block, again after any of them changed; nothing on vitaGL
+    void upload();
+    // binds the uniform block, uploading it first if it was never uploaded
+    void bind();
+
+    // cached textures are referenced for as long as the material lives
+    inline void add_texture(Texture* tex) {
+        TextureCache::get().retain(tex);
+        textures.push_back(tex);
+    }
+
     Material() {}
-    Material(const std::vector<Texture*>& texs) : textures{texs} {}
-    Material(Texture* tex) { textures.push_back(tex); }
-    ~Material() {}
+    Material(const std::vector<Texture*>& texs) { for(auto& tex: texs) add_texture(tex); }
+    Material(Texture* tex) { add_texture(tex); }
+    Material(const std::string& path) { textures.push_back(TextureCache::get().acquire(path)); }
+    ~Material();
 
     Material(const Material&) = delete;
     Material& operator=(const Material&) = delete;
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <functional>
+#include <istream>
 #include <limits>
+#include <map>
 #include <vector>
 
 #ifdef USE_ASSIMP
@@ -24,6 +27,7 @@
 #include "external/glm/gtc/matrix_transform.hpp"
 #include "external/glm/gtc/type_ptr.hpp"
 
+#include "format.hh"
 #include "shader.hh"
 #include "material.hh"
 
@@ -34,9 +38,16 @@ constexpr GLuint NORMAL_ATTRIBUTE_INDEX         = 1;
 constexpr GLuint TEXCOORD0_ATTRIBUTE_INDEX      = 2;
 constexpr GLuint JOINTS_ATTRIBUTE_INDEX         = 3;
 constexpr GLuint WEIGHTS_ATTRIBUTE_INDEX        = 4;
+// per instance model matrix in 4 columns, normal matrix in 3 and the first bone
+// of a skinned instance's pose in the bone buffer, see RenderQueue
+constexpr GLuint INSTANCE_MODEL_ATTRIBUTE_INDEX = 5;
+constexpr GLuint INSTANCE_NORMAL_ATTRIBUTE_INDEX = 9;
+constexpr GLuint INSTANCE_BONES_ATTRIBUTE_INDEX = 12;
 
 constexpr GLuint MAX_BONE_INFLUENCE             = 4;
 constexpr GLuint MAX_BONES                      = 100;
+// meshes with up to this many vertices use 16 bit indices
+constexpr size_t MAX_INDEX16_VERTICES           = 65536;
 
 struct Vertex {
     glm::vec3 position;
@@ -47,76 +58,233 @@ struct Vertex {
     float weights[MAX_BONE_INFLUENCE];
 };
 
+// full float VERTEX_SKINNED vertices are stored as raw blobs of this struct
+static_assert(sizeof(Vertex) == 64);
+
+// describes how vertices are packed in the GPU buffer, flags are format::VertexFlags
+struct VertexLayout {
+    uint32_t flags {format::VERTEX_SKINNED};
+    glm::vec3 position_offset {0.0f};
+    glm::vec3 position_scale {1.0f};
+
+    size_t stride() const;
+    inline bool is_full() const { return flags == format::VERTEX_SKINNED; }
+
+    // picks a layout for the vertices, skinned only when any vertex has weights
+    static VertexLayout select(const std::vector<Vertex>& vertices, bool compact, bool quantize_position);
+
+    // packs vertices in this layout, fits position_offset and position_scale first
+    std::string pack(const std::vector<Vertex>& vertices);
+    std::vector<Vertex> unpack(const char* data, size_t count) const;
+
+    // glVertexAttribPointer calls for the bound vertex buffer
+    void set_attributes() const;
+};
+
 struct BoneInfo {
     std::string name;
     glm::mat4 offset;
 };
 
-class Mesh {
-    private:
-        GLuint VAO, VBO, EBO;
-        
+struct MeshLod {
+    // offset into Mesh::lod_indices
+    size_t index_offset;
+    size_t index_count;
+    float error;
+};
+
+// cpu side of a mesh, enough to inspect, convert or simulate it without a GL context
+class MeshData {
+    protected:
+        bool released {false};
+
     public:
         std::vector<Vertex>             vertices;
         std::vector<unsigned int>       indices;
-        Material*                       material;
+        Material*                       material {nullptr};
+        VertexLayout                    layout;
+        // vertices already packed in layout, uploaded instead of vertices and freed after
+        std::string                     packed;
+        // simplified levels drawn from the same vertices, lod n is lods[n-1]
+        std::vector<unsigned int>       lod_indices;
+        std::vector<MeshLod>            lods;
+        // marks meshes that back physics triangle shapes, release_cpu_data() then
+        // leaves their vertices and indices alone. Model::upload() sets it from the
+        // keep predicate given to Model or Loader::load_model, set it by hand only
+        // on models constructed with upload_now=false
+        bool                            keep_cpu_data {false};
+        // bounding sphere of this mesh alone, set with the model's bounds
+        glm::vec3                       bounds_center {0.0f};
+        float                           bounds_radius {0.0f};
+
+        // coarsest level that deviates less than max_error
+        size_t select_lod(float max_error) const;
+        inline bool cpu_data_released() const { return released; }
 
-        void render(Shader* shader, ShadingType type);
+        MeshData() {};
+        MeshData(std::vector<Vertex>&& vert, std::vector<unsigned int>&& idx, Material* mat)
+            : vertices{std::move(vert)}, indices{std::move(idx)}, material{mat} {};
+        virtual ~MeshData() {};
 
-        Mesh(std::vector<Vertex> vert, std::vector<unsigned int> idx, Material* mat, Shader* shader);
+        MeshData(MeshData&&) = default;
+        MeshData& operator=(MeshData&&) = default;
+        MeshData(const MeshData&) = delete;
+        MeshData& operator=(const MeshData&) = delete;
+};
+
+// GPU buffers of a mesh, created by upload()
+class Mesh : public MeshData {
+    private:
+        GLuint VAO {0}, VBO {0}, EBO {0};
+        GLenum index_type {GL_UNSIGNED_INT};
+        // indices.size() at upload, indices may be released afterwards
+        size_t index_count {0};
+        Shader* shader;
+        
+    public:
+        void render(Shader* shader, ShadingType type, size_t lod=0);
+        // the steps of render(), for callers that skip the ones a previous draw
+        // already did: material uniforms and textures, then the vertex array and
+        // per mesh uniforms, then the draw call itself; more than one instance
+        // needs the instance attributes set on the bound vertex array
+        void bind_material(Shader* shader, ShadingType type);
+        void bind(Shader* shader);
+        void draw(size_t lod=0, GLsizei instances=1);
+
+        void upload();
+        inline bool uploaded() const { return VAO != 0; }
+        // shader whose attribute locations upload() binds the vertex arrays to
+        inline void set_shader(Shader* s) { shader = s; }
+        // frees vertices and indices once they are on the GPU
+        void release_cpu_data();
+
+        Mesh(std::vector<Vertex>&& vert, std::vector<unsigned int>&& idx, Material* mat, Shader* shader, bool upload_now=true);
+        Mesh(MeshData&& data, Shader* shader, bool upload_now=true);
         ~Mesh();
 
         Mesh(const Mesh&) = delete;
         Mesh& operator=(const Mesh&) = delete;
 };
 
-class Model {
-    private:
-        std::vector<Mesh*> meshes {};
+// cpu side of a model: meshes, materials, decoded textures, bones and bounds.
+// loading one never touches GL, so tools and servers can use it headless
+class ModelData {
+    protected:
+        std::vector<MeshData*> meshes {};
         std::vector<BoneInfo> bones {};
         std::vector<Texture*> textures {};
 
-        ShadingType shading {ShadingType::PBR};
+        glm::vec3 bounds_min {0.0f};
+        glm::vec3 bounds_max {0.0f};
+        glm::vec3 bounds_center {0.0f};
+        float bounds_radius {0.0f};
 
-        Shader* shader;
         std::string directory;
         std::string name;
+        // file the model was loaded from
+        std::string path;
+        // written instead of a texture's file name, for tools that convert
+        // textures next to the model
+        std::map<const Texture*, std::string> texture_names;
+
+        // every loaded or split mesh is made here, Model makes GPU meshes instead
+        virtual MeshData* create_mesh(MeshData&& data);
 
 #ifdef USE_ASSIMP
         void assimp_load(const std::string& path);
         void assimp_node_process(aiNode* node, const aiScene* scene);
-        Mesh* assimp_mesh_process(aiMesh* mesh, const aiScene* scene);
+        MeshData* assimp_mesh_process(aiMesh* mesh, const aiScene* scene);
         Texture* assimp_textures_load(aiMaterial* mat, aiTextureType type);
 #endif
         Texture* texture_load(const std::string& path);
-        void deserialize_data(std::stringstream& s);
+        void deserialize_data(std::istream& s);
+        void deserialize_binary(std::istream& s);
+        // aabb and bounding sphere, computed once at load while vertices are around
+        void calculate_bounds();
 
     public:
-        void render();
-
         inline const std::vector<BoneInfo>& get_bone_info() const { return bones; }
 
-        inline Shader* get_shader() { return shader; }
-        inline void set_shader(Shader* s) { shader = s; }
-        inline void set_shading_type(ShadingType s) { shading = s; }
+        inline const glm::vec3& get_bounds_min() const { return bounds_min; }
+        inline const glm::vec3& get_bounds_max() const { return bounds_max; }
+        inline const glm::vec3& get_bounds_center() const { return bounds_center; }
+        inline float get_bounds_radius() const { return bounds_radius; }
 
-        inline std::vector<Mesh*> get_meshes() { return meshes; }
+        inline std::vector<MeshData*> get_meshes() { return meshes; }
         inline std::vector<Texture*> get_textures() { return textures; }
+        inline const std::string& get_path() const { return path; }
         inline std::string& get_directory() { return directory; }
         inline void set_directory(const std::string& s) { directory = s; }
         inline std::string& get_name() { return name; }
         inline void set_name(const std::string& s) { name = s; }
+        inline void rename_texture(const Texture* tex, const std::string& s) { texture_names[tex] = s; }
+        // file name the model refers to the texture by, relative to the model
+        std::string get_texture_name(const Texture* tex) const;
 
+        // half extents of the aabb computed at load
         glm::vec3 calculate_bounding_box();
+        // splits meshes so each one fits 16 bit indices, returns how many were split;
+        // split meshes lose their lods so generate them afterwards, split before upload
+        size_t split_meshes(size_t max_vertices=MAX_INDEX16_VERTICES);
 
         void load(const std::string& path);
 
         std::stringstream serialize_data();
+        std::string serialize_binary();
 
-        Model() {};
-        Model(const std::string& path, Shader* shader, ShadingType shading_t);
-        ~Model();
+        ModelData() {};
+        explicit ModelData(const std::string& path);
+        virtual ~ModelData();
 
+        ModelData(const ModelData&) = delete;
+        ModelData& operator=(const ModelData&) = delete;
+};
+
+// picks the meshes of a model, by index in get_meshes() and contents, whose cpu
+// data release_cpu_data keeps, see MeshData::keep_cpu_data
+using KeepMeshData = std::function<bool(size_t index, const MeshData& mesh)>;
+
+class Model : public ModelData {
+    private:
+        ShadingType shading {ShadingType::PBR};
+        // screen space error in pixels allowed when picking mesh lods
+        float lod_threshold {1.0f};
+        // meshes free their vertices and indices after upload, see Mesh::keep_cpu_data
+        bool release_cpu_data {false};
+        KeepMeshData keep_mesh_data {};
+
+        Shader* shader;
+
+        MeshData* create_mesh(MeshData&& data) override;
+
+    public:
+        void render();
+        // picks each mesh's lod from how many pixels an object space unit covers
+        void render(float pixels_per_unit);
+
+        inline Shader* get_shader() { return shader; }
+        inline void set_shader(Shader* s) { shader = s; }
+        inline ShadingType get_shading_type() const { return shading; }
+        inline void set_shading_type(ShadingType s) { shading = s; }
+        inline float get_lod_threshold() const { return lod_threshold; }
+        inline void set_lod_threshold(float pixels) { lod_threshold = pixels; }
+
+        // every mesh of a Model is a GPU mesh
+        std::vector<Mesh*> get_meshes();
+
+        // creates the GL objects of textures and meshes that are not uploaded yet
+        void upload();
+        // uploads other, a newer load of the same file, with this model's shader and
+        // settings and swaps meshes, materials, textures and bones with it; other
+        // gets the old ones to delete. collision shapes and animations made from
+        // the old model are not rebuilt
+        void replace(Model& other);
+
+        Model() {};
+        // upload_now=false only decodes the model, upload() has to be called on the GL thread.
+        // with release_cpu_data, meshes keep picks keep their vertices and indices
+        Model(const std::string& path, Shader* shader, ShadingType shading_t, bool upload_now=true,
+                bool release_cpu_data=false, KeepMeshData keep={});
 };
 
 }
@@ -14,15 +14,26 @@ constexpr auto static_shader = "#version 330 core\n"
 "layout (location = 2) in vec2 texcoord0;\n"
 "layout (location = 3) in vec4 joints;\n"
 "layout (location = 4) in vec4 weights;\n"
+"layout (location = 5) in mat4 instance_model;\n"
+"layout (location = 9) in mat3 instance_normal;\n"
 "out vec2 uv0;\n"
 "out vec3 wpos;\n"
 "out vec3 norm;\n"
-"uniform mat4 vp;\n"
-"uniform mat4 model;\n"
+"layout (std140) uniform CameraBlock {\n"
+"    mat4 vp;\n"
+"    vec3 camera_position;\n"
+"};\n"
+"layout (std140) uniform ObjectBlock {\n"
+"    mat4 model;\n"
+"};\n"
+"uniform bool instanced;\n"
+"uniform vec3 position_scale;\n"
+"uniform vec3 position_offset;\n"
 "void main() {\n"
 "    uv0 = texcoord0;\n"
-"    wpos = vec3(model * vec4(position, 1.0));\n"
-"    norm = transpose(inverse(mat3(model)))*normal;\n"
+"    mat4 m = instanced ? instance_model : model;\n"
+"    wpos = vec3(m * vec4(position*position_scale + position_offset, 1.0));\n"
+"    norm = (instanced ? instance_normal : transpose(inverse(mat3(model))))*normal;\n"
 "    gl_Position = vp * vec4(wpos, 1.0);\n"
 "}\n";
 constexpr auto skinned_shader = "#version 330 core\n"
@@ -31,74 +42,101 @@ constexpr auto skinned_shader = "#version 330 core\n"
 "layout (location = 2) in vec2 texcoord0;\n"
 "layout (location = 3) in vec4 joints;\n"
 "layout (location = 4) in vec4 weights;\n"
+"layout (location = 5) in mat4 instance_model;\n"
+"layout (location = 9) in mat3 instance_normal;\n"
+"layout (location = 12) in int instance_bones;\n"
 "out vec2 uv0;\n"
 "out vec3 wpos;\n"
 "out vec3 norm;\n"
-"uniform mat4 vp;\n"
-"uniform mat4 model;\n"
+"layout (std140) uniform CameraBlock {\n"
+"    mat4 vp;\n"
+"    vec3 camera_position;\n"
+"};\n"
+"layout (std140) uniform ObjectBlock {\n"
+"    mat4 model;\n"
+"};\n"
+"uniform bool instanced;\n"
 "uniform mat4 pose[100];\n"
+"uniform vec3 position_scale;\n"
+"uniform vec3 position_offset;\n"
+"uniform samplerBuffer pose_buffer;\n"
+"mat4 bone(int joint) {\n"
+"    if(!instanced) return pose[joint];\n"
+"    int texel = (instance_bones + joint)*4;\n"
+"    return mat4(texelFetch(pose_buffer, texel), texelFetch(pose_buffer, texel+1),\n"
+"                texelFetch(pose_buffer, texel+2), texelFetch(pose_buffer, texel+3));\n"
+"}\n"
 "void main() {\n"
-"    mat4 skin = weights.x * pose[int(joints.x)] +\n"
-"                weights.y * pose[int(joints.y)] +\n"
-"                weights.z * pose[int(joints.z)] +\n"
-"                weights.w * pose[int(joints.w)];\n"
+"    mat4 skin = weights.x * bone(int(joints.x)) +\n"
+"                weights.y * bone(int(joints.y)) +\n"
+"                weights.z * bone(int(joints.z)) +\n"
+"                weights.w * bone(int(joints.w));\n"
 "    uv0 = texcoord0;\n"
-"    wpos = vec3(model * vec4(position, 1.0));\n"
-"    norm = transpose(inverse(mat3(model)))*normal;\n"
+"    mat4 m = instanced ? instance_model : model;\n"
+"    wpos = vec3(m * vec4(position*position_scale + position_offset, 1.0));\n"
+"    norm = (instanced ? instance_normal : transpose(inverse(mat3(model))))*normal;\n"
 "    gl_Position = vp * skin * vec4(wpos, 1.0);\n"
 "}\n";
 constexpr auto phong_shader = "#version 330 core\n"
 "out vec4 color;\n"
-"struct Material {\n"
+"layout (std140) uniform MaterialBlock {\n"
 "    vec3 ambient;\n"
+"    float shininess;\n"
 "    vec3 diffuse;\n"
+"    float metallic;\n"
 "    vec3 specular;\n"
-"    float shininess;\n"
-"    sampler2D diffuse_tex;\n"
-"    sampler2D normal_tex;\n"
-"    sampler2D specular_tex;\n"
+"    float roughness;\n"
+"    vec3 albedo;\n"
 "    bool diffuse_tex_exists;\n"
 "    bool normal_tex_exists;\n"
 "    bool specular_tex_exists;\n"
-"};\n"
-"struct Light {\n"
+"    bool metallic_tex_exists;\n"
+"    bool roughness_tex_exists;\n"
+"    bool ao_tex_exists;\n"
+"} material;\n"
+"layout (std140) uniform LightBlock {\n"
 "    vec3 position;\n"
+"    bool directional;\n"
 "    vec3 direction;\n"
+"    float linear;\n"
 "    vec3 ambient;\n"
+"    float quadratic;\n"
 "    vec3 diffuse;\n"
 "    vec3 specular;\n"
-"    bool directional;\n"
-"    float linear;\n"
-"    float quadratic;\n"
-"};\n"
-"struct Fog {\n"
+"    vec3 color;\n"
+"} light;\n"
+"layout (std140) uniform FogBlock {\n"
 "    vec3 color;\n"
 "    float near;\n"
 "    float far;\n"
-"};\n"
+"} fog;\n"
+"uniform sampler2D diffuse_tex;\n"
+"uniform sampler2D normal_tex;\n"
+"uniform sampler2D specular_tex;\n"
 "in vec2 uv0;\n"
 "in vec3 wpos;\n"
 "in vec3 norm;\n"
-"uniform vec3 camera_position;\n"
-"uniform Material material;\n"
-"uniform Light light;\n"
-"uniform Fog fog;\n"
+"layout (std140) uniform CameraBlock {\n"
+"    mat4 vp;\n"
+"    vec3 camera_position;\n"
+"};\n"
 "float lin_depth(float depth) {\n"
 "    float z = depth*2.0-1.0;\n"
 "    return (2.0*fog.near*fog.far)/(fog.far+fog.near-z*(fog.far-fog.near));\n"
 "}\n"
 "void main()\n"
 "{\n"
-"    if(texture(material.diffuse_tex, uv0).a < 0.1) discard;\n"
+"    if(texture(diffuse_tex, uv0).a < 0.1) discard;\n"
 "    vec3 ambient;\n"
 "    if(material.diffuse_tex_exists) {\n"
-"        ambient = light.ambient * texture(material.diffuse_tex, uv0).rgb;\n"
+"        ambient = light.ambient * texture(diffuse_tex, uv0).rgb;\n"
 "    } else {\n"
 "        ambient = light.ambient * material.ambient;\n"
 "    }\n"
 "    vec3 normal;\n"
 "    if(material.normal_tex_exists) {\n"
-"        vec3 tangent = texture(material.normal_tex, uv0).rgb * 2.0 - 1.0;\n"
+"        vec2 txy = texture(normal_tex, uv0).rg * 2.0 - 1.0;\n"
+"        vec3 tangent = vec3(txy, sqrt(max(0.0, 1.0 - dot(txy, txy))));\n"
 "        vec3 q1 = dFdx(wpos);\n"
 "        vec3 q2 = dFdy(wpos);\n"
 "        vec2 st1 = dFdx(uv0);\n"
@@ -120,7 +158,7 @@ constexpr auto phong_shader = "#version 330 core\n"
 "    float diff = max(dot(normal, light_dir), 0.0);\n"
 "    vec3 diffuse;\n"
 "    if(material.diffuse_tex_exists) {\n"
-"        diffuse = light.diffuse * diff * texture(material.diffuse_tex, uv0).rgb;\n"
+"        diffuse = light.diffuse * diff * texture(diffuse_tex, uv0).rgb;\n"
 "    } else {\n"
 "        diffuse = light.diffuse * (diff * material.diffuse);\n"
 "    }\n"
@@ -134,9 +172,9 @@ constexpr auto phong_shader = "#version 330 core\n"
 "    }\n"
 "    vec3 specular;\n"
 "    if(material.specular_tex_exists) {\n"
-"        specular = light.specular * spec * texture(material.specular_tex, uv0).rgb;\n"
+"        specular = light.specular * spec * texture(specular_tex, uv0).rgb;\n"
 "    } else if(material.diffuse_tex_exists) {\n"
-"        specular = light.specular * spec * texture(material.diffuse_tex, uv0).rgb;\n"
+"        specular = light.specular * spec * texture(diffuse_tex, uv0).rgb;\n"
 "    } else {\n"
 "        specular = light.specular * (spec * material.specular);\n"
 "    }\n"
@@ -154,39 +192,49 @@ constexpr auto phong_shader = "#version 330 core\n"
 "}\n";
 constexpr auto pbr_shader = "#version 330 core\n"
 "out vec4 out_color;\n"
-"struct Material {\n"
-"    vec3 albedo;\n"
+"layout (std140) uniform MaterialBlock {\n"
+"    vec3 ambient;\n"
+"    float shininess;\n"
+"    vec3 diffuse;\n"
 "    float metallic;\n"
+"    vec3 specular;\n"
 "    float roughness;\n"
-"    sampler2D diffuse_tex;\n"
-"    sampler2D normal_tex;\n"
-"    sampler2D metallic_tex;\n"
-"    sampler2D roughness_tex;\n"
-"    sampler2D ao_tex;\n"
+"    vec3 albedo;\n"
 "    bool diffuse_tex_exists;\n"
 "    bool normal_tex_exists;\n"
+"    bool specular_tex_exists;\n"
 "    bool metallic_tex_exists;\n"
 "    bool roughness_tex_exists;\n"
 "    bool ao_tex_exists;\n"
-"};\n"
-"struct Light {\n"
+"} material;\n"
+"layout (std140) uniform LightBlock {\n"
 "    vec3 position;\n"
+"    bool directional;\n"
 "    vec3 direction;\n"
+"    float linear;\n"
+"    vec3 ambient;\n"
+"    float quadratic;\n"
+"    vec3 diffuse;\n"
+"    vec3 specular;\n"
 "    vec3 color;\n"
-"    bool directional;\n"
-"};\n"
-"struct Fog {\n"
+"} light;\n"
+"layout (std140) uniform FogBlock {\n"
 "    vec3 color;\n"
 "    float near;\n"
 "    float far;\n"
-"};\n"
+"} fog;\n"
+"uniform sampler2D diffuse_tex;\n"
+"uniform sampler2D normal_tex;\n"
+"uniform sampler2D metallic_tex;\n"
+"uniform sampler2D roughness_tex;\n"
+"uniform sampler2D ao_tex;\n"
 "in vec2 uv0;\n"
 "in vec3 wpos;\n"
 "in vec3 norm;\n"
-"uniform vec3 camera_position;\n"
-"uniform Material material;\n"
-"uniform Light light;\n"
-"uniform Fog fog;\n"
+"layout (std140) uniform CameraBlock {\n"
+"    mat4 vp;\n"
+"    vec3 camera_position;\n"
+"};\n"
 "float lin_depth(float depth) {\n"
 "    float z = depth*2.0-1.0;\n"
 "    return (2.0*fog.near*fog.far)/(fog.far+fog.near-z*(fog.far-fog.near));\n"
@@ -220,34 +268,35 @@ constexpr auto pbr_shader = "#version 330 core\n"
 "    return ggx1*ggx2;\n"
 "}\n"
 "void main() {\n"
-"    if(texture(material.diffuse_tex, uv0).a < 0.1) discard;\n"
+"    if(texture(diffuse_tex, uv0).a < 0.1) discard;\n"
 "    vec3 albedo;\n"
 "    float metallic;\n"
 "    float roughness;\n"
 "    float ao;\n"
 "    if(material.diffuse_tex_exists) {\n"
-"        albedo = pow(texture(material.diffuse_tex, uv0).rgb, vec3(2.2));\n"
+"        albedo = pow(texture(diffuse_tex, uv0).rgb, vec3(2.2));\n"
 "    } else {\n"
 "        albedo = material.albedo;\n"
 "    }\n"
 "    if(material.metallic_tex_exists) {\n"
-"        metallic = texture(material.metallic_tex, uv0).r;\n"
+"        metallic = texture(metallic_tex, uv0).r;\n"
 "    } else {\n"
 "        metallic = material.metallic;\n"
 "    }\n"
 "    if(material.roughness_tex_exists) {\n"
-"        roughness = texture(material.roughness_tex, uv0).r;\n"
+"        roughness = texture(roughness_tex, uv0).r;\n"
 "    } else {\n"
 "        roughness = material.roughness;\n"
 "    }\n"
 "    if(material.ao_tex_exists) {\n"
-"        ao = texture(material.ao_tex, uv0).r;\n"
+"        ao = texture(ao_tex, uv0).r;\n"
 "    } else {\n"
 "        ao = 1.0f;\n"
 "    }\n"
 "    vec3 normal;\n"
 "    if(material.normal_tex_exists) {\n"
-"        vec3 tangent = texture(material.normal_tex, uv0).rgb * 2.0 - 1.0;\n"
+"        vec2 txy = texture(normal_tex, uv0).rg * 2.0 - 1.0;\n"
+"        vec3 tangent = vec3(txy, sqrt(max(0.0, 1.0 - dot(txy, txy))));\n"
 "        vec3 q1 = dFdx(wpos);\n"
 "        vec3 q2 = dFdy(wpos);\n"
 "        vec2 st1 = dFdx(uv0);\n"
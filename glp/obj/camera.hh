@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+
 #include "../external/glm/glm.hpp"
 #include "../external/glm/gtc/matrix_transform.hpp"
 #include "../external/glm/gtc/type_ptr.hpp"
@@ -46,6 +48,11 @@ class Camera {
             return projection * view;
         };
 
+        // how many pixels one world unit covers at distance from the camera
+        inline float pixels_per_unit(float distance) {
+            return height / (2.0f*tan(glm::radians(fov)/2.0f)) / std::max(distance, near);
+        }
+
         inline void yaw_change(float add) { yaw += add; }
         inline void pitch_change(float add) { pitch += add; }
         inline void position_change(glm::vec3 add) { position += add; }
@@ -40,7 +40,8 @@ class BulletDebugDraw : public btIDebugDraw {
 
         inline void set_matrices(Camera& cam) {
             shader.bind();
-            shader.set("vp", cam.view_projection());
+            static const Uniform<glm::mat4> vp {"vp"};
+            shader.set(vp, cam.view_projection());
 	}
 
 	int m;
@@ -99,6 +100,7 @@ class Collidable : public CollidableInterface {
 
     public:
         inline btRigidBody* get_rigidbody() { return rigidbody; }
+        inline float get_mass() { return mass; }
 
         void setup(btCollisionShape* shape, float mass, const btVector3& position=btVector3{0.0f, 0.0f, 0.0f}, const btQuaternion& rotation=btQuaternion{0, 0, 0, 1});
 
@@ -133,22 +135,36 @@ class World {
         btDynamicsWorld* world;
 
         std::vector<CollidableInterface*> objects;
+        // renderable objects, found once when they are added
+        std::vector<Renderable*> renderables;
+        RenderQueue queue;
+        // bounding spheres and visibility of renderables, kept between frames
+        std::vector<glm::vec4> bounds;
+        std::vector<uint8_t> visible;
 
     public:
         inline btDynamicsWorld* get_bullet_world() { return world; }
+        inline const RenderStats& get_render_stats() const { return queue.get_stats(); }
 
         inline void add_collidable(CollidableInterface* c) {
             auto collidable = dynamic_cast<Collidable*>(c);
             if(collidable) {
                 world->addRigidBody(collidable->get_rigidbody());
                 objects.push_back(c);
-            }        }
+                if(auto renderable = dynamic_cast<Renderable*>(c)) renderables.push_back(renderable);
+            }
+        }
 
+        // culls renderables against the camera's frustum and draws the rest
+        // through the render queue, sorted by state
         inline void render(Camera& camera) {
-            for(auto& obj: objects) {
-                auto renderable = dynamic_cast<Renderable*>(obj);
-                if(renderable) renderable->render(camera);
-            }
+            queue.begin(camera);
+            bounds.clear();
+            for(auto& renderable: renderables) bounds.push_back(renderable->bounding_sphere());
+            queue.cull(bounds, visible);
+            for(size_t i=0; i<renderables.size(); i++)
+                if(visible[i]) renderables[i]->submit(queue, camera);
+            queue.submit(camera);
             auto deb = dynamic_cast<BulletDebugDraw*>(world->getDebugDrawer());
             if(deb) {
                 deb->set_matrices(camera);
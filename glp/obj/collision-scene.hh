@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <obj/collidable.hh>
+#include <obj/scene-data.hh>
+
+namespace glp {
+
+namespace Object {
+
+// bullet shape an object was saved with, nullptr for SCENE_SHAPE_MODEL, the object
+// then sizes a box from its model
+btCollisionShape* make_shape(const SceneObjectData& obj);
+
+// The bullet side of a .scene without any GL: objects become plain Collidables
+// and models are only decoded as ModelData, for the boxes of objects saved
+// without a shape. Lets servers and tools simulate a scene with no window or
+// context, PhysicsScene is the drawn version.
+class CollisionScene {
+    private:
+        World* world {nullptr};
+        std::vector<Collidable*> objects;
+        // index into SceneData::objects of each body, objects without a model have none
+        std::vector<size_t> indices;
+
+    public:
+        void update(float dt);
+
+        inline World* get_world() { return world; }
+        inline const std::vector<Collidable*>& get_objects() const { return objects; }
+
+        // writes the bodies' current positions and rotations back to the objects
+        // of the data the scene was built from
+        void store(SceneData& data) const;
+
+        // path is the scene's own, models are relative to it
+        CollisionScene(const SceneData& data, const std::string& path);
+        ~CollisionScene();
+
+        CollisionScene(const CollisionScene&) = delete;
+        CollisionScene& operator=(const CollisionScene&) = delete;
+};
+
+}
+
+}
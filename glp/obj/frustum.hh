@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../external/glm/glm.hpp"
+
+namespace glp {
+
+namespace Object {
+
+// The six planes bounding what a camera sees, pointing inwards and normalized so
+// a plane's dot product with a point is its distance. A default constructed
+// frustum has zero planes and contains everything.
+class Frustum {
+    private:
+        glm::vec4 planes[6] {};
+
+    public:
+        // a sphere is culled only when it is entirely behind some plane, spheres
+        // near a corner can pass while outside
+        bool contains(const glm::vec3& center, float radius) const;
+        // tests count spheres packed as center xyz and radius w, four at a time
+        // with SSE or NEON; visible gets 1 for the spheres that pass and 0 for the
+        // rest, returns how many passed
+        size_t cull(const glm::vec4* spheres, size_t count, uint8_t* visible) const;
+
+        Frustum() = default;
+        // planes of a view projection matrix, in world space
+        explicit Frustum(const glm::mat4& view_projection);
+};
+
+}
+
+}
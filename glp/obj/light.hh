@@ -10,25 +10,65 @@ namespace Object {
 class Fog {
     private:
         Shader* shader;
+#ifndef __vita__
+        // std140 FogBlock of the builtin shaders
+        struct Block {
+            glm::vec3 color;
+            float near;
+            float far;
+            float padding[3];
+        };
+        static_assert(sizeof(Block) == 32, "FogBlock has to match std140");
+        UniformBuffer block {"FogBlock", sizeof(Block)};
+#endif
         
         glm::vec3 color {0.4f, 0.4f, 0.4f};
         float near {0.1f};
         float far {100.0f};
+
+        // uniform blocks are shared, so the fog reaches every program at once;
+        // vitaGL has no blocks and gets the uniforms of the one shader
+        inline void apply() {
+#ifndef __vita__
+            Block data {color, near, far, {}};
+            block.update(&data);
+            block.bind();
+#else
+            shader->bind();
+            shader->set("fog.color", color);
+            shader->set("fog.near", near);
+            shader->set("fog.far", far);
+#endif
+        }
     public:
+        // the block binding is shared by every Fog, the one drawing has to bind
+        // its own each frame; cheap, vitaGL sets the uniforms again instead
+        inline void bind() {
+#ifndef __vita__
+            block.bind();
+#else
+            apply();
+#endif
+        }
+
         inline void set_color(glm::vec3 v) {
+            if(color == v) return;
             color = v;
-            shader->bind();
-            shader->set("fog.color", color);
+            apply();
         }
         inline void set_near(float v) {
+            if(near == v) return;
             near = v;
-            shader->bind();
-            shader->set("fog.near", near);
+            apply();
         }
         inline void set_far(float v) {
+            if(far == v) return;
             far = v;
-            shader->bind();
-            shader->set("fog.far", far);
+            apply();
+        }
+        inline void set_shader(Shader* s) {
+            shader = s;
+            apply();
         }
 
         inline glm::vec3 get_color() { return color; }
@@ -36,10 +76,7 @@ class Fog {
         inline float get_far() { return far; }
 
         Fog(Shader* s) : shader{s} {
-            shader->bind();
-            shader->set("fog.color", color);
-            shader->set("fog.near", near);
-            shader->set("fog.far", far);
+            apply();
         };
         ~Fog() = default;
 };
@@ -54,6 +91,25 @@ class Light {
         LightType type;
 
         Shader* shader;
+#ifndef __vita__
+        // std140 LightBlock of the builtin shaders
+        struct Block {
+            glm::vec3 position;
+            int32_t directional;
+            glm::vec3 direction;
+            float linear;
+            glm::vec3 ambient;
+            float quadratic;
+            glm::vec3 diffuse;
+            float padding0;
+            glm::vec3 specular;
+            float padding1;
+            glm::vec3 color;
+            float padding2;
+        };
+        static_assert(sizeof(Block) == 96, "LightBlock has to match std140");
+        UniformBuffer block {"LightBlock", sizeof(Block)};
+#endif
         
         glm::vec3 position {1.2f, 1.0f, 2.0f};
         glm::vec3 direction {-0.2f, -1.0f, -0.3f};
@@ -66,54 +122,88 @@ class Light {
         float linear {0.09f};
         float quadratic {0.032f};
 
+        // see Fog::apply
+        inline void apply() {
+            int directional = type == LightType::DIRECTIONAL ? 1 : 0;
+#ifndef __vita__
+            Block data {position, directional, direction, linear, ambient, quadratic,
+                diffuse, 0.0f, specular, 0.0f, color, 0.0f};
+            block.update(&data);
+            block.bind();
+#else
+            shader->bind();
+            shader->set("light.directional", directional);
+            shader->set("light.position", position);
+            shader->set("light.direction", direction);
+            shader->set("light.ambient", ambient);
+            shader->set("light.diffuse", diffuse);
+            shader->set("light.specular", specular);
+            shader->set("light.color", color);
+            shader->set("light.linear", linear);
+            shader->set("light.quadratic", quadratic);
+#endif
+        }
+
     public:
+        // see Fog::bind
+        inline void bind() {
+#ifndef __vita__
+            block.bind();
+#else
+            apply();
+#endif
+        }
+
         inline void set_type(LightType t) {
+            if(type == t) return;
             type = t;
-            shader->bind();
-            shader->set("light.directional", type == LightType::DIRECTIONAL ? 1 : 0);
+            apply();
         }
 
-        inline void set_shader(Shader* s) { shader = s; }
+        inline void set_shader(Shader* s) {
+            shader = s;
+            apply();
+        }
 
         inline void set_position(glm::vec3 v) {
+            if(position == v) return;
             position = v;
-            shader->bind();
-            shader->set("light.position", position);
+            apply();
         }
         inline void set_direction(glm::vec3 v) {
+            if(direction == v) return;
             direction = v;
-            shader->bind();
-            shader->set("light.direction", direction);
+            apply();
         }
         inline void set_ambient(glm::vec3 v) {
+            if(ambient == v) return;
             ambient = v;
-            shader->bind();
-            shader->set("light.ambient", ambient);
+            apply();
         }
         inline void set_diffuse(glm::vec3 v) {
+            if(diffuse == v) return;
             diffuse = v;
-            shader->bind();
-            shader->set("light.diffuse", diffuse);
+            apply();
         }
         inline void set_specular(glm::vec3 v) {
+            if(specular == v) return;
             specular = v;
-            shader->bind();
-            shader->set("light.specular", specular);
+            apply();
         }
         inline void set_color(glm::vec3 v) {
+            if(color == v) return;
             color = v;
-            shader->bind();
-            shader->set("light.color", color);
+            apply();
         }
         inline void set_linear(float v) {
+            if(linear == v) return;
             linear = v;
-            shader->bind();
-            shader->set("light.linear", linear);
+            apply();
         }
         inline void set_quadratic(float v) {
+            if(quadratic == v) return;
             quadratic = v;
-            shader->bind();
-            shader->set("light.quadratic", quadratic);
+            apply();
         }
 
         inline LightType get_type() { return type; }
@@ -125,18 +215,8 @@ class Light {
         inline float get_linear() { return linear; }
         inline float get_quadratic() { return quadratic; }
 
-        Light(LightType t, Shader* s) : shader{s} {
-            set_type(t);
-            shader->bind();
-            shader->set("light.directional", t == LightType::DIRECTIONAL ? 1 : 0);
-            shader->set("light.position", position);
-            shader->set("light.direction", direction);
-            shader->set("light.ambient", ambient);
-            shader->set("light.diffuse", diffuse);
-            shader->set("light.specular", specular);
-            shader->set("light.color", color);
-            shader->set("light.linear", linear);
-            shader->set("light.quadratic", quadratic);
+        Light(LightType t, Shader* s) : type{t}, shader{s} {
+            apply();
         }
         ~Light() = default;
 };
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "../shader.hh"
+#include "../model.hh"
+#include "camera.hh"
+#include "frustum.hh"
+
+namespace glp {
+
+namespace Object {
+
+struct RenderStats {
+    size_t items {0};
+    size_t draw_calls {0};
+    // binds that were needed, everything else was skipped as redundant
+    size_t program_changes {0};
+    size_t material_changes {0};
+    size_t mesh_changes {0};
+    size_t object_changes {0};
+    // draws that went out instanced and the objects they covered
+    size_t instanced_draws {0};
+    size_t instances {0};
+    // objects tested by cull() and meshes of visible objects dropped by add()
+    size_t visible_objects {0};
+    size_t culled_objects {0};
+    size_t culled_meshes {0};
+};
+
+// Collects a frame's draws and submits them sorted by a 64-bit key packing pass,
+// program, material, mesh and depth from the most significant bits down, so draws
+// sharing state end up next to each other and binds repeating the previous draw's
+// are skipped. Draws with the same state go front to back. Runs of draws that
+// differ only in their transform are drawn as one instanced draw when the
+// program declares the instanced uniform, as the builtin shaders do; skinned
+// runs also differing in pose when it declares pose_buffer too, which then
+// holds every instance's bones.
+class RenderQueue {
+    public:
+        static constexpr unsigned PASS_BITS = 2;
+        static constexpr unsigned PROGRAM_BITS = 10;
+        static constexpr unsigned MATERIAL_BITS = 16;
+        static constexpr unsigned MESH_BITS = 16;
+        static constexpr unsigned DEPTH_BITS = 20;
+        static_assert(PASS_BITS+PROGRAM_BITS+MATERIAL_BITS+MESH_BITS+DEPTH_BITS == 64);
+        // shorter runs are cheaper as plain draws than streaming their transforms
+        static constexpr size_t MIN_INSTANCES = 2;
+        // texture unit of pose_buffer, after the material's
+        static constexpr GLint POSE_UNIT = AO_UNIT + 1;
+
+    private:
+        struct Item {
+            uint64_t key;
+            Shader* shader;
+            ShadingType shading;
+            Mesh* mesh;
+            size_t lod;
+            glm::mat4 transform;
+            const std::vector<glm::mat4>* pose;
+            // set on the first item of an instanced run, the rest of the run is skipped
+            GLsizei instances {1};
+            size_t first_instance {0};
+        };
+
+        std::vector<Item> items;
+        // keys hold small ids handed out each frame in the order things are first
+        // queued; ids past a field's range share its last value, which only
+        // weakens the grouping
+        std::unordered_map<const void*, uint64_t> programs, materials, meshes;
+        RenderStats stats {};
+        // of the camera passed to begin(), empty and culling nothing outside a frame
+        Frustum frustum {};
+
+        uint64_t id(std::unordered_map<const void*, uint64_t>& ids, const void* p, unsigned bits);
+
+#ifndef __vita__
+        // what the instance attributes read, see INSTANCE_MODEL_ATTRIBUTE_INDEX
+        struct Instance {
+            glm::mat4 model;
+            glm::mat3 normal;
+            int32_t bones;
+        };
+
+        std::vector<Instance> instances;
+        GLuint instance_buffer {0};
+        // poses of the frame's skinned instances one after another, each pose
+        // once however many meshes draw with it, behind a texture buffer
+        std::vector<glm::mat4> bones;
+        std::unordered_map<const void*, int32_t> palettes;
+        GLuint bone_buffer {0}, bone_texture {0};
+        size_t max_bones {0};
+
+        // first bone of the pose in bones, added on first use
+        int32_t palette(const std::vector<glm::mat4>* pose);
+
+        // marks the instanced runs and streams their transforms to instance_buffer
+        // and their poses to bone_buffer
+        void batch();
+        void bind_instances(size_t first);
+        void unbind_instances();
+#endif
+
+    public:
+        // starts a frame seen by camera, resetting the stats
+        void begin(Camera& camera);
+        // tests bounding spheres packed as in Renderable::bounding_sphere against
+        // the frame's frustum, visible gets 1 for each one to submit
+        void cull(const std::vector<glm::vec4>& spheres, std::vector<uint8_t>& visible);
+        // queues every uploaded mesh of the model at the lod its screen size allows,
+        // see Model::render; pose is sent with each of the model's draws. lower
+        // passes are drawn first. meshes of unposed models with several of them
+        // are culled one by one
+        void add(Model* model, const glm::mat4& transform, float pixels_per_unit, Camera& camera,
+                const std::vector<glm::mat4>* pose=nullptr, uint8_t pass=0);
+        // draws and empties the queue, leaving no program or vertex array bound
+        void submit(Camera& camera);
+
+        // counts of the last frame, from begin() to submit()
+        inline const RenderStats& get_stats() const { return stats; }
+
+        RenderQueue() = default;
+        ~RenderQueue();
+
+        RenderQueue(const RenderQueue&) = delete;
+        RenderQueue& operator=(const RenderQueue&) = delete;
+};
+
+}
+
+}
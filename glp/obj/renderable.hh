@@ -4,11 +4,17 @@
 #include "../model.hh"
 #include "../anim.hh"
 #include "camera.hh"
+#include "render-queue.hh"
 
 namespace glp {
 
 namespace Object {
 
+// camera and model matrix uniforms of the builtin shaders; the shader has to be
+// bound. with uniform blocks a camera equal to the last one sent is skipped
+void send_camera(Shader* shader, Camera& camera);
+void send_transform(Shader* shader, const glm::mat4& transform);
+
 class Renderable {
     protected:
         Shader* shader {nullptr};
@@ -16,6 +22,9 @@ class Renderable {
 
         glm::mat4 transform {1.0f};
 
+        // pixels per object space unit at the model's distance, used to pick lods
+        float lod_scale(Camera& camera);
+
     public: 
         inline void translate(glm::vec3 translation) { transform = glm::translate(glm::mat4(1.0f), translation); }
         inline void rotate(float rad, glm::vec3 axis) { transform = glm::rotate(transform, glm::radians(rad), axis); }
@@ -23,6 +32,10 @@ class Renderable {
 
         void load(const std::string& path, Shader* shader, ShadingType shading_type=ShadingType::PBR);
         void render(Camera& camera);
+        // queues the model's meshes instead of drawing them right away
+        virtual void submit(RenderQueue& queue, Camera& camera);
+        // world space center in xyz and radius in w, for culling
+        virtual glm::vec4 bounding_sphere();
 
         inline Model* get_model() { return model; }
         inline glm::mat4 get_transform() { return transform; }
@@ -60,6 +73,10 @@ class Animated: public Renderable {
         void set_path(const std::string& p) { animation_path = p; }
 
         void render(Camera& camera);
+        void submit(RenderQueue& queue, Camera& camera) override;
+        // the pose can move vertices past the bind pose bounds, animated models
+        // report an infinite sphere and are never culled
+        glm::vec4 bounding_sphere() override;
 
         Animated(const std::string& path, const std::string& anim_path, float* dt_, Shader* shader, ShadingType shading_type);
         Animated(Model* model, const std::string& anim_path, float* dt_, Shader* shader, ShadingType shading_type);
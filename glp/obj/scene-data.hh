@@ -0,0 +1,67 @@
+#pragma once
+
+#include <istream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../external/glm/glm.hpp"
+#include "../external/glm/gtc/quaternion.hpp"
+
+#include "../format.hh"
+
+namespace glp {
+
+namespace Object {
+
+struct SceneObjectData {
+    // index into SceneData::models, -1 for objects without a model
+    int32_t model {-1};
+    float mass {0.0f};
+    glm::vec3 position {0.0f};
+    glm::quat rotation {1.0f, 0.0f, 0.0f, 0.0f};
+
+    // text scenes store no shapes, so their objects get a box around the model
+    format::SceneShape shape {format::SCENE_SHAPE_MODEL};
+    glm::vec3 extents {0.0f};
+};
+
+// cpu side of a .scene: settings, model paths relative to the scene and objects.
+// reading and writing it never touches GL or bullet. PhysicsScene is built from it,
+// CollisionScene too when there is no GL context
+struct SceneData {
+    float camera_fov {60.0f};
+    float camera_near {0.1f};
+    float camera_far {100.0f};
+    glm::vec3 camera_position {0.0f, 1.0f, 3.0f};
+    float player_speed {25.0f};
+
+    glm::vec3 fog_color {0.0f};
+    float fog_near {0.0f};
+    float fog_far {0.0f};
+
+    bool light_directional {true};
+    glm::vec3 light_position {0.0f};
+    glm::vec3 light_direction {0.0f};
+    glm::vec3 light_ambient {0.0f};
+    glm::vec3 light_diffuse {0.0f};
+    glm::vec3 light_specular {0.0f};
+    float light_linear {0.0f};
+    float light_quadratic {0.0f};
+
+    // every path once, objects refer to them by index
+    std::vector<std::string> models;
+    std::vector<SceneObjectData> objects;
+
+    // text or binary .scene, false when it could not be read
+    bool load(const std::string& path);
+    bool deserialize_data(std::istream& s);
+    bool deserialize_binary(std::istream& s);
+
+    std::stringstream serialize_data() const;
+    std::string serialize_binary() const;
+};
+
+}
+
+}
@@ -2,18 +2,30 @@
 
 #include "LinearMath/btIDebugDraw.h"
 #include "material.hh"
+#include "loader.hh"
 #include "utils.hh"
 #include <obj/camera.hh>
 #include <obj/player.hh>
 #include <obj/light.hh>
 #include <obj/collidable.hh>
 #include <obj/renderable.hh>
+#include <obj/scene-data.hh>
 #include <sstream>
 
 namespace glp {
 
 namespace Object {
 
+struct PendingObject {
+    std::shared_future<Model*> model;
+    ShadingType shading;
+    float mass;
+    btVector3 position;
+    btQuaternion rotation;
+    // owned until the object is added, nullptr sizes a box from the model
+    btCollisionShape* shape {nullptr};
+};
+
 class PhysicsScene {
     private:
         Shader* shader {nullptr};
@@ -30,17 +42,28 @@ class PhysicsScene {
 
         std::vector<CollRenderableModel*> objects;
 
-        void deserialize_data(std::stringstream& s, size_t width, size_t height, std::vector<SDL_Event>* ev, ShadingType shading_t, const std::string& path);
+        Loader* loader {nullptr};
+        std::map<std::string, std::shared_future<Model*>> streamed_models;
+        std::vector<PendingObject> pending;
+        float upload_budget {2.0f};
+
+        void add_pending_objects();
+        void build(const SceneData& data, size_t width, size_t height, std::vector<SDL_Event>* ev, ShadingType shading_t, const std::string& path, bool stream);
 
     public:
         PhysicsScene(size_t width, size_t height, std::vector<SDL_Event>* ev, Shader* shader_);
         PhysicsScene(size_t width, size_t height, std::vector<SDL_Event>* ev, Shader* shader_, Camera* camera_, bool instantiate_player=true);
-        PhysicsScene(const std::string& path, size_t width, size_t height, std::vector<SDL_Event>* ev, Shader* shader_, ShadingType shading_t);
+        PhysicsScene(const std::string& path, size_t width, size_t height, std::vector<SDL_Event>* ev, Shader* shader_, ShadingType shading_t, bool stream=false);
 
         void new_object(CollRenderableModel* object);
+        // loads the model in the background and adds the object once it is on the GPU
+        void stream_object(const std::string& path, ShadingType shading_t, float mass, const btVector3& position=btVector3{0.0f, 0.0f, 0.0f}, const btQuaternion& rotation=btQuaternion{0, 0, 0, 1});
 
         void update(float dt);
 
+        inline void set_upload_budget(float ms) { upload_budget = ms; }
+        inline size_t get_pending_count() { return pending.size(); }
+
         inline void set_debug(bool b) { debug_draw->setDebugMode(b ? btIDebugDraw::DBG_DrawWireframe : 0); }
 
         inline Camera& get_camera() { return *camera; }
@@ -50,7 +73,10 @@ class PhysicsScene {
         inline World* get_world() { return world; }
         inline std::vector<CollRenderableModel*> get_objects() { return objects; }
 
+        // settings and objects as they are now, models are listed once
+        SceneData get_data();
         std::stringstream serialize_data();
+        std::string serialize_binary();
 
         ~PhysicsScene();
 };
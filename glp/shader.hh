@@ -2,6 +2,7 @@
 
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #ifndef __vita__
@@ -22,33 +23,117 @@
 
 namespace glp {
 
+// process-wide index of a uniform name, 0 is reserved for no uniform
+uint32_t uniform_slot(const std::string& name);
+
+// uniform looked up by name once, when the handle is made. every shader maps the
+// slot to its own location on first use, so one handle serves all shaders that
+// declare the uniform and stays valid across Shader::reload
+template <typename T>
+struct Uniform {
+    uint32_t slot {0};
+
+    Uniform() {};
+    explicit Uniform(const std::string& name) : slot{uniform_slot(name)} {};
+};
+
+// texture unit a sampler uniform of this name is set to whenever a program links,
+// so draws only bind textures
+void set_sampler_unit(const std::string& name, GLint unit);
+
+#ifndef __vita__
+// binding point of a named uniform block, the same in every program
+GLuint uniform_block_binding(const std::string& name);
+
+// std140 buffer of a named uniform block, read by every program that declares
+// the block until another buffer of the block is bound
+class UniformBuffer {
+    private:
+        GLuint ubo {0};
+        GLuint binding;
+        size_t size;
+
+    public:
+        // replaces the whole contents, orphaning the old storage so draws still
+        // reading it don't stall
+        void update(const void* data);
+        inline void bind() const { glBindBufferBase(GL_UNIFORM_BUFFER, binding, ubo); }
+
+        UniformBuffer(const std::string& block, size_t size);
+        ~UniformBuffer();
+
+        UniformBuffer(const UniformBuffer&) = delete;
+        UniformBuffer& operator=(const UniformBuffer&) = delete;
+};
+#endif
+
 class Shader {
     private:
+        // slots not looked up in this program yet, -1 is GL's missing uniform
+        static constexpr GLint UNRESOLVED = -2;
+
         GLuint handle;
+        // locations of the active uniforms, reflected at link; names looked up
+        // that are not active, like single array elements, are added as they come
+        mutable std::unordered_map<std::string, GLint> locations;
+        // location of each uniform slot in this program
+        mutable std::vector<GLint> slots;
+        // sources of shaders made from files, empty for ones made from code
+        std::string vertex_path;
+        std::string fragment_path;
 
         GLuint compile(const GLenum shader, const std::string& code);
-        bool link_shaders(GLuint vertex, GLuint fragment);
+        bool link_shaders(GLuint program, GLuint vertex, GLuint fragment);
         void make(const std::string& v, const std::string& f);
+        // fills locations from the linked program and forgets resolved slots,
+        // then connects uniform blocks and samplers to their shared bindings
+        void reflect();
+        GLint resolve(uint32_t slot) const;
+
+        inline GLint location(uint32_t slot) const {
+            if(slot < slots.size() && slots[slot] != UNRESOLVED) return slots[slot];
+            return resolve(slot);
+        }
     public:
         Shader(const std::string& vertex, const std::string& fragment, bool from_path=true);
 
         inline ~Shader() {
-            glDeleteShader(handle);
+            glDeleteProgram(handle);
         }
 
+        inline const std::string& get_vertex_path() const { return vertex_path; }
+        inline const std::string& get_fragment_path() const { return fragment_path; }
+
+        // relinks from new code, keeping attribute locations so existing vertex
+        // arrays still match and carrying uniform values over; on a compile or
+        // link error the current program stays and false is returned
+        bool reload(const std::string& vertex_code, const std::string& fragment_code);
+
         inline void bind() { glUseProgram(handle); }
         inline void unbind() { glUseProgram(0); }
 
         inline GLuint get() const { return handle; }
+        GLint location(const std::string& name) const;
+
+        inline void set(Uniform<int> u, int value) const { glUniform1i(location(u.slot), value); }
+        inline void set(Uniform<float> u, float value) const { glUniform1f(location(u.slot), value); }
+        inline void set(Uniform<glm::vec2> u, const glm::vec2& value) const { glUniform2fv(location(u.slot), 1, &value[0]); }
+        inline void set(Uniform<glm::vec3> u, const glm::vec3& value) const { glUniform3fv(location(u.slot), 1, &value[0]); }
+        inline void set(Uniform<glm::vec4> u, const glm::vec4& value) const { glUniform4fv(location(u.slot), 1, &value[0]); }
+        inline void set(Uniform<glm::quat> u, const glm::quat& value) const { glUniform4fv(location(u.slot), 1, &value[0]); }
+        inline void set(Uniform<glm::mat4> u, const glm::mat4& value) const { glUniformMatrix4fv(location(u.slot), 1, GL_FALSE, &value[0][0]); }
+        inline void set(Uniform<std::vector<glm::mat4>> u, const std::vector<glm::mat4>& value) const { glUniformMatrix4fv(location(u.slot), value.size(), GL_FALSE, &value.data()[0][0][0]); }
+
+        // by name, hashed into the reflected table; per draw uniforms use handles
 
-        inline void set(const std::string& name, int value) const { glUniform1i(glGetUniformLocation(handle, name.c_str()), value); }
-        inline void set(const std::string& name, float value) const { glUniform1f(glGetUniformLocation(handle, name.c_str()), value); }
-        inline void set(const std::string& name, const glm::vec2& value) const { glUniform2fv(glGetUniformLocation(handle, name.c_str()), 1, &value[0]); }
-        inline void set(const std::string& name, const glm::vec3& value) const { glUniform3fv(glGetUniformLocation(handle, name.c_str()), 1, &value[0]); }
-        inline void set(const std::string& name, const glm::vec4& value) const { glUniform4fv(glGetUniformLocation(handle, name.c_str()), 1, &value[0]); }
-        inline void set(const std::string& name, const glm::quat& value) const { glUniform4fv(glGetUniformLocation(handle, name.c_str()), 1, &value[0]); }
-        inline void set(const std::string& name, const glm::mat4& value) const { glUniformMatrix4fv(glGetUniformLocation(handle, name.c_str()), 1, GL_FALSE, &value[0][0]); }
-        inline void set(const std::string& name, const std::vector<glm::mat4>& value) const { glUniformMatrix4fv(glGetUniformLocation(handle, name.c_str()), value.size(), GL_FALSE, &value.data()[0][0][0]); }
+        inline void set(const std::string& name, int value) const { glUniform1i(location(name), value); }
+        inline void set(const std::string& name, float value) const { glUniform1f(location(name), value); }
+        inline void set(const std::string& name, const glm::vec2& value) const { glUniform2fv(location(name), 1, &value[0]); }
+        inline void set(const std::string& name, const glm::vec3& value) const { glUniform3fv(location(name), 1, &value[0]); }
+        inline void set(const std::string& name, const glm::vec4& value) const { glUniform4fv(location(name), 1, &value[0]); }
+        inline void set(const std::string& name, const glm::quat& value) const { glUniform4fv(location(name), 1, &value[0]); }
+        inline void set(const std::string& name, const glm::mat4& value) const { glUniformMatrix4fv(location(name), 1, GL_FALSE, &value[0][0]); }
+        inline void set(const std::string& name, const std::vector<glm::mat4>& value) const { glUniformMatrix4fv(location(name), value.size(), GL_FALSE, &value.data()[0][0][0]); }
 
         Shader(const Shader&) = delete;
         Shader& operator=(const Shader&) = delete;
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <istream>
+#include <streambuf>
 #include <string>
+#include <vector>
 #include <zstd.h>
 
 #ifndef __vita__
@@ -23,9 +26,103 @@ namespace glp {
 
 namespace util {
 
+constexpr int DEFAULT_COMPRESS_LEVEL = 19;
+
 std::string read_file(const std::string& path);
-std::string compress(const std::string& data, int compress_level);
+std::string compress(const std::string& data, int compress_level, unsigned dict_id=0);
 std::string decompress(const std::string& data);
+std::string decompress(const char* data, size_t size);
+
+bool is_compressed(const char* data, size_t size);
+
+// trained dictionaries are registered by their id, which zstd also stores in
+// the header of every frame compressed with them; returns 0 on failure
+unsigned load_dictionary(const std::string& path);
+unsigned add_dictionary(const std::string& data);
+
+// decompression contexts are pooled so loads reuse their allocations
+ZSTD_DCtx* acquire_dctx();
+void release_dctx(ZSTD_DCtx* ctx);
+
+// 64-bit FNV-1a, used to identify asset contents
+uint64_t hash(const char* data, size_t size);
+
+// read-only view of a whole file, memory mapped where the platform allows it;
+// files inside a mounted pak are viewed in place in the pak's mapping
+class MappedFile {
+    private:
+        void* map {nullptr};
+        const char* view {nullptr};
+        size_t length {0};
+        std::string fallback {};
+
+    public:
+        inline const char* data() const {
+            if(map) return static_cast<const char*>(map);
+            return view ? view : fallback.data();
+        }
+        inline size_t size() const { return map || view ? length : fallback.size(); }
+
+        MappedFile(const std::string& path);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+};
+
+class MemoryStreamBuf : public std::streambuf {
+    public:
+        inline void set(const char* data, size_t size) {
+            auto begin = const_cast<char*>(data);
+            setg(begin, begin, begin+size);
+        }
+
+        MemoryStreamBuf() {}
+        MemoryStreamBuf(const char* data, size_t size) { set(data, size); }
+};
+
+// decompresses a zstd frame in memory chunk by chunk through a fixed-size
+// buffer; large reads are decompressed straight into the caller's memory
+class DecompressStreamBuf : public std::streambuf {
+    private:
+        ZSTD_DCtx* ctx {nullptr};
+        ZSTD_inBuffer input {nullptr, 0, 0};
+        std::vector<char> buffer;
+
+        size_t decompress_into(char* dst, size_t size);
+
+    protected:
+        int_type underflow() override;
+        std::streamsize xsgetn(char* s, std::streamsize n) override;
+
+    public:
+        void open(const char* data, size_t size);
+
+        DecompressStreamBuf() {}
+        ~DecompressStreamBuf();
+
+        DecompressStreamBuf(const DecompressStreamBuf&) = delete;
+        DecompressStreamBuf& operator=(const DecompressStreamBuf&) = delete;
+};
+
+// asset file exposed as an istream: raw files are parsed straight out of the
+// mapping, zstd frames are streamed out of it with a bounded buffer
+class AssetStream {
+    private:
+        MappedFile file;
+        MemoryStreamBuf raw {};
+        DecompressStreamBuf zstd {};
+        std::istream stream {nullptr};
+
+    public:
+        inline std::istream& get() { return stream; }
+        inline bool empty() const { return file.size() == 0; }
+
+        AssetStream(const std::string& path);
+
+        AssetStream(const AssetStream&) = delete;
+        AssetStream& operator=(const AssetStream&) = delete;
+};
 
 inline bool glerr() {
     GLenum err;
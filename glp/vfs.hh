@@ -0,0 +1,51 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "format.hh"
+#include "utils.hh"
+
+namespace glp {
+
+// memory mapped .pak archive, files are looked up by path hash
+class Pak {
+    private:
+        util::MappedFile file;
+        std::string root;
+
+        const format::PakHeader* header {nullptr};
+        const format::PakEntry* entries {nullptr};
+        const char* strings {nullptr};
+
+    public:
+        inline bool is_open() const { return header != nullptr; }
+        inline const std::string& get_root() const { return root; }
+        inline size_t get_entry_count() const { return header ? header->entry_count : 0; }
+
+        // path is relative to the packed directory, returns false when missing
+        bool find(const std::string& path, const char*& data, size_t& size) const;
+
+        Pak(const std::string& path, const std::string& root);
+
+        Pak(const Pak&) = delete;
+        Pak& operator=(const Pak&) = delete;
+};
+
+namespace vfs {
+
+// normalized, '/' separated form used for pack entries and lookups
+std::string normalize(const std::string& path);
+
+// files under root resolve through the pack before the real filesystem,
+// packs mounted later take precedence
+bool mount(const std::string& pak_path, const std::string& root="");
+void unmount_all();
+
+// finds path in the mounted packs, data stays valid until unmount_all()
+bool find(const std::string& path, const char*& data, size_t& size);
+
+}
+
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "model.hh"
+#include "material.hh"
+#include "anim.hh"
+#include "shader.hh"
+
+namespace glp {
+
+// Reloads assets whose files change on disk. A thread waits on inotify for
+// writes in the directories of watched files and decodes new versions, while
+// process(), called once per frame on the main thread, swaps them into the
+// existing handles. Everything holding a Model, Texture, Animation or Shader
+// pointer sees the new contents from that frame on.
+class AssetWatcher {
+    private:
+        struct Watch {
+            uint64_t generation;
+            // files that reload the asset itself
+            std::vector<std::string> files;
+            // runs on the watcher thread, the returned function swaps the new
+            // version in on the main thread; empty when decoding failed
+            std::function<std::function<void()>()> prepare;
+            // textures the asset draws with, they reload on their own
+            std::function<std::vector<Texture*>()> textures;
+        };
+
+        struct Pending {
+            // nullptr for texture reloads, which look their texture up when applied
+            const void* handle;
+            uint64_t generation;
+            std::function<void()> apply;
+        };
+
+        std::map<const void*, Watch> watches;
+        std::set<std::string> texture_files;
+        // inotify watch descriptor of each watched directory
+        std::map<int, std::string> directories;
+        uint64_t next_generation {0};
+        std::mutex mutex;
+
+        std::deque<Pending> pending;
+        std::mutex pending_mutex;
+
+        int inotify_fd {-1};
+        std::atomic<bool> stopping {false};
+        std::thread thread;
+
+        void work();
+        void reload(const std::string& path);
+        std::function<void()> prepare_texture(const std::string& path);
+        Texture* find_texture(const std::string& path);
+        void add(const void* handle, Watch&& watch);
+        // rescans the textures of every watch after watches or reloads changed them
+        void refresh();
+        void add_directory(const std::string& file);
+
+    public:
+        // reloads the model file and its textures; physics shapes and animations
+        // made from the model keep the old data
+        void watch(Model* model);
+        void watch(Texture* tex);
+        // only shaders made from paths, code has no file to watch
+        void watch(Shader* shader);
+        // the animation is reparsed on the main thread against the model's bones
+        void watch(Animation::Animation* anim, const ModelData* model);
+        // has to be called before a watched asset is deleted
+        void unwatch(const void* handle);
+
+        // swaps in every reload decoded since the last call, returns how many
+        size_t process();
+
+        AssetWatcher();
+        ~AssetWatcher();
+
+        AssetWatcher(const AssetWatcher&) = delete;
+        AssetWatcher& operator=(const AssetWatcher&) = delete;
+};
+
+}
@@ -1,4 +1,8 @@
+#include <algorithm>
+#include <limits>
+
 #include "anim.hh"
+#include "format.hh"
 #include "external/glm/glm.hpp"
 #include "external/glm/gtc/matrix_transform.hpp"
 #include "external/glm/gtc/type_ptr.hpp"
@@ -15,14 +19,14 @@ namespace Animation {
 #ifdef USE_ASSIMP
 void Node::assimp_set_keys(const aiNodeAnim* channel) {
     for(size_t i=0; i<channel->mNumPositionKeys; i++)
-        positions.emplace_back(
+        positions.add(
                 glm::vec3(channel->mPositionKeys[i].mValue.x,
                     channel->mPositionKeys[i].mValue.y,
                     channel->mPositionKeys[i].mValue.z),
                 channel->mPositionKeys[i].mTime);
 
     for(size_t i=0; i<channel->mNumRotationKeys; i++)
-        rotations.emplace_back(
+        rotations.add(
                 glm::quat(channel->mRotationKeys[i].mValue.w,
                     channel->mRotationKeys[i].mValue.x,
                     channel->mRotationKeys[i].mValue.y,
@@ -30,7 +34,7 @@ void Node::assimp_set_keys(const aiNodeAnim* channel) {
                 channel->mRotationKeys[i].mTime);
 
     for(size_t i=0; i<channel->mNumScalingKeys; i++)
-        scales.emplace_back(
+        scales.add(
                 glm::vec3(channel->mScalingKeys[i].mValue.x,
                     channel->mScalingKeys[i].mValue.y,
                     channel->mScalingKeys[i].mValue.z),
@@ -45,58 +49,112 @@ void Node::update(float time) {
     local_transform = t*r*s;
 }
 
-int Node::get_position_index(float time) {
-    for(size_t i=0; i<positions.size()-1; i++)
-        if(time < positions[i+1].time) return i;
-    return -1;
+constexpr float QUANTIZED_MAX = 65535.0f;
+// smallest three components lie within +-1/sqrt(2), stored with 15 bits
+constexpr float SMALLEST_THREE_RANGE = 0.70710678f;
+constexpr float SMALLEST_THREE_MAX = 32767.0f;
+
+template <>
+void Channel<glm::vec3>::pack() {
+    if(values.empty()) return;
+    glm::vec3 max = values[0];
+    range_min = values[0];
+    for(const auto& v: values) {
+        range_min = glm::min(range_min, v);
+        max = glm::max(max, v);
+    }
+    range_extent = max - range_min;
+    packed.resize(values.size()*3);
+    for(size_t i=0; i<values.size(); i++)
+        for(size_t k=0; k<3; k++)
+            packed[i*3+k] = range_extent[k] > 0.0f
+                ? std::round((values[i][k]-range_min[k])/range_extent[k] * QUANTIZED_MAX) : 0;
+    std::vector<glm::vec3>{}.swap(values);
 }
 
-int Node::get_rotation_index(float time) {
-    for(size_t i=0; i<rotations.size()-1; i++)
-        if(time < rotations[i+1].time) return i;
-    return -1;
+template <>
+glm::vec3 Channel<glm::vec3>::unpack(size_t i) const {
+    return range_min + glm::vec3(packed[i*3], packed[i*3+1], packed[i*3+2])/QUANTIZED_MAX * range_extent;
 }
 
-int Node::get_scale_index(float time) {
-    for(size_t i=0; i<scales.size()-1; i++)
-        if(time < scales[i+1].time) return i;
-    return -1;
+template <>
+void Channel<glm::quat>::pack() {
+    if(values.empty()) return;
+    packed.resize(values.size()*3);
+    for(size_t i=0; i<values.size(); i++) {
+        auto q = glm::normalize(values[i]);
+        float c[4] {q.x, q.y, q.z, q.w};
+        size_t largest = 0;
+        for(size_t k=1; k<4; k++)
+            if(std::fabs(c[k]) > std::fabs(c[largest])) largest = k;
+        // q and -q are the same rotation, keep the dropped component positive
+        float sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+        uint16_t small[3];
+        for(size_t k=0, j=0; k<4; k++) {
+            if(k == largest) continue;
+            float v = std::clamp(sign*c[k]/SMALLEST_THREE_RANGE, -1.0f, 1.0f);
+            small[j++] = std::round((v*0.5f+0.5f) * SMALLEST_THREE_MAX);
+        }
+        // the index of the dropped component goes in the top bits of the first two
+        packed[i*3] = small[0] | (largest & 1) << 15;
+        packed[i*3+1] = small[1] | (largest >> 1) << 15;
+        packed[i*3+2] = small[2];
+    }
+    std::vector<glm::quat>{}.swap(values);
+}
+
+template <>
+glm::quat Channel<glm::quat>::unpack(size_t i) const {
+    const uint16_t* p = &packed[i*3];
+    size_t largest = (p[0] >> 15) | (p[1] >> 15) << 1;
+    float c[4];
+    float sum = 0.0f;
+    for(size_t k=0, j=0; k<4; k++) {
+        if(k == largest) continue;
+        c[k] = ((p[j++] & 0x7fff)/SMALLEST_THREE_MAX*2.0f - 1.0f) * SMALLEST_THREE_RANGE;
+        sum += c[k]*c[k];
+    }
+    c[largest] = std::sqrt(std::max(0.0f, 1.0f-sum));
+    return glm::quat(c[3], c[0], c[1], c[2]);
 }
 
-float Node::get_scale_factor(float last, float next, float time) {
-    float mid = time - last;
-    float dif = next - last;
-    return mid/dif;
+size_t Node::get_index(const std::vector<float>& times, float time, float& factor) {
+    factor = 0.0f;
+    if(times.size() < 2 || time <= times.front()) return 0;
+    if(time >= times.back()) return times.size()-1;
+    size_t i = std::upper_bound(times.begin(), times.end(), time) - times.begin() - 1;
+    factor = (time - times[i]) / (times[i+1] - times[i]);
+    return i;
 }
 
 glm::mat4 Node::interpolate_position(float time) {
     if(positions.size() <= 0) return glm::mat4(1.0f);
-    int p = get_position_index(time);
-    int n = p+1;
-    float factor = get_scale_factor(positions[p].time, positions[n].time, time);
-    glm::vec3 pos = glm::mix(positions[p].value, positions[n].value, factor);
+    float factor;
+    size_t p = get_index(positions.times, time, factor);
+    size_t n = std::min(p+1, positions.size()-1);
+    glm::vec3 pos = glm::mix(positions.get(p), positions.get(n), factor);
     return glm::translate(glm::mat4(1.0f), pos);
 }
 
 glm::mat4 Node::interpolate_rotation(float time) {
     if(rotations.size() <= 0) return glm::mat4(1.0f);
-    int p = get_rotation_index(time);
-    int n = p+1;
-    float factor = get_scale_factor(rotations[p].time, rotations[n].time, time);
-    glm::quat rot = glm::slerp(rotations[p].value, rotations[n].value, factor);
+    float factor;
+    size_t p = get_index(rotations.times, time, factor);
+    size_t n = std::min(p+1, rotations.size()-1);
+    glm::quat rot = glm::slerp(rotations.get(p), rotations.get(n), factor);
     return glm::toMat4(rot);
 }
 
 glm::mat4 Node::interpolate_scale(float time) {
     if(scales.size() <= 0) return glm::mat4(1.0f);
-    int p = get_scale_index(time);
-    int n = p+1;
-    float factor = get_scale_factor(scales[p].time, scales[n].time, time);
-    glm::vec3 scale = glm::mix(scales[p].value, scales[n].value, factor);
+    float factor;
+    size_t p = get_index(scales.times, time, factor);
+    size_t n = std::min(p+1, scales.size()-1);
+    glm::vec3 scale = glm::mix(scales.get(p), scales.get(n), factor);
     return glm::scale(glm::mat4(1.0f), scale);
 }
 
-Animation::Animation(const std::string& path, const Model& model) {
+Animation::Animation(const std::string& path, const ModelData& model) : path(path) {
 #ifdef USE_ASSIMP
     Assimp::Importer import;
     const aiScene* scene = import.ReadFile(path, aiProcess_Triangulate);
@@ -126,11 +184,9 @@ Animation::Animation(const std::string& path, const Model& model) {
         node->assimp_set_keys(chan);
     }
 #else
-    auto file = util::read_file(path);
-    auto decompressed = util::decompress(file);
-    std::stringstream s;
-    s << decompressed;
-    deserialize_data(model, s);
+    util::AssetStream s{path};
+    if(format::is_binary(s.get())) deserialize_binary(model, s.get());
+    else deserialize_data(model, s.get());
 #endif
 }
 
@@ -142,7 +198,22 @@ void Animation::clear_nodes(Node* parent) {
 }
 
 Animation::~Animation() {
-    clear_nodes(root_node);
+    if(root_node) clear_nodes(root_node);
+}
+
+void Animation::swap(Animation& other) {
+    std::swap(name, other.name);
+    std::swap(path, other.path);
+    std::swap(duration, other.duration);
+    std::swap(ticks_per_second, other.ticks_per_second);
+    std::swap(root_node, other.root_node);
+}
+
+static int find_bone(const ModelData& m, const std::string& name) {
+    const auto& bones = m.get_bone_info();
+    for(size_t i=0; i<bones.size(); i++)
+        if(bones[i].name == name) return i;
+    return -1;
 }
 
 Node* Animation::find_node(Node* root, const std::string& name) {
@@ -155,7 +226,7 @@ Node* Animation::find_node(Node* root, const std::string& name) {
 }
 
 #ifdef USE_ASSIMP
-void Animation::read_assimp_hierarchy(Node* dest, const aiNode* src, const Model& m) {
+void Animation::read_assimp_hierarchy(Node* dest, const aiNode* src, const ModelData& m) {
     dest->name = src->mName.C_Str();
     for(int i=0; i<m.get_bone_info().size(); i++) {
         auto bone = m.get_bone_info().at(i);
@@ -179,7 +250,6 @@ Animator::Animator(Animation* animation, Model* m)
 }
 
 void Animator::update(float dt) {
-    model->get_shader()->set("pose", bone_mat);
     delta_time = dt;
     if(current_animation) {
         current_time += current_animation->get_tps()*dt;
@@ -211,23 +281,23 @@ void Animation::serialize_nodes(Node* parent, std::stringstream& s) {
     s << "node " << parent->name << ' ';
     s << "pk " << parent->positions.size() << ' ';
     for(size_t i=0; i<parent->positions.size(); i++)
-        s << "p " << parent->positions[i].value.x << ' '
-            << parent->positions[i].value.y << ' '
-            << parent->positions[i].value.z << ' '
-            << parent->positions[i].time << ' ';
+        s << "p " << parent->positions.get(i).x << ' '
+            << parent->positions.get(i).y << ' '
+            << parent->positions.get(i).z << ' '
+            << parent->positions.times[i] << ' ';
     s << "rk " << parent->rotations.size() << ' ';
     for(size_t i=0; i<parent->rotations.size(); i++)
-        s << "r " << parent->rotations[i].value.w << ' '
-            << parent->rotations[i].value.x << ' '
-            << parent->rotations[i].value.y << ' '
-            << parent->rotations[i].value.z << ' '
-            << parent->rotations[i].time << ' ';
+        s << "r " << parent->rotations.get(i).w << ' '
+            << parent->rotations.get(i).x << ' '
+            << parent->rotations.get(i).y << ' '
+            << parent->rotations.get(i).z << ' '
+            << parent->rotations.times[i] << ' ';
     s << "sk " << parent->scales.size() << ' ';
     for(size_t i=0; i<parent->scales.size(); i++)
-        s << "s " << parent->scales[i].value.x << ' '
-            << parent->scales[i].value.y << ' '
-            << parent->scales[i].value.z << ' '
-            << parent->scales[i].time << ' ';
+        s << "s " << parent->scales.get(i).x << ' '
+            << parent->scales.get(i).y << ' '
+            << parent->scales.get(i).z << ' '
+            << parent->scales.times[i] << ' ';
 
     s << "cdn " << parent->children.size() << ' ';
     for(size_t i=0; i<parent->children.size(); i++)
@@ -237,13 +307,15 @@ void Animation::serialize_nodes(Node* parent, std::stringstream& s) {
 
 std::stringstream Animation::serialize_data() {
     std::stringstream s;
+    // enough digits for floats to read back exactly
+    s.precision(std::numeric_limits<float>::max_digits10);
     if(name.empty()) name = "anim";
     s << name << ' ' << duration << ' ' << ticks_per_second << ' ';
     serialize_nodes(root_node, s);
     return s;
 }
 
-void Animation::deserialize_nodes(Node*& parent, const Model& m, std::stringstream& s) {
+void Animation::deserialize_nodes(Node*& parent, const ModelData& m, std::istream& s) {
     std::string name;
     size_t count;
     s >> name; 
@@ -251,41 +323,37 @@ void Animation::deserialize_nodes(Node*& parent, const Model& m, std::stringstre
     s >> name;
     parent->name = name;
     glp_logv("%s", parent->name.c_str());
-    for(int i=0; i<m.get_bone_info().size(); i++) {
-        auto bone = m.get_bone_info().at(i);
-        if(bone.name == parent->name)
-            parent->bone_index = i;
-    }
+    parent->bone_index = find_bone(m, parent->name);
     s >> name; assert(name == "pk");
     s >> count;
     parent->positions.resize(count);
     for(size_t i=0; i<parent->positions.size(); i++) {
         s >> name; assert(name == "p");
-        s >> parent->positions[i].value.x
-            >> parent->positions[i].value.y 
-            >> parent->positions[i].value.z
-            >> parent->positions[i].time;
+        s >> parent->positions.values[i].x
+            >> parent->positions.values[i].y 
+            >> parent->positions.values[i].z
+            >> parent->positions.times[i];
     }
     s >> name; assert(name == "rk");
     s >> count;
     parent->rotations.resize(count);
     for(size_t i=0; i<parent->rotations.size(); i++) {
         s >> name; assert(name == "r");
-        s >> parent->rotations[i].value.w
-            >> parent->rotations[i].value.x 
-            >> parent->rotations[i].value.y 
-            >> parent->rotations[i].value.z
-            >> parent->rotations[i].time;
+        s >> parent->rotations.values[i].w
+            >> parent->rotations.values[i].x 
+            >> parent->rotations.values[i].y 
+            >> parent->rotations.values[i].z
+            >> parent->rotations.times[i];
     }
     s >> name; assert(name == "sk");
     s >> count;
     parent->scales.resize(count);
     for(size_t i=0; i<parent->scales.size(); i++) {
         s >> name; assert(name == "s");
-        s >> parent->scales[i].value.x
-            >> parent->scales[i].value.y 
-            >> parent->scales[i].value.z
-            >> parent->scales[i].time;
+        s >> parent->scales.values[i].x
+            >> parent->scales.values[i].y 
+            >> parent->scales.values[i].z
+            >> parent->scales.times[i];
     }
     s >> name; assert(name == "cdn");
     s >> count;
@@ -298,12 +366,171 @@ void Animation::deserialize_nodes(Node*& parent, const Model& m, std::stringstre
     s >> name; assert(name == "cdnend");
 }
 
-void Animation::deserialize_data(const Model& m, std::stringstream& s) {
+void Animation::deserialize_data(const ModelData& m, std::istream& s) {
     s >> name >> duration >> ticks_per_second;
     root_node = new Node;
     deserialize_nodes(root_node, m, s);
 }
 
+static void write_value(std::string& out, const glm::vec3& v) {
+    float f[3] {v.x, v.y, v.z};
+    format::write(out, f, 3);
+}
+
+static void write_value(std::string& out, const glm::quat& q) {
+    float f[4] {q.x, q.y, q.z, q.w};
+    format::write(out, f, 4);
+}
+
+static void write_range(std::string& out, const Channel<glm::vec3>& channel) {
+    write_value(out, channel.range_min);
+    write_value(out, channel.range_extent);
+}
+
+static void write_range(std::string&, const Channel<glm::quat>&) {}
+
+template <typename T>
+static format::AnimChannel write_channel(std::string& blobs, const Channel<T>& channel) {
+    format::align(blobs);
+    format::AnimChannel entry {static_cast<uint32_t>(channel.size()), 0, blobs.size()};
+    format::write(blobs, channel.times.data(), channel.times.size());
+    if(channel.is_packed()) {
+        entry.flags |= format::ANIM_CHANNEL_PACKED;
+        write_range(blobs, channel);
+        format::write(blobs, channel.packed.data(), channel.packed.size());
+    } else for(const auto& value: channel.values) write_value(blobs, value);
+    return entry;
+}
+
+static bool read_values(std::istream& s, std::vector<glm::vec3>& values) {
+    static_assert(sizeof(glm::vec3) == 3*sizeof(float));
+    return format::read(s, values.data(), values.size());
+}
+
+static bool read_values(std::istream& s, std::vector<glm::quat>& values) {
+    std::vector<float> f(values.size()*4);
+    if(!format::read(s, f.data(), f.size())) return false;
+    for(size_t i=0; i<values.size(); i++)
+        values[i] = glm::quat(f[i*4+3], f[i*4], f[i*4+1], f[i*4+2]);
+    return true;
+}
+
+static size_t read_range(std::istream& s, Channel<glm::vec3>& channel) {
+    return format::read(s, channel.range_min) && format::read(s, channel.range_extent) ? 2*sizeof(glm::vec3) : 0;
+}
+
+static size_t read_range(std::istream&, Channel<glm::quat>&) { return 0; }
+
+template <typename T>
+static bool read_channel(std::istream& s, uint64_t& pos, uint64_t blobs_offset,
+        const format::AnimChannel& entry, Channel<T>& channel) {
+    if(!format::skip_to(s, pos, blobs_offset+entry.offset)) return false;
+    channel.times.resize(entry.count);
+    if(!format::read(s, channel.times.data(), channel.times.size())) return false;
+    pos += entry.count*sizeof(float);
+    if(entry.flags & format::ANIM_CHANNEL_PACKED) {
+        pos += read_range(s, channel);
+        channel.packed.resize(entry.count*3);
+        pos += channel.packed.size()*sizeof(uint16_t);
+        return format::read(s, channel.packed.data(), channel.packed.size());
+    }
+    channel.values.resize(entry.count);
+    pos += entry.count*sizeof(T);
+    return read_values(s, channel.values);
+}
+
+std::string Animation::serialize_binary() {
+    std::vector<format::AnimNodeEntry> node_table;
+    std::string strings, blobs;
+    if(name.empty()) name = "anim";
+
+    // depth first with an explicit stack, children keep their order
+    std::vector<std::pair<Node*, int32_t>> stack;
+    if(root_node) stack.emplace_back(root_node, -1);
+    while(!stack.empty()) {
+        auto [node, parent] = stack.back();
+        stack.pop_back();
+        format::AnimNodeEntry entry {};
+        entry.name = format::add_string(strings, node->name);
+        entry.parent = parent;
+        entry.positions = write_channel(blobs, node->positions);
+        entry.rotations = write_channel(blobs, node->rotations);
+        entry.scales = write_channel(blobs, node->scales);
+        int32_t index = node_table.size();
+        node_table.push_back(entry);
+        for(auto it = node->children.rbegin(); it != node->children.rend(); it++)
+            stack.emplace_back(*it, index);
+    }
+
+    format::AnimHeader header {};
+    std::memcpy(header.magic, format::ANIM_MAGIC, sizeof(header.magic));
+    header.version = format::ANIM_VERSION;
+    header.node_count = node_table.size();
+    header.name = format::add_string(strings, name);
+    header.strings_size = strings.size();
+    header.duration = duration;
+    header.ticks_per_second = ticks_per_second;
+    header.blobs_size = blobs.size();
+
+    std::string s;
+    format::write(s, header);
+    format::write(s, node_table.data(), node_table.size());
+    s += strings;
+    format::align(s);
+    header.blobs_offset = s.size();
+    std::memcpy(s.data(), &header, sizeof(header));
+    s += blobs;
+
+    return s;
+}
+
+void Animation::deserialize_binary(const ModelData& m, std::istream& s) {
+    format::AnimHeader header;
+    if(!format::read(s, header) || !format::check_magic(header.magic, format::ANIM_MAGIC)) {
+        glp_log("animation has no valid binary header");
+        return;
+    }
+    if(header.version > format::ANIM_VERSION) {
+        glp_logv("unsupported animation version %u", header.version);
+        return;
+    }
+
+    std::vector<format::AnimNodeEntry> node_table(header.node_count);
+    std::string strings(header.strings_size, '\0');
+    if(!format::read(s, node_table.data(), node_table.size()) || !format::read(s, strings.data(), strings.size())) {
+        glp_log("animation tables are truncated");
+        return;
+    }
+    uint64_t pos = sizeof(header) + node_table.size()*sizeof(format::AnimNodeEntry) + strings.size();
+
+    name = format::get_string(strings, header.name);
+    duration = header.duration;
+    ticks_per_second = header.ticks_per_second;
+
+    std::vector<Node*> nodes;
+    nodes.reserve(node_table.size());
+    for(size_t i=0; i<node_table.size(); i++) {
+        const auto& entry = node_table[i];
+        if((i == 0) != (entry.parent < 0) || entry.parent >= static_cast<int32_t>(i)) {
+            glp_logv("animation node %zu has an invalid parent", i);
+            return;
+        }
+        auto node = new Node;
+        node->name = format::get_string(strings, entry.name);
+        node->bone_index = find_bone(m, node->name);
+        if(i == 0) root_node = node;
+        else nodes[entry.parent]->children.push_back(node);
+        nodes.push_back(node);
+
+        if(!read_channel(s, pos, header.blobs_offset, entry.positions, node->positions)
+                || !read_channel(s, pos, header.blobs_offset, entry.rotations, node->rotations)
+                || !read_channel(s, pos, header.blobs_offset, entry.scales, node->scales)) {
+            glp_logv("animation keys of %s are truncated", node->name.c_str());
+            return;
+        }
+    }
+}
+
 }
 
 }
@@ -0,0 +1,70 @@
+#include "utils.hh"
+#include "obj/collision-scene.hh"
+
+namespace glp {
+
+namespace Object {
+
+btCollisionShape* make_shape(const SceneObjectData& obj) {
+    switch(obj.shape) {
+        case format::SCENE_SHAPE_BOX: return new btBoxShape(btVector3(obj.extents.x, obj.extents.y, obj.extents.z));
+        case format::SCENE_SHAPE_SPHERE: return new btSphereShape(obj.extents.x);
+        default: return nullptr;
+    }
+}
+
+CollisionScene::CollisionScene(const SceneData& data, const std::string& path) {
+    world = new World{};
+    auto scene_path = path.substr(0, path.find_last_of('/')) + '/';
+
+    // models are read only for objects that need their bounds, and once each
+    std::vector<glm::vec3> boxes(data.models.size());
+    std::vector<bool> loaded(data.models.size(), false);
+    objects.reserve(data.objects.size());
+    for(size_t i=0; i<data.objects.size(); i++) {
+        const auto& obj = data.objects[i];
+        if(obj.model < 0 || static_cast<size_t>(obj.model) >= data.models.size()) continue;
+        btCollisionShape* shape = make_shape(obj);
+        if(!shape) {
+            if(!loaded[obj.model]) {
+                ModelData model{scene_path + data.models[obj.model]};
+                boxes[obj.model] = model.calculate_bounding_box();
+                loaded[obj.model] = true;
+            }
+            auto& box = boxes[obj.model];
+            shape = new btBoxShape(btVector3(box.x, box.y, box.z));
+        }
+        btVector3 position {obj.position.x, obj.position.y, obj.position.z};
+        btQuaternion rotation {obj.rotation.x, obj.rotation.y, obj.rotation.z, obj.rotation.w};
+        auto collidable = new Collidable{shape, obj.mass, position, rotation};
+        world->add_collidable(collidable);
+        objects.push_back(collidable);
+        indices.push_back(i);
+    }
+    glp_logv("collision scene %s: %zu bodies", path.c_str(), objects.size());
+}
+
+void CollisionScene::update(float dt) {
+    world->update(dt);
+}
+
+void CollisionScene::store(SceneData& data) const {
+    for(size_t i=0; i<objects.size(); i++) {
+        if(indices[i] >= data.objects.size()) continue;
+        auto t = objects[i]->get_rigidbody()->getWorldTransform();
+        auto pos = t.getOrigin();
+        auto rot = t.getRotation();
+        auto& obj = data.objects[indices[i]];
+        obj.position = glm::vec3(pos.getX(), pos.getY(), pos.getZ());
+        obj.rotation = glm::quat(rot.getW(), rot.getX(), rot.getY(), rot.getZ());
+    }
+}
+
+CollisionScene::~CollisionScene() {
+    delete world;
+    for(auto& obj: objects) delete obj;
+}
+
+}
+
+}
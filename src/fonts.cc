@@ -2572,14 +2572,14 @@ const unsigned int karla_png_len = 83342;
 Font::Font(const size_t& screen_w, const size_t& screen_h, const std::string& path)
     : screen_width{screen_w}, screen_height{screen_h} {
         if(path.empty()) {
-            texture = new Texture{karla_png, karla_png_len};
-        } else texture = new Texture{path};
+            texture = TextureCache::get().acquire(karla_png, karla_png_len, "karla.png");
+        } else texture = TextureCache::get().acquire(path);
 
         shader = new Shader{text_vert, text_frag, false};
 }
 
 Font::~Font() {
-    delete texture;
+    TextureCache::get().release(texture);
     delete shader;
 }
 
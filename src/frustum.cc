@@ -0,0 +1,87 @@
+#include "obj/frustum.hh"
+
+#if defined(__SSE__) || defined(_M_X64)
+    #include <xmmintrin.h>
+    #define GLP_FRUSTUM_SSE
+#elif defined(__ARM_NEON)
+    #include <arm_neon.h>
+    #define GLP_FRUSTUM_NEON
+#endif
+
+namespace glp {
+
+namespace Object {
+
+Frustum::Frustum(const glm::mat4& vp) {
+    // rows of the matrix, clip space x, y and z lie within -w and w
+    glm::vec4 rows[4];
+    for(int i=0; i<4; i++) rows[i] = glm::vec4(vp[0][i], vp[1][i], vp[2][i], vp[3][i]);
+    for(int i=0; i<3; i++) {
+        planes[i*2] = rows[3] + rows[i];
+        planes[i*2+1] = rows[3] - rows[i];
+    }
+    for(auto& plane: planes) plane /= glm::length(glm::vec3(plane));
+}
+
+bool Frustum::contains(const glm::vec3& center, float radius) const {
+    for(auto& plane: planes)
+        if(glm::dot(glm::vec3(plane), center) + plane.w < -radius) return false;
+    return true;
+}
+
+size_t Frustum::cull(const glm::vec4* spheres, size_t count, uint8_t* visible) const {
+    size_t i = 0, passed = 0;
+#if defined(GLP_FRUSTUM_SSE)
+    for(; i+4 <= count; i += 4) {
+        // four spheres to one register per component
+        __m128 x = _mm_loadu_ps(&spheres[i].x);
+        __m128 y = _mm_loadu_ps(&spheres[i+1].x);
+        __m128 z = _mm_loadu_ps(&spheres[i+2].x);
+        __m128 r = _mm_loadu_ps(&spheres[i+3].x);
+        _MM_TRANSPOSE4_PS(x, y, z, r);
+        __m128 zero = _mm_setzero_ps();
+        __m128 neg_r = _mm_sub_ps(zero, r);
+        __m128 inside = _mm_cmpeq_ps(zero, zero);
+        for(auto& plane: planes) {
+            __m128 distance = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+                _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, neg_r));
+        }
+        int mask = _mm_movemask_ps(inside);
+        for(int k=0; k<4; k++) {
+            visible[i+k] = (mask >> k) & 1;
+            passed += visible[i+k];
+        }
+    }
+#elif defined(GLP_FRUSTUM_NEON)
+    for(; i+4 <= count; i += 4) {
+        // deinterleaving load, val[0] holds the four x and so on
+        float32x4x4_t s = vld4q_f32(&spheres[i].x);
+        float32x4_t neg_r = vnegq_f32(s.val[3]);
+        uint32x4_t inside = vdupq_n_u32(~0u);
+        for(auto& plane: planes) {
+            float32x4_t distance = vdupq_n_f32(plane.w);
+            distance = vmlaq_n_f32(distance, s.val[0], plane.x);
+            distance = vmlaq_n_f32(distance, s.val[1], plane.y);
+            distance = vmlaq_n_f32(distance, s.val[2], plane.z);
+            inside = vandq_u32(inside, vcgeq_f32(distance, neg_r));
+        }
+        uint32_t lanes[4];
+        vst1q_u32(lanes, inside);
+        for(int k=0; k<4; k++) {
+            visible[i+k] = lanes[k] & 1;
+            passed += visible[i+k];
+        }
+    }
+#endif
+    for(; i<count; i++) {
+        visible[i] = contains(glm::vec3(spheres[i]), spheres[i].w);
+        passed += visible[i];
+    }
+    return passed;
+}
+
+}
+
+}
@@ -0,0 +1,122 @@
+#include <chrono>
+#include <limits>
+#include <memory>
+
+#include "loader.hh"
+#include "utils.hh"
+
+namespace glp {
+
+Loader::Loader(size_t threads) {
+    if(threads == 0) threads = 1;
+    for(size_t i=0; i<threads; i++)
+        workers.emplace_back(&Loader::work, this);
+}
+
+Loader::~Loader() {
+    {
+        std::lock_guard<std::mutex> lock{jobs_mutex};
+        stopping = true;
+    }
+    jobs_cv.notify_all();
+    for(auto& worker: workers) worker.join();
+    // workers finished every queued job, running what they left for the GL
+    // thread fulfills every future handed out
+    while(process_uploads(std::numeric_limits<float>::max())) {}
+}
+
+void Loader::work() {
+    for(;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock{jobs_mutex};
+            jobs_cv.wait(lock, [this]{ return stopping || !jobs.empty(); });
+            // queued jobs still run when stopping, their promises would break otherwise
+            if(jobs.empty()) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
+
+void Loader::push_job(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock{jobs_mutex};
+        jobs.push_back(std::move(job));
+    }
+    jobs_cv.notify_one();
+}
+
+void Loader::push_upload(std::function<void()> upload) {
+    std::lock_guard<std::mutex> lock{uploads_mutex};
+    uploads.push_back(std::move(upload));
+}
+
+size_t Loader::pending_uploads() {
+    std::lock_guard<std::mutex> lock{uploads_mutex};
+    return uploads.size();
+}
+
+size_t Loader::process_uploads(float budget_ms) {
+    auto start = std::chrono::steady_clock::now();
+    size_t count = 0;
+    for(;;) {
+        std::function<void()> upload;
+        {
+            std::lock_guard<std::mutex> lock{uploads_mutex};
+            if(uploads.empty()) break;
+            upload = std::move(uploads.front());
+            uploads.pop_front();
+        }
+        upload();
+        count++;
+        std::chrono::duration<float, std::milli> spent = std::chrono::steady_clock::now() - start;
+        if(spent.count() >= budget_ms) break;
+    }
+    return count;
+}
+
+std::shared_future<Model*> Loader::load_model(const std::string& path, Shader* shader, ShadingType shading_t,
+        bool release_cpu_data, KeepMeshData keep) {
+    auto promise = std::make_shared<std::promise<Model*>>();
+    std::shared_future<Model*> future = promise->get_future().share();
+    push_job([this, promise, path, shader, shading_t, release_cpu_data, keep] {
+        // the last upload applies keep before releasing
+        auto model = new Model{path, shader, shading_t, false, release_cpu_data, keep};
+        // one upload per texture and mesh so a big model is spread over frames
+        for(auto& tex: model->get_textures())
+            push_upload([tex]{ tex->upload(); });
+        for(auto& mesh: model->get_meshes())
+            push_upload([mesh]{ mesh->upload(); });
+        push_upload([promise, model]{
+            model->upload();
+            promise->set_value(model);
+        });
+    });
+    return future;
+}
+
+std::shared_future<Texture*> Loader::load_texture(const std::string& path) {
+    auto promise = std::make_shared<std::promise<Texture*>>();
+    std::shared_future<Texture*> future = promise->get_future().share();
+    push_job([this, promise, path] {
+        auto tex = TextureCache::get().acquire(path, false);
+        push_upload([promise, tex]{
+            tex->upload();
+            promise->set_value(tex);
+        });
+    });
+    return future;
+}
+
+std::shared_future<Animation::Animation*> Loader::load_animation(const std::string& path, const Model* model) {
+    auto promise = std::make_shared<std::promise<Animation::Animation*>>();
+    std::shared_future<Animation::Animation*> future = promise->get_future().share();
+    push_job([promise, path, model] {
+        promise->set_value(new Animation::Animation{path, *model});
+    });
+    return future;
+}
+
+}
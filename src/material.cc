@@ -1,52 +1,432 @@
+#include <cstring>
+#include <filesystem>
+#include <set>
+#include <sstream>
+
 #include "material.hh"
+#include "utils.hh"
 #include "external/stb_image.h"
 
 namespace glp {
 
-Texture::Texture(const std::string& path_) : path{path_} {
-    glGenTextures(1, &id);
-    glBindTexture(GL_TEXTURE_2D, id);
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RG_RGTC2
+#define GL_COMPRESSED_RG_RGTC2 0x8DBD
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+#ifndef GL_COMPRESSED_RGB8_ETC2
+#define GL_COMPRESSED_RGB8_ETC2 0x9274
+#endif
+#ifndef GL_COMPRESSED_RGBA8_ETC2_EAC
+#define GL_COMPRESSED_RGBA8_ETC2_EAC 0x9278
+#endif
 
-    int width, height, component;
-    unsigned char* data = stbi_load(path.c_str(), &width, &height, &component, 0);
-    glTexImage2D(GL_TEXTURE_2D, 0,
-            (component == 3 ? GL_RGB : GL_RGBA), width, height, 0,
-            (component == 3 ? GL_RGB : GL_RGBA), GL_UNSIGNED_BYTE, data);
-    
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+// extension names, read once with the first upload's context current
+static const std::set<std::string>& gl_extensions() {
+    static const std::set<std::string> extensions = [] {
+        std::set<std::string> names;
+#ifndef __vita__
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for(GLint i=0; i<count; i++) names.insert(reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i)));
+#else
+        if(auto list = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS))) {
+            std::stringstream s{list};
+            std::string name;
+            while(s >> name) names.insert(name);
+        }
+#endif
+        return names;
+    }();
+    return extensions;
+}
 
-    stbi_image_free(data);
+static bool has_extension(std::initializer_list<const char*> names) {
+    for(auto name: names)
+        if(gl_extensions().count(name)) return true;
+    return false;
+}
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+// internal format to upload a block compressed format as is, 0 when it has to be decoded
+static GLenum compressed_gl_format(uint32_t format) {
+    switch(format) {
+        case format::TEXTURE_BC1:
+            return has_extension({"GL_EXT_texture_compression_s3tc", "GL_EXT_texture_compression_dxt1"})
+                ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : 0;
+        case format::TEXTURE_BC3:
+            return has_extension({"GL_EXT_texture_compression_s3tc"}) ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : 0;
+        case format::TEXTURE_BC5:
+#ifndef __vita__
+            // rgtc is core since GL 3.0
+            return GL_COMPRESSED_RG_RGTC2;
+#else
+            return has_extension({"GL_EXT_texture_compression_rgtc"}) ? GL_COMPRESSED_RG_RGTC2 : 0;
+#endif
+        case format::TEXTURE_BC7:
+            return has_extension({"GL_ARB_texture_compression_bptc", "GL_EXT_texture_compression_bptc"})
+                ? GL_COMPRESSED_RGBA_BPTC_UNORM : 0;
+        case format::TEXTURE_ETC2_RGB:
+            return has_extension({"GL_ARB_ES3_compatibility", "GL_OES_compressed_ETC2_RGB8_texture"})
+                ? GL_COMPRESSED_RGB8_ETC2 : 0;
+        case format::TEXTURE_ETC2_RGBA:
+            return has_extension({"GL_ARB_ES3_compatibility", "GL_OES_compressed_ETC2_RGBA8_texture"})
+                ? GL_COMPRESSED_RGBA8_ETC2_EAC : 0;
+        default:
+            return 0;
+    }
+}
+
+static bool read_container(Texture& tex, const char* data, size_t size) {
+    format::TextureHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if(header.version > format::TEXTURE_VERSION) {
+        glp_logv("unsupported texture version %u", header.version);
+        return false;
+    }
+    if(header.format > format::TEXTURE_ETC2_RGBA) {
+        glp_logv("unsupported texture format %u", header.format);
+        return false;
+    }
+    size_t table_end = sizeof(header) + static_cast<size_t>(header.level_count)*sizeof(format::TextureLevel);
+    if(table_end > size || header.data_offset < table_end || header.data_offset > size) {
+        glp_log("texture level table is truncated");
+        return false;
+    }
+    std::vector<format::TextureLevel> levels(header.level_count);
+    std::memcpy(levels.data(), data+sizeof(header), levels.size()*sizeof(format::TextureLevel));
+    uint32_t block_size = format::texture_block_size(header.format);
+    uint32_t components = header.format == format::TEXTURE_RGB8 ? 3 : 4;
+    for(const auto& level: levels) {
+        uint64_t expected = block_size
+            ? static_cast<uint64_t>((level.width+3)/4)*((level.height+3)/4)*block_size
+            : static_cast<uint64_t>(level.width)*level.height*components;
+        if(level.size != expected) {
+            glp_logv("texture level %ux%u has %llu bytes instead of %llu", level.width, level.height,
+                    static_cast<unsigned long long>(level.size), static_cast<unsigned long long>(expected));
+            return false;
+        }
+        if(level.offset+level.size > size-header.data_offset) {
+            glp_log("texture level data is truncated");
+            return false;
+        }
+    }
+    tex.levels = std::move(levels);
+    tex.level_data.assign(data+header.data_offset, size-header.data_offset);
+    tex.width = header.width;
+    tex.height = header.height;
+    tex.level_format = header.format;
+    bool opaque = header.format == format::TEXTURE_RGB8 || header.format == format::TEXTURE_BC1
+        || header.format == format::TEXTURE_ETC2_RGB;
+    tex.component = opaque ? 3 : 4;
+    return true;
+}
+
+// .tex containers are copied as they are, compressed ones are decompressed
+// first; any other image is decoded with stb_image
+static void decode(Texture& tex, const char* data, size_t size) {
+    std::string decompressed;
+    if(util::is_compressed(data, size)) {
+        decompressed = util::decompress(data, size);
+        data = decompressed.data();
+        size = decompressed.size();
+    }
+    if(size >= sizeof(format::TextureHeader) && format::check_magic(data, format::TEXTURE_MAGIC)) {
+        read_container(tex, data, size);
+        return;
+    }
+    tex.pixels = stbi_load_from_memory(reinterpret_cast<const unsigned char*>(data),
+            size, &tex.width, &tex.height, &tex.component, 0);
 }
 
-Texture::Texture(const unsigned char* strliteral, const unsigned int len) {
+Texture::Texture(const std::string& path_, bool upload_now) : path{path_} {
+    util::MappedFile file{path};
+    decode(*this, file.data(), file.size());
+    if(!pixels && levels.empty()) glp_logv("could not decode texture %s", path.c_str());
+    if(upload_now) upload();
+}
+
+Texture::Texture(const unsigned char* strliteral, const unsigned int len, bool upload_now) {
+    decode(*this, reinterpret_cast<const char*>(strliteral), len);
+    if(upload_now) upload();
+}
+
+size_t Texture::size() const {
+    if(!levels.empty()) return level_data.size();
+    return static_cast<size_t>(width)*height*component*4/3;
+}
+
+void Texture::upload() {
+    if(uploaded()) return;
     glGenTextures(1, &id);
     glBindTexture(GL_TEXTURE_2D, id);
 
-    int width, height, component;
-    unsigned char* data = stbi_load_from_memory(strliteral, len, &width, &height, &component, 0);
-    glTexImage2D(GL_TEXTURE_2D, 0,
-            (component == 3 ? GL_RGB : GL_RGBA), width, height, 0,
-            (component == 3 ? GL_RGB : GL_RGBA), GL_UNSIGNED_BYTE, data);
-    
-    glGenerateMipmap(GL_TEXTURE_2D);
+    GLenum format = component == 3 ? GL_RGB : GL_RGBA;
+    if(!levels.empty()) {
+        // levels are tightly packed, small ones have rows of a few bytes
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        bool block_compressed = format::texture_block_size(level_format) != 0;
+        GLenum compressed_format = compressed_gl_format(level_format);
+        if(block_compressed && !compressed_format)
+            glp_logv("decoding %s on the cpu, GL has no support for its format", path.c_str());
+        std::vector<unsigned char> decoded;
+        for(size_t i=0; i<levels.size(); i++) {
+            auto data = reinterpret_cast<const unsigned char*>(level_data.data()+levels[i].offset);
+            if(compressed_format) {
+                glCompressedTexImage2D(GL_TEXTURE_2D, i, compressed_format, levels[i].width, levels[i].height, 0,
+                        levels[i].size, data);
+            } else if(block_compressed) {
+                decoded.assign(static_cast<size_t>(levels[i].width)*levels[i].height*4, 0);
+                if(!decode_blocks(level_format, data, levels[i].width, levels[i].height, decoded.data()))
+                    glp_logv("could not decode level %zu of %s", i, path.c_str());
+                glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA, levels[i].width, levels[i].height, 0,
+                        GL_RGBA, GL_UNSIGNED_BYTE, decoded.data());
+            } else {
+                glTexImage2D(GL_TEXTURE_2D, i, format, levels[i].width, levels[i].height, 0,
+                        format, GL_UNSIGNED_BYTE, data);
+            }
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        std::string{}.swap(level_data);
+    } else {
+        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0,
+                format, GL_UNSIGNED_BYTE, pixels);
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    stbi_image_free(data);
+    stbi_image_free(pixels);
+    pixels = nullptr;
 
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+void Texture::replace(Texture& other) {
+    std::swap(id, other.id);
+    std::swap(pixels, other.pixels);
+    std::swap(width, other.width);
+    std::swap(height, other.height);
+    std::swap(component, other.component);
+    std::swap(levels, other.levels);
+    std::swap(level_data, other.level_data);
+    std::swap(level_format, other.level_format);
+}
+
 Texture::~Texture() {
-    glDeleteTextures(1, &id);
+    if(pixels) stbi_image_free(pixels);
+    if(id) glDeleteTextures(1, &id);
+}
+
+#ifndef __vita__
+// std140 layout of MaterialBlock in the builtin shaders
+struct MaterialBlock {
+    glm::vec3 ambient;
+    float shininess;
+    glm::vec3 diffuse;
+    float metallic;
+    glm::vec3 specular;
+    float roughness;
+    glm::vec3 albedo;
+    int32_t diffuse_tex_exists;
+    int32_t normal_tex_exists;
+    int32_t specular_tex_exists;
+    int32_t metallic_tex_exists;
+    int32_t roughness_tex_exists;
+    int32_t ao_tex_exists;
+    int32_t padding[3];
+};
+static_assert(sizeof(MaterialBlock) == 96, "MaterialBlock has to match std140");
+
+// samplers are set once per program at link, draws only bind textures
+static const bool material_units = [] {
+    set_sampler_unit("diffuse_tex", DIFFUSE_UNIT);
+    set_sampler_unit("normal_tex", NORMAL_UNIT);
+    set_sampler_unit("specular_tex", SPECULAR_UNIT);
+    set_sampler_unit("metallic_tex", METALLIC_UNIT);
+    set_sampler_unit("roughness_tex", ROUGHNESS_UNIT);
+    set_sampler_unit("ao_tex", AO_UNIT);
+    return true;
+}();
+#endif
+
+void Material::upload() {
+#ifndef __vita__
+    if(!block) block = new UniformBuffer{"MaterialBlock", sizeof(MaterialBlock)};
+    MaterialBlock data {ambient, shininess, diffuse, metallic, specular, roughness, albedo,
+        diffuse_id > -1, normal_id > -1, specular_id > -1, metallic_id > -1, roughness_id > -1, ao_id > -1, {}};
+    block->update(&data);
+#endif
+}
+
+void Material::bind() {
+#ifndef __vita__
+    if(!block) upload();
+    block->bind();
+#endif
+}
+
+Material::~Material() {
+    for(auto& tex: textures) TextureCache::get().release(tex);
+#ifndef __vita__
+    delete block;
+#endif
+}
+
+TextureCache& TextureCache::get() {
+    static TextureCache cache;
+    return cache;
+}
+
+Texture* TextureCache::find(uint64_t hash, const std::string& key) {
+    std::lock_guard<std::mutex> lock{mutex};
+    auto it = entries.find(hash);
+    if(it == entries.end()) return nullptr;
+    it->second.refs++;
+    stats.hits++;
+    paths[key] = hash;
+    return it->second.texture;
+}
+
+Texture* TextureCache::insert(Texture* tex, uint64_t hash, const std::string& key) {
+    std::lock_guard<std::mutex> lock{mutex};
+    auto it = entries.find(hash);
+    if(it != entries.end()) {
+        // another thread decoded the same image in the meantime
+        delete tex;
+        it->second.refs++;
+        stats.hits++;
+        paths[key] = hash;
+        return it->second.texture;
+    }
+    size_t bytes = tex->size();
+    entries.emplace(hash, Entry{tex, 1, bytes});
+    owners.emplace(tex, hash);
+    paths[key] = hash;
+    stats.misses++;
+    stats.resident++;
+    stats.resident_bytes += bytes;
+    return tex;
+}
+
+// entry key of a texture that could not be read or decoded. keyed by path rather
+// than contents, so every missing file gets an entry of its own and a reload of
+// it later only reaches the users of that path
+static uint64_t failed_hash(const std::string& key) {
+    std::string tagged = "failed:" + key;
+    return util::hash(tagged.data(), tagged.size());
+}
+
+Texture* TextureCache::acquire(const std::string& path, bool upload_now) {
+    std::error_code ec;
+    std::string key = std::filesystem::weakly_canonical(path, ec).string();
+    if(ec) key = path;
+
+    Texture* tex {nullptr};
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        auto it = paths.find(key);
+        if(it != paths.end()) {
+            auto& entry = entries.at(it->second);
+            entry.refs++;
+            stats.hits++;
+            tex = entry.texture;
+        }
+    }
+
+    if(!tex) {
+        util::MappedFile file{path};
+        uint64_t hash = util::hash(file.data(), file.size());
+        // empty means unreadable, its hash would match every other missing file
+        if(file.size()) tex = find(hash, key);
+        if(!tex) {
+            tex = new Texture{reinterpret_cast<const unsigned char*>(file.data()),
+                static_cast<unsigned int>(file.size()), false};
+            tex->path = path;
+            if(!tex->pixels && tex->levels.empty()) {
+                glp_logv("could not decode texture %s", path.c_str());
+                hash = failed_hash(key);
+            }
+            tex = insert(tex, hash, key);
+        }
+    }
+
+    if(upload_now) tex->upload();
+    return tex;
+}
+
+Texture* TextureCache::acquire(const unsigned char* data, const unsigned int len, const std::string& key, bool upload_now) {
+    uint64_t hash = util::hash(reinterpret_cast<const char*>(data), len);
+    Texture* tex = len ? find(hash, key) : nullptr;
+    if(!tex) {
+        tex = new Texture{data, len, false};
+        tex->path = key;
+        if(!tex->pixels && tex->levels.empty()) hash = failed_hash(key);
+        tex = insert(tex, hash, key);
+    }
+    if(upload_now) tex->upload();
+    return tex;
+}
+
+bool TextureCache::retain(const Texture* tex) {
+    std::lock_guard<std::mutex> lock{mutex};
+    auto owner = owners.find(tex);
+    if(owner == owners.end()) return false;
+    entries.at(owner->second).refs++;
+    return true;
+}
+
+void TextureCache::release(const Texture* tex) {
+    std::lock_guard<std::mutex> lock{mutex};
+    auto owner = owners.find(tex);
+    if(owner == owners.end()) return;
+    auto hash = owner->second;
+    auto& entry = entries.at(hash);
+    if(--entry.refs > 0) return;
+
+    stats.evictions++;
+    stats.resident--;
+    stats.resident_bytes -= entry.bytes;
+    for(auto it = paths.begin(); it != paths.end();) {
+        if(it->second == hash) it = paths.erase(it);
+        else it++;
+    }
+    delete entry.texture;
+    owners.erase(owner);
+    entries.erase(hash);
+}
+
+void TextureCache::update(const Texture* tex, uint64_t hash, size_t bytes) {
+    std::lock_guard<std::mutex> lock{mutex};
+    auto owner = owners.find(tex);
+    if(owner == owners.end()) return;
+    auto old = owner->second;
+    auto& entry = entries.at(old);
+    stats.resident_bytes = stats.resident_bytes - entry.bytes + bytes;
+    entry.bytes = bytes;
+    // contents identical to another cached texture keep the old key, a map
+    // can't hold both
+    if(old == hash || entries.count(hash)) return;
+
+    auto node = entries.extract(old);
+    node.key() = hash;
+    entries.insert(std::move(node));
+    for(auto& [path, path_hash]: paths)
+        if(path_hash == old) path_hash = hash;
+    owner->second = hash;
+}
+
+TextureCacheStats TextureCache::get_stats() {
+    std::lock_guard<std::mutex> lock{mutex};
+    return stats;
 }
 
 }
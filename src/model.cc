@@ -4,49 +4,271 @@
 #include <sstream>
 #include <string>
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <limits>
 
+#include "format.hh"
 #include "material.hh"
 #include "model.hh"
 #include "utils.hh"
+#include "external/glm/packing.hpp"
 
 namespace glp {
 
-Mesh::Mesh(std::vector<Vertex> vert, std::vector<unsigned int> idx, Material* mat, Shader* shader)
-    : vertices{vert}, indices{idx}, material{mat} {
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
+Mesh::Mesh(std::vector<Vertex>&& vert, std::vector<unsigned int>&& idx, Material* mat, Shader* shader_, bool upload_now)
+    : MeshData{std::move(vert), std::move(idx), mat}, shader{shader_} {
+    if(upload_now) upload();
+}
 
-    glBindVertexArray(VAO);
+Mesh::Mesh(MeshData&& data, Shader* shader_, bool upload_now)
+    : MeshData{std::move(data)}, shader{shader_} {
+    if(upload_now) upload();
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(Vertex),
-            vertices.data(), GL_STATIC_DRAW);
+size_t VertexLayout::stride() const {
+    bool compact = flags & format::VERTEX_COMPACT;
+    size_t size = flags & format::VERTEX_QUANTIZED_POSITION ? 8 : 12;
+    size += compact ? 4+4 : 12+8;
+    if(flags & format::VERTEX_SKINNED)
+        size += compact ? 4 + (flags & format::VERTEX_WEIGHTS16 ? 8 : 4) : 16+16;
+    return size;
+}
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(unsigned int),
-            indices.data(), GL_STATIC_DRAW);
+VertexLayout VertexLayout::select(const std::vector<Vertex>& vertices, bool compact, bool quantize_position) {
+    VertexLayout layout;
+    layout.flags = 0;
+    for(const auto& v: vertices)
+        if(v.weights[0] != 0.0f || v.weights[1] != 0.0f || v.weights[2] != 0.0f || v.weights[3] != 0.0f) {
+            layout.flags |= format::VERTEX_SKINNED;
+            break;
+        }
+    if(compact) layout.flags |= format::VERTEX_COMPACT;
+    if(quantize_position) layout.flags |= format::VERTEX_QUANTIZED_POSITION;
+    return layout;
+}
 
-    glVertexAttribPointer(POSITION_ATTRIBUTE_INDEX,
-            3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+template <typename T>
+static void put(char*& p, T value) {
+    std::memcpy(p, &value, sizeof(T));
+    p += sizeof(T);
+}
+
+template <typename T>
+static T take(const char*& p) {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return value;
+}
+
+static uint32_t pack_snorm10(const glm::vec3& n) {
+    auto c = glm::clamp(n, -1.0f, 1.0f);
+    auto x = static_cast<uint32_t>(static_cast<int32_t>(std::round(c.x*511.0f)) & 0x3ff);
+    auto y = static_cast<uint32_t>(static_cast<int32_t>(std::round(c.y*511.0f)) & 0x3ff);
+    auto z = static_cast<uint32_t>(static_cast<int32_t>(std::round(c.z*511.0f)) & 0x3ff);
+    return x | y << 10 | z << 20;
+}
+
+static glm::vec3 unpack_snorm10(uint32_t v) {
+    // sign extend each 10 bit field
+    auto field = [v](int shift) {
+        int32_t x = static_cast<int32_t>(v << (22-shift)) >> 22;
+        return std::max(x/511.0f, -1.0f);
+    };
+    return glm::vec3(field(0), field(10), field(20));
+}
+
+std::string VertexLayout::pack(const std::vector<Vertex>& vertices) {
+    position_offset = glm::vec3(0.0f);
+    position_scale = glm::vec3(1.0f);
+    if(flags & format::VERTEX_QUANTIZED_POSITION && !vertices.empty()) {
+        glm::vec3 min = vertices[0].position, max = vertices[0].position;
+        for(const auto& v: vertices) {
+            min = glm::min(min, v.position);
+            max = glm::max(max, v.position);
+        }
+        position_offset = min;
+        position_scale = max-min;
+        for(size_t i=0; i<3; i++)
+            if(position_scale[i] <= 0.0f) position_scale[i] = 1.0f;
+    }
+
+    std::string data(vertices.size()*stride(), '\0');
+    char* p = data.data();
+    bool compact = flags & format::VERTEX_COMPACT;
+    for(const auto& v: vertices) {
+        if(flags & format::VERTEX_QUANTIZED_POSITION) {
+            auto q = glm::round(glm::clamp((v.position-position_offset)/position_scale, 0.0f, 1.0f) * 65535.0f);
+            put<uint16_t>(p, q.x);
+            put<uint16_t>(p, q.y);
+            put<uint16_t>(p, q.z);
+            put<uint16_t>(p, 0);
+        } else put(p, v.position);
+
+        if(compact) {
+            put(p, pack_snorm10(v.normal));
+            put(p, glm::packHalf2x16(v.uv));
+        } else {
+            put(p, v.normal);
+            put(p, v.uv);
+        }
+
+        if(!(flags & format::VERTEX_SKINNED)) continue;
+        if(compact) {
+            for(size_t i=0; i<MAX_BONE_INFLUENCE; i++)
+                put<uint8_t>(p, std::clamp(v.bone_index[i], 0.0f, 255.0f));
+            float max = flags & format::VERTEX_WEIGHTS16 ? 65535.0f : 255.0f;
+            uint32_t q[MAX_BONE_INFLUENCE], sum = 0;
+            size_t largest = 0;
+            for(size_t i=0; i<MAX_BONE_INFLUENCE; i++) {
+                q[i] = std::round(std::clamp(v.weights[i], 0.0f, 1.0f) * max);
+                sum += q[i];
+                if(q[i] > q[largest]) largest = i;
+            }
+            // keep weights that summed to one doing so after rounding
+            int64_t error = int64_t(max) - sum;
+            if(sum && std::abs(error) <= int64_t(MAX_BONE_INFLUENCE)) q[largest] += error;
+            for(size_t i=0; i<MAX_BONE_INFLUENCE; i++) {
+                if(flags & format::VERTEX_WEIGHTS16) put<uint16_t>(p, q[i]);
+                else put<uint8_t>(p, q[i]);
+            }
+        } else {
+            for(size_t i=0; i<MAX_BONE_INFLUENCE; i++) put(p, v.bone_index[i]);
+            for(size_t i=0; i<MAX_BONE_INFLUENCE; i++) put(p, v.weights[i]);
+        }
+    }
+    return data;
+}
+
+std::vector<Vertex> VertexLayout::unpack(const char* p, size_t count) const {
+    std::vector<Vertex> vertices(count);
+    bool compact = flags & format::VERTEX_COMPACT;
+    for(auto& v: vertices) {
+        if(flags & format::VERTEX_QUANTIZED_POSITION) {
+            glm::vec3 q;
+            q.x = take<uint16_t>(p);
+            q.y = take<uint16_t>(p);
+            q.z = take<uint16_t>(p);
+            take<uint16_t>(p);
+            v.position = q/65535.0f * position_scale + position_offset;
+        } else v.position = take<glm::vec3>(p);
+
+        if(compact) {
+            v.normal = unpack_snorm10(take<uint32_t>(p));
+            v.uv = glm::unpackHalf2x16(take<uint32_t>(p));
+        } else {
+            v.normal = take<glm::vec3>(p);
+            v.uv = take<glm::vec2>(p);
+        }
+
+        if(!(flags & format::VERTEX_SKINNED)) {
+            std::fill(std::begin(v.bone_index), std::end(v.bone_index), 0.0f);
+            std::fill(std::begin(v.weights), std::end(v.weights), 0.0f);
+        } else if(compact) {
+            for(size_t i=0; i<MAX_BONE_INFLUENCE; i++) v.bone_index[i] = take<uint8_t>(p);
+            for(size_t i=0; i<MAX_BONE_INFLUENCE; i++)
+                v.weights[i] = flags & format::VERTEX_WEIGHTS16 ? take<uint16_t>(p)/65535.0f : take<uint8_t>(p)/255.0f;
+        } else {
+            for(size_t i=0; i<MAX_BONE_INFLUENCE; i++) v.bone_index[i] = take<float>(p);
+            for(size_t i=0; i<MAX_BONE_INFLUENCE; i++) v.weights[i] = take<float>(p);
+        }
+    }
+    return vertices;
+}
+
+void VertexLayout::set_attributes() const {
+    GLsizei size = stride();
+    bool compact = flags & format::VERTEX_COMPACT;
+    size_t offset = 0;
+
+    // quantized positions come in as 0-1, the shader applies position_scale and position_offset
+    if(flags & format::VERTEX_QUANTIZED_POSITION) {
+        glVertexAttribPointer(POSITION_ATTRIBUTE_INDEX, 3, GL_UNSIGNED_SHORT, GL_TRUE, size, (void*)offset);
+        offset += 8;
+    } else {
+        glVertexAttribPointer(POSITION_ATTRIBUTE_INDEX, 3, GL_FLOAT, GL_FALSE, size, (void*)offset);
+        offset += 12;
+    }
     glEnableVertexAttribArray(POSITION_ATTRIBUTE_INDEX);
 
-    glVertexAttribPointer(NORMAL_ATTRIBUTE_INDEX,
-            3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+    if(compact) {
+        glVertexAttribPointer(NORMAL_ATTRIBUTE_INDEX, 4, GL_INT_2_10_10_10_REV, GL_TRUE, size, (void*)offset);
+        offset += 4;
+        glVertexAttribPointer(TEXCOORD0_ATTRIBUTE_INDEX, 2, GL_HALF_FLOAT, GL_FALSE, size, (void*)offset);
+        offset += 4;
+    } else {
+        glVertexAttribPointer(NORMAL_ATTRIBUTE_INDEX, 3, GL_FLOAT, GL_FALSE, size, (void*)offset);
+        offset += 12;
+        glVertexAttribPointer(TEXCOORD0_ATTRIBUTE_INDEX, 2, GL_FLOAT, GL_FALSE, size, (void*)offset);
+        offset += 8;
+    }
     glEnableVertexAttribArray(NORMAL_ATTRIBUTE_INDEX);
-
-    glVertexAttribPointer(TEXCOORD0_ATTRIBUTE_INDEX,
-            2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, uv));
     glEnableVertexAttribArray(TEXCOORD0_ATTRIBUTE_INDEX);
 
-    glVertexAttribPointer(JOINTS_ATTRIBUTE_INDEX,
-            4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, bone_index));
+    if(!(flags & format::VERTEX_SKINNED)) return;
+    if(compact) {
+        // joints stay integers in float form, the shaders index pose with int(joints)
+        glVertexAttribPointer(JOINTS_ATTRIBUTE_INDEX, 4, GL_UNSIGNED_BYTE, GL_FALSE, size, (void*)offset);
+        offset += 4;
+        if(flags & format::VERTEX_WEIGHTS16)
+            glVertexAttribPointer(WEIGHTS_ATTRIBUTE_INDEX, 4, GL_UNSIGNED_SHORT, GL_TRUE, size, (void*)offset);
+        else
+            glVertexAttribPointer(WEIGHTS_ATTRIBUTE_INDEX, 4, GL_UNSIGNED_BYTE, GL_TRUE, size, (void*)offset);
+    } else {
+        glVertexAttribPointer(JOINTS_ATTRIBUTE_INDEX, 4, GL_FLOAT, GL_FALSE, size, (void*)offset);
+        offset += 16;
+        glVertexAttribPointer(WEIGHTS_ATTRIBUTE_INDEX, 4, GL_FLOAT, GL_FALSE, size, (void*)offset);
+    }
     glEnableVertexAttribArray(JOINTS_ATTRIBUTE_INDEX);
-
-    glVertexAttribPointer(WEIGHTS_ATTRIBUTE_INDEX,
-            4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, weights));
     glEnableVertexAttribArray(WEIGHTS_ATTRIBUTE_INDEX);
+}
+
+void Mesh::upload() {
+    if(uploaded()) return;
+#ifdef __vita__
+    // vitaGL has no packed attribute types, upload the unpacked vertices instead
+    layout = VertexLayout{};
+    packed.clear();
+#endif
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+
+    glBindVertexArray(VAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    if(packed.empty() && !layout.is_full()) packed = layout.pack(vertices);
+    if(!packed.empty()) {
+        glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
+        std::string{}.swap(packed);
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(Vertex),
+                vertices.data(), GL_STATIC_DRAW);
+    }
+
+    // lod index lists follow the full one in the same buffer
+    index_count = indices.size();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    if(vertices.size() <= MAX_INDEX16_VERTICES) {
+        std::vector<uint16_t> idx16(indices.begin(), indices.end());
+        idx16.insert(idx16.end(), lod_indices.begin(), lod_indices.end());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx16.size()*sizeof(uint16_t),
+                idx16.data(), GL_STATIC_DRAW);
+        index_type = GL_UNSIGNED_SHORT;
+    } else if(!lod_indices.empty()) {
+        std::vector<unsigned int> idxs = indices;
+        idxs.insert(idxs.end(), lod_indices.begin(), lod_indices.end());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, idxs.size()*sizeof(unsigned int),
+                idxs.data(), GL_STATIC_DRAW);
+        index_type = GL_UNSIGNED_INT;
+    } else {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(unsigned int),
+                indices.data(), GL_STATIC_DRAW);
+        index_type = GL_UNSIGNED_INT;
+    }
+
+    layout.set_attributes();
 
 #ifdef __vita__
     shader->bind();
@@ -75,107 +297,251 @@ Mesh::Mesh(std::vector<Vertex> vert, std::vector<unsigned int> idx, Material* ma
     glBindVertexArray(0);
 }
 
-void Mesh::render(Shader* shader, ShadingType type) {
+void Mesh::release_cpu_data() {
+    if(!uploaded() || keep_cpu_data) return;
+    std::vector<Vertex>{}.swap(vertices);
+    std::vector<unsigned int>{}.swap(indices);
+    std::vector<unsigned int>{}.swap(lod_indices);
+    released = true;
+}
+
+size_t MeshData::select_lod(float max_error) const {
+    size_t lod = 0;
+    while(lod < lods.size() && lods[lod].error <= max_error) lod++;
+    return lod;
+}
+
+// handles of the uniforms Mesh::render sets, shared by every shader
+static const struct MeshUniforms {
+#ifdef __vita__
+    Uniform<int> diffuse_tex_exists {"material.diffuse_tex_exists"};
+    Uniform<int> diffuse_tex {"material.diffuse_tex"};
+    Uniform<glm::vec3> diffuse {"material.diffuse"};
+    Uniform<glm::vec3> ambient {"material.ambient"};
+    Uniform<float> shininess {"material.shininess"};
+    Uniform<glm::vec3> albedo {"material.albedo"};
+    Uniform<int> normal_tex_exists {"material.normal_tex_exists"};
+    Uniform<int> normal_tex {"material.normal_tex"};
+    Uniform<int> specular_tex_exists {"material.specular_tex_exists"};
+    Uniform<int> specular_tex {"material.specular_tex"};
+    Uniform<glm::vec3> specular {"material.specular"};
+    Uniform<int> metallic_tex_exists {"material.metallic_tex_exists"};
+    Uniform<int> metallic_tex {"material.metallic_tex"};
+    Uniform<float> metallic {"material.metallic"};
+    Uniform<int> roughness_tex_exists {"material.roughness_tex_exists"};
+    Uniform<int> roughness_tex {"material.roughness_tex"};
+    Uniform<float> roughness {"material.roughness"};
+    Uniform<int> ao_tex_exists {"material.ao_tex_exists"};
+    Uniform<int> ao_tex {"material.ao_tex"};
+#endif
+    Uniform<glm::vec3> position_scale {"position_scale"};
+    Uniform<glm::vec3> position_offset {"position_offset"};
+} mesh_uniforms;
+
+#ifndef __vita__
+static void bind_texture(GLint unit, const Material* material, int8_t id) {
+    if(id < 0) return;
+    glActiveTexture(GL_TEXTURE0+unit);
+    glBindTexture(GL_TEXTURE_2D, material->textures[id]->id);
+}
+#endif
+
+void Mesh::bind_material([[maybe_unused]] Shader* shader, ShadingType type) {
+#ifndef __vita__
+    // scalars and texture flags live in the material's uniform block, samplers
+    // are fixed to units at link
+    material->bind();
+    bind_texture(DIFFUSE_UNIT, material, material->diffuse_id);
+    bind_texture(NORMAL_UNIT, material, material->normal_id);
+    if(type == ShadingType::PHONG) {
+        bind_texture(SPECULAR_UNIT, material, material->specular_id);
+    } else {
+        bind_texture(METALLIC_UNIT, material, material->metallic_id);
+        bind_texture(ROUGHNESS_UNIT, material, material->roughness_id);
+        bind_texture(AO_UNIT, material, material->ao_id);
+    }
+#else
     uint8_t count = 0;
     if(material->diffuse_id>-1) {
         glActiveTexture(GL_TEXTURE0+count);
-        shader->set("material.diffuse_tex_exists", 1);
-        shader->set("material.diffuse_tex", count);
+        shader->set(mesh_uniforms.diffuse_tex_exists, 1);
+        shader->set(mesh_uniforms.diffuse_tex, count);
         glBindTexture(GL_TEXTURE_2D, material->textures[material->diffuse_id]->id);
         count++;
     } else {
-        shader->set("material.diffuse_tex_exists", 0);
+        shader->set(mesh_uniforms.diffuse_tex_exists, 0);
         if(type==ShadingType::PHONG) {
-            shader->set("material.diffuse", material->diffuse);
-            shader->set("material.ambient", material->ambient);
-            shader->set("material.shininess", material->shininess);
-        } else shader->set("material.albedo", material->albedo);
+            shader->set(mesh_uniforms.diffuse, material->diffuse);
+            shader->set(mesh_uniforms.ambient, material->ambient);
+            shader->set(mesh_uniforms.shininess, material->shininess);
+        } else shader->set(mesh_uniforms.albedo, material->albedo);
     }
 
     if(material->normal_id>-1) {
         glActiveTexture(GL_TEXTURE0+count);
-        shader->set("material.normal_tex_exists", 1);
-        shader->set("material.normal_tex", count);
+        shader->set(mesh_uniforms.normal_tex_exists, 1);
+        shader->set(mesh_uniforms.normal_tex, count);
         glBindTexture(GL_TEXTURE_2D, material->textures[material->normal_id]->id);
         count++;
-    } else shader->set("material.normal_tex_exists", 0);
+    } else shader->set(mesh_uniforms.normal_tex_exists, 0);
 
     if(type == ShadingType::PHONG) {
         if(material->specular_id>-1) {
             glActiveTexture(GL_TEXTURE0+count);
-            shader->set("material.specular_tex_exists", 1);
-            shader->set("material.specular_tex", count);
+            shader->set(mesh_uniforms.specular_tex_exists, 1);
+            shader->set(mesh_uniforms.specular_tex, count);
             glBindTexture(GL_TEXTURE_2D, material->textures[material->specular_id]->id);
             count++;
         } else {
-            shader->set("material.specular_tex_exists", 0);
-            shader->set("material.specular", material->specular);
+            shader->set(mesh_uniforms.specular_tex_exists, 0);
+            shader->set(mesh_uniforms.specular, material->specular);
         }
     } else {
         if(material->metallic_id>-1) {
             glActiveTexture(GL_TEXTURE0+count);
-            shader->set("material.metallic_tex_exists", 1);
-            shader->set("material.metallic_tex", count);
+            shader->set(mesh_uniforms.metallic_tex_exists, 1);
+            shader->set(mesh_uniforms.metallic_tex, count);
             glBindTexture(GL_TEXTURE_2D, material->textures[material->metallic_id]->id);
             count++;
         } else {
-            shader->set("material.metallic_tex_exists", 0);
-            shader->set("material.metallic", material->metallic);
+            shader->set(mesh_uniforms.metallic_tex_exists, 0);
+            shader->set(mesh_uniforms.metallic, material->metallic);
         }
 
         if(material->roughness_id>-1) {
             glActiveTexture(GL_TEXTURE0+count);
-            shader->set("material.roughness_tex_exists", 1);
-            shader->set("material.roughness_tex", count);
+            shader->set(mesh_uniforms.roughness_tex_exists, 1);
+            shader->set(mesh_uniforms.roughness_tex, count);
             glBindTexture(GL_TEXTURE_2D, material->textures[material->roughness_id]->id);
             count++;
         } else {
-            shader->set("material.roughness_tex_exists", 0);
-            shader->set("material.roughness", material->roughness);
+            shader->set(mesh_uniforms.roughness_tex_exists, 0);
+            shader->set(mesh_uniforms.roughness, material->roughness);
         }
 
         if(material->ao_id>-1) {
             glActiveTexture(GL_TEXTURE0+count);
-            shader->set("material.ao_tex_exists", 1);
-            shader->set("material.ao_tex", count);
+            shader->set(mesh_uniforms.ao_tex_exists, 1);
+            shader->set(mesh_uniforms.ao_tex, count);
             glBindTexture(GL_TEXTURE_2D, material->textures[material->ao_id]->id);
             count++;
         } else {
-            shader->set("material.ao_tex_exists", 0);
+            shader->set(mesh_uniforms.ao_tex_exists, 0);
         }
     }
 
+#endif
+
+}
+
+void Mesh::bind(Shader* shader) {
     glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+    shader->set(mesh_uniforms.position_scale, layout.position_scale);
+    shader->set(mesh_uniforms.position_offset, layout.position_offset);
+}
+
+void Mesh::draw(size_t lod, GLsizei instances) {
+    size_t draw_count = index_count, offset = 0;
+    if(lod > 0 && lod <= lods.size()) {
+        draw_count = lods[lod-1].index_count;
+        offset = index_count + lods[lod-1].index_offset;
+    }
+    size_t index_size = index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+
+#ifndef __vita__
+    if(instances > 1) {
+        glDrawElementsInstanced(GL_TRIANGLES, draw_count, index_type, (void*)(offset*index_size), instances);
+        return;
+    }
+#endif
+    glDrawElements(GL_TRIANGLES, draw_count, index_type, (void*)(offset*index_size));
+}
+
+void Mesh::render(Shader* shader, ShadingType type, size_t lod) {
+    if(!uploaded()) return;
+    bind_material(shader, type);
+    bind(shader);
+    draw(lod);
     glBindVertexArray(0);
 }
 
 Mesh::~Mesh() {
+    if(!uploaded()) return;
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &EBO);
 }
 
-Model::Model(const std::string& path, Shader* shader_, ShadingType shading_t) 
-    : shader{shader_}, shading{shading_t} {
+Model::Model(const std::string& path, Shader* shader_, ShadingType shading_t, bool upload_now, bool release_cpu_data_,
+        KeepMeshData keep)
+    : shading{shading_t}, release_cpu_data{release_cpu_data_}, keep_mesh_data{std::move(keep)}, shader{shader_} {
     load(path);
+    if(upload_now) upload();
 }
 
-void Model::load(const std::string& path) {
+MeshData* Model::create_mesh(MeshData&& data) {
+    return new Mesh(std::move(data), shader, false);
+}
+
+std::vector<Mesh*> Model::get_meshes() {
+    std::vector<Mesh*> result;
+    result.reserve(meshes.size());
+    for(auto& mesh: meshes) result.push_back(static_cast<Mesh*>(mesh));
+    return result;
+}
+
+void Model::upload() {
+    for(auto& tex: textures) tex->upload();
+    auto all = get_meshes();
+    for(size_t i=0; i<all.size(); i++) {
+        all[i]->upload();
+        if(!release_cpu_data) continue;
+        if(keep_mesh_data && keep_mesh_data(i, *all[i])) all[i]->keep_cpu_data = true;
+        all[i]->release_cpu_data();
+    }
+}
+
+void Model::replace(Model& other) {
+    for(auto& mesh: other.get_meshes()) mesh->set_shader(shader);
+    other.release_cpu_data = release_cpu_data;
+    other.keep_mesh_data = keep_mesh_data;
+    other.upload();
+
+    std::swap(meshes, other.meshes);
+    std::swap(bones, other.bones);
+    std::swap(textures, other.textures);
+    std::swap(texture_names, other.texture_names);
+    std::swap(bounds_min, other.bounds_min);
+    std::swap(bounds_max, other.bounds_max);
+    std::swap(bounds_center, other.bounds_center);
+    std::swap(bounds_radius, other.bounds_radius);
+    std::swap(directory, other.directory);
+    std::swap(path, other.path);
+}
+
+ModelData::ModelData(const std::string& path) {
+    load(path);
+}
+
+MeshData* ModelData::create_mesh(MeshData&& data) {
+    return new MeshData(std::move(data));
+}
+
+void ModelData::load(const std::string& path) {
+    this->path = path;
 #ifdef USE_ASSIMP
     assimp_load(path);
 #else
-    auto file = util::read_file(path);
+    util::AssetStream s{path};
     directory = path.substr(0, path.find_last_of('/'));
-    auto decompressed = util::decompress(file);
-    std::stringstream s;
-    s << decompressed;
-    deserialize_data(s);
+    if(format::is_binary(s.get())) deserialize_binary(s.get());
+    else deserialize_data(s.get());
 #endif
+    calculate_bounds();
 }
 
 #ifdef USE_ASSIMP
-void Model::assimp_load(const std::string& path) {
+void ModelData::assimp_load(const std::string& path) {
     Assimp::Importer import;
     const aiScene* scene = import.ReadFile(path, aiProcess_JoinIdenticalVertices | aiProcess_Triangulate | aiProcess_FlipUVs);
 
@@ -191,26 +557,21 @@ void Model::assimp_load(const std::string& path) {
 }
 #endif
 
-Texture* Model::texture_load(const std::string& path) {
-    Texture* tex;
-    bool skip = false;
+Texture* ModelData::texture_load(const std::string& path) {
+    Texture* tex = TextureCache::get().acquire(path, false);
     for(Texture* loaded: textures) {
-        if(loaded->path == path) {
-            tex = loaded;
-            skip = true;
-            break;
+        if(loaded == tex) {
+            TextureCache::get().release(tex);
+            return tex;
         }
     }
-    if(!skip) {
-        tex = new Texture{path};
-        glp_logv("new texture: %s", tex->path.c_str());
-        textures.push_back(tex);
-    }
+    glp_logv("new texture: %s", tex->path.c_str());
+    textures.push_back(tex);
     return tex;
 }
 
 #ifdef USE_ASSIMP
-void Model::assimp_node_process(aiNode* node, const aiScene* scene) {
+void ModelData::assimp_node_process(aiNode* node, const aiScene* scene) {
     for(size_t i=0; i<node->mNumMeshes; i++) {
         aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
         meshes.push_back(assimp_mesh_process(mesh, scene));
@@ -220,7 +581,7 @@ void Model::assimp_node_process(aiNode* node, const aiScene* scene) {
         assimp_node_process(node->mChildren[i], scene);
 }
 
-Texture* Model::assimp_textures_load(aiMaterial* mat, aiTextureType type) {
+Texture* ModelData::assimp_textures_load(aiMaterial* mat, aiTextureType type) {
     Texture* tex {nullptr};
     for(size_t i=0; i<mat->GetTextureCount(type); i++) {
         aiString str;
@@ -231,7 +592,7 @@ Texture* Model::assimp_textures_load(aiMaterial* mat, aiTextureType type) {
     return tex;
 }
 
-Mesh* Model::assimp_mesh_process(aiMesh* mesh, const aiScene* scene) {
+MeshData* ModelData::assimp_mesh_process(aiMesh* mesh, const aiScene* scene) {
     std::vector<Vertex> verts;
     std::vector<unsigned int> idxs;
     Material* mat {nullptr};
@@ -298,18 +659,18 @@ Mesh* Model::assimp_mesh_process(aiMesh* mesh, const aiScene* scene) {
 
         int8_t count = 0;
         auto dif = assimp_textures_load(aimat, aiTextureType_DIFFUSE);
-        if(dif) mat->textures.push_back(dif), mat->diffuse_id = count++;
+        if(dif) mat->add_texture(dif), mat->diffuse_id = count++;
         auto spec = assimp_textures_load(aimat, aiTextureType_SPECULAR);
-        if(spec) mat->textures.push_back(spec), mat->specular_id = count++;
+        if(spec) mat->add_texture(spec), mat->specular_id = count++;
 
         auto rough = assimp_textures_load(aimat, aiTextureType_DIFFUSE_ROUGHNESS);
-        if(rough) mat->textures.push_back(rough), mat->roughness_id = count++;
+        if(rough) mat->add_texture(rough), mat->roughness_id = count++;
         auto metal = assimp_textures_load(aimat, aiTextureType_METALNESS);
-        if(metal) mat->textures.push_back(metal), mat->metallic_id = count++;
+        if(metal) mat->add_texture(metal), mat->metallic_id = count++;
         auto ao = assimp_textures_load(aimat, aiTextureType_AMBIENT_OCCLUSION);
-        if(ao) mat->textures.push_back(ao), mat->ao_id = count++;
+        if(ao) mat->add_texture(ao), mat->ao_id = count++;
         auto normal = assimp_textures_load(aimat, aiTextureType_NORMALS);
-        if(normal) mat->textures.push_back(normal), mat->normal_id = count++;
+        if(normal) mat->add_texture(normal), mat->normal_id = count++;
     }
 
     if(mesh->HasBones()) {
@@ -346,39 +707,132 @@ Mesh* Model::assimp_mesh_process(aiMesh* mesh, const aiScene* scene) {
         }
     }
     
-    return new Mesh(verts, idxs, mat, shader);
+    return create_mesh(MeshData{std::move(verts), std::move(idxs), mat});
 }
 #endif
 
 void Model::render() {
-    for(auto& mesh: meshes) mesh->render(shader, shading);
+    for(auto& mesh: get_meshes()) mesh->render(shader, shading);
+}
+
+void Model::render(float pixels_per_unit) {
+    float max_error = pixels_per_unit > 0.0f ? lod_threshold/pixels_per_unit : 0.0f;
+    for(auto& mesh: get_meshes()) mesh->render(shader, shading, mesh->select_lod(max_error));
 }
 
-glm::vec3 Model::calculate_bounding_box() {
+void ModelData::calculate_bounds() {
     glm::vec3 min {std::numeric_limits<float>::max()};
     glm::vec3 max {-std::numeric_limits<float>::max()};
-    for(const auto& mesh: meshes) {
+    for(const auto& mesh: meshes)
+        for(const auto& vert: mesh->vertices) {
+            min = glm::min(min, vert.position);
+            max = glm::max(max, vert.position);
+        }
+    if(min.x > max.x) return;
+    bounds_min = min;
+    bounds_max = max;
+    bounds_center = (min+max)/2.0f;
+    bounds_radius = 0.0f;
+    for(const auto& mesh: meshes)
+        for(const auto& vert: mesh->vertices)
+            bounds_radius = std::max(bounds_radius, glm::length(vert.position-bounds_center));
+
+    // per mesh spheres let the parts of a large model be culled on their own
+    for(auto& mesh: meshes) {
+        if(mesh->vertices.empty()) continue;
+        glm::vec3 mesh_min {std::numeric_limits<float>::max()};
+        glm::vec3 mesh_max {-std::numeric_limits<float>::max()};
         for(const auto& vert: mesh->vertices) {
-            min.x = std::min(min.x, vert.position.x);
-            min.y = std::min(min.y, vert.position.y);
-            min.z = std::min(min.z, vert.position.z);
-            max.x = std::max(max.x, vert.position.x);
-            max.y = std::max(max.y, vert.position.y);
-            max.z = std::max(max.z, vert.position.z);
+            mesh_min = glm::min(mesh_min, vert.position);
+            mesh_max = glm::max(mesh_max, vert.position);
         }
+        mesh->bounds_center = (mesh_min+mesh_max)/2.0f;
+        mesh->bounds_radius = 0.0f;
+        for(const auto& vert: mesh->vertices)
+            mesh->bounds_radius = std::max(mesh->bounds_radius, glm::length(vert.position-mesh->bounds_center));
     }
-    return glm::vec3((max.x-min.x)/2,
-            (max.y-min.y)/2,
-            (max.z-min.z)/2);
 }
 
-Model::~Model() {
-    for(auto& mesh: meshes) delete mesh;
-    for(auto& tex: textures) delete tex;
+std::string ModelData::get_texture_name(const Texture* tex) const {
+    auto it = texture_names.find(tex);
+    if(it != texture_names.end()) return it->second;
+    return tex->path.substr(tex->path.find_last_of('/')+1);
 }
 
-std::stringstream Model::serialize_data() {
+glm::vec3 ModelData::calculate_bounding_box() {
+    return (bounds_max-bounds_min)/2.0f;
+}
+
+static bool released_meshes(const std::vector<MeshData*>& meshes) {
+    for(const auto& mesh: meshes) {
+        if(mesh->cpu_data_released()) {
+            glp_log("model meshes were released after upload, nothing to serialize");
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t ModelData::split_meshes(size_t max_vertices) {
+    size_t split = 0;
+    std::vector<MeshData*> result;
+    constexpr unsigned int unused = std::numeric_limits<unsigned int>::max();
+    for(auto mesh: meshes) {
+        if(mesh->vertices.size() <= max_vertices) {
+            result.push_back(mesh);
+            continue;
+        }
+        // triangles keep their order, a new part starts when the next one
+        // would take a part over max_vertices
+        std::vector<unsigned int> remap(mesh->vertices.size(), unused);
+        std::vector<unsigned int> used;
+        std::vector<Vertex> verts;
+        std::vector<unsigned int> idxs;
+        auto flush = [&] {
+            for(auto i: used) remap[i] = unused;
+            used.clear();
+            MeshData part {std::move(verts), std::move(idxs), mesh->material};
+            part.layout = mesh->layout;
+            result.push_back(create_mesh(std::move(part)));
+            verts.clear();
+            idxs.clear();
+        };
+        for(size_t t=0; t+2<mesh->indices.size(); t+=3) {
+            size_t added = 0;
+            for(size_t k=0; k<3; k++) added += remap[mesh->indices[t+k]] == unused;
+            if(verts.size()+added > max_vertices) flush();
+            for(size_t k=0; k<3; k++) {
+                auto& r = remap[mesh->indices[t+k]];
+                if(r == unused) {
+                    r = verts.size();
+                    used.push_back(mesh->indices[t+k]);
+                    verts.push_back(mesh->vertices[mesh->indices[t+k]]);
+                }
+                idxs.push_back(r);
+            }
+        }
+        if(!idxs.empty()) flush();
+        delete mesh;
+        split++;
+    }
+    meshes = std::move(result);
+    return split;
+}
+
+ModelData::~ModelData() {
+    std::vector<Material*> materials;
+    for(auto& mesh: meshes) {
+        if(std::find(materials.begin(), materials.end(), mesh->material) == materials.end())
+            materials.push_back(mesh->material);
+        delete mesh;
+    }
+    for(auto& mat: materials) delete mat;
+    for(auto& tex: textures) TextureCache::get().release(tex);
+}
+
+std::stringstream ModelData::serialize_data() {
     std::stringstream s;
+    if(released_meshes(meshes)) return s;
     s << "meshes " << meshes.size() << ' ';
     for(const auto& mesh: meshes) {
         s << "mesh " << "verts " << mesh->vertices.size() << ' ';
@@ -405,10 +859,8 @@ std::stringstream Model::serialize_data() {
         for(const auto& id: mesh->indices)
             s << id << ' ';
         s << "mat " << "texs " << mesh->material->textures.size() << ' ';
-        for(const auto& tex: mesh->material->textures) {
-            size_t f = tex->path.find_last_of("/");
-            s << tex->path.substr(f+1) << ' ';
-        }
+        for(const auto& tex: mesh->material->textures)
+            s << get_texture_name(tex) << ' ';
         s << "amb " << mesh->material->ambient.x << ' '
             << mesh->material->ambient.y << ' '
             << mesh->material->ambient.z << ' ';
@@ -459,7 +911,7 @@ std::stringstream Model::serialize_data() {
     return s;
 }
 
-void Model::deserialize_data(std::stringstream& s) {
+void ModelData::deserialize_data(std::istream& s) {
     std::string name;
     size_t count;
     
@@ -506,10 +958,9 @@ void Model::deserialize_data(std::stringstream& s) {
         auto mat = new Material;
         s >> name; assert(name == "texs");
         s >> count;
-        mat->textures.resize(count);
-        for(size_t i=0; i<mat->textures.size(); i++) {
+        for(size_t i=0; i<count; i++) {
             s >> name;
-            mat->textures[i] = texture_load(directory + '/' + name);
+            mat->add_texture(texture_load(directory + '/' + name));
         }
         s >> name; assert(name == "amb");
         s >> mat->ambient.x
@@ -545,7 +996,7 @@ void Model::deserialize_data(std::stringstream& s) {
         s >>   mat->ao_id;
         s >> name; assert(name == "nid");
         s >>   mat->normal_id;
-        meshes[i] = new Mesh(verts, idxs, mat, shader);
+        meshes[i] = create_mesh(MeshData{std::move(verts), std::move(idxs), mat});
     }
 
     s >> name; assert("bones");
@@ -563,4 +1014,248 @@ void Model::deserialize_data(std::stringstream& s) {
     }
 }
 
+static format::MaterialEntry material_entry(const ModelData& model, const Material& mat, std::string& strings) {
+    format::MaterialEntry entry {};
+    for(size_t i=0; i<3; i++) {
+        entry.ambient[i] = mat.ambient[i];
+        entry.diffuse[i] = mat.diffuse[i];
+        entry.specular[i] = mat.specular[i];
+        entry.albedo[i] = mat.albedo[i];
+    }
+    entry.shininess = mat.shininess;
+    entry.metallic = mat.metallic;
+    entry.roughness = mat.roughness;
+    entry.diffuse_id = mat.diffuse_id;
+    entry.specular_id = mat.specular_id;
+    entry.metallic_id = mat.metallic_id;
+    entry.roughness_id = mat.roughness_id;
+    entry.ao_id = mat.ao_id;
+    entry.normal_id = mat.normal_id;
+    entry.texture_count = std::min(mat.textures.size(), format::MAX_MATERIAL_TEXTURES);
+    for(size_t i=0; i<entry.texture_count; i++)
+        entry.textures[i] = format::add_string(strings, model.get_texture_name(mat.textures[i]));
+    return entry;
+}
+
+static void write_indices(std::string& blobs, const unsigned int* indices, size_t count, size_t index_size) {
+    if(index_size == sizeof(uint16_t)) {
+        std::vector<uint16_t> idx16(indices, indices+count);
+        format::write(blobs, idx16.data(), idx16.size());
+    } else format::write(blobs, indices, count);
+}
+
+static bool read_indices(std::istream& s, uint64_t& pos, uint64_t offset, size_t index_size, unsigned int* indices, size_t count) {
+    if(!format::skip_to(s, pos, offset)) return false;
+    if(index_size == sizeof(uint16_t)) {
+        std::vector<uint16_t> idx16(count);
+        if(!format::read(s, idx16.data(), idx16.size())) return false;
+        std::copy(idx16.begin(), idx16.end(), indices);
+        pos += count*sizeof(uint16_t);
+        return true;
+    }
+    pos += count*sizeof(unsigned int);
+    return format::read(s, indices, count);
+}
+
+std::string ModelData::serialize_binary() {
+    if(released_meshes(meshes)) return {};
+    std::vector<format::MeshEntry> mesh_table;
+    std::vector<format::MaterialEntry> material_table;
+    std::vector<format::BoneEntry> bone_table;
+    std::vector<format::LodEntry> lod_table;
+    std::string strings, blobs;
+
+    for(size_t i=0; i<meshes.size(); i++) {
+        const auto& mesh = meshes[i];
+        format::MeshEntry entry {};
+        entry.vertex_count = mesh->vertices.size();
+        entry.index_count = mesh->indices.size();
+        entry.material = material_table.size();
+        entry.flags = mesh->layout.flags;
+        entry.vertex_stride = mesh->layout.stride();
+        format::align(blobs);
+        entry.vertex_offset = blobs.size();
+        blobs += mesh->layout.pack(mesh->vertices);
+        std::memcpy(entry.position_offset, glm::value_ptr(mesh->layout.position_offset), sizeof(entry.position_offset));
+        std::memcpy(entry.position_scale, glm::value_ptr(mesh->layout.position_scale), sizeof(entry.position_scale));
+        format::align(blobs);
+        entry.index_offset = blobs.size();
+        entry.index_size = mesh->vertices.size() <= MAX_INDEX16_VERTICES ? sizeof(uint16_t) : sizeof(unsigned int);
+        write_indices(blobs, mesh->indices.data(), mesh->indices.size(), entry.index_size);
+        for(const auto& lod: mesh->lods) {
+            format::align(blobs);
+            lod_table.push_back(format::LodEntry{static_cast<uint32_t>(i), static_cast<uint32_t>(lod.index_count),
+                    lod.error, 0, blobs.size()});
+            write_indices(blobs, mesh->lod_indices.data()+lod.index_offset, lod.index_count, entry.index_size);
+        }
+        mesh_table.push_back(entry);
+        material_table.push_back(material_entry(*this, *mesh->material, strings));
+    }
+
+    for(const auto& bone: bones) {
+        format::BoneEntry entry {};
+        entry.name = format::add_string(strings, bone.name);
+        std::memcpy(entry.offset, glm::value_ptr(bone.offset), sizeof(entry.offset));
+        bone_table.push_back(entry);
+    }
+
+    format::ModelHeader header {};
+    std::memcpy(header.magic, format::MODEL_MAGIC, sizeof(header.magic));
+    header.version = format::MODEL_VERSION;
+    header.mesh_count = mesh_table.size();
+    header.material_count = material_table.size();
+    header.bone_count = bone_table.size();
+    header.lod_count = lod_table.size();
+    header.strings_size = strings.size();
+    header.blobs_size = blobs.size();
+
+    std::string s;
+    format::write(s, header);
+    format::write(s, mesh_table.data(), mesh_table.size());
+    format::write(s, material_table.data(), material_table.size());
+    format::write(s, bone_table.data(), bone_table.size());
+    format::write(s, lod_table.data(), lod_table.size());
+    s += strings;
+    format::align(s);
+    header.blobs_offset = s.size();
+    std::memcpy(s.data(), &header, sizeof(header));
+    s += blobs;
+
+    return s;
+}
+
+void ModelData::deserialize_binary(std::istream& s) {
+    format::ModelHeader header {};
+    if(!format::read(s, reinterpret_cast<char*>(&header), format::MODEL_HEADER_V3_SIZE)
+            || !format::check_magic(header.magic, format::MODEL_MAGIC)) {
+        glp_log("model has no valid binary header");
+        return;
+    }
+    if(header.version > format::MODEL_VERSION) {
+        glp_logv("unsupported model version %u", header.version);
+        return;
+    }
+    size_t header_size = format::MODEL_HEADER_V3_SIZE;
+    if(header.version >= 4) {
+        header_size = sizeof(header);
+        if(!format::read(s, reinterpret_cast<char*>(&header)+format::MODEL_HEADER_V3_SIZE,
+                    sizeof(header)-format::MODEL_HEADER_V3_SIZE)) {
+            glp_log("model has no valid binary header");
+            return;
+        }
+    }
+
+    std::vector<format::MeshEntry> mesh_table(header.mesh_count);
+    std::vector<format::MaterialEntry> material_table(header.material_count);
+    std::vector<format::BoneEntry> bone_table(header.bone_count);
+    std::vector<format::LodEntry> lod_table(header.lod_count);
+    std::string strings(header.strings_size, '\0');
+    size_t mesh_entry_size = header.version < 3 ? format::MESH_ENTRY_V2_SIZE : sizeof(format::MeshEntry);
+    bool meshes_read = true;
+    for(auto& entry: mesh_table) {
+        entry = format::MeshEntry{};
+        meshes_read &= format::read(s, reinterpret_cast<char*>(&entry), mesh_entry_size);
+        if(header.version < 3) {
+            entry.flags = format::VERTEX_SKINNED;
+            entry.vertex_stride = sizeof(Vertex);
+            std::fill(std::begin(entry.position_scale), std::end(entry.position_scale), 1.0f);
+        }
+    }
+    if(!meshes_read
+            || !format::read(s, material_table.data(), material_table.size())
+            || !format::read(s, bone_table.data(), bone_table.size())
+            || !format::read(s, lod_table.data(), lod_table.size())
+            || !format::read(s, strings.data(), strings.size())) {
+        glp_log("model tables are truncated");
+        return;
+    }
+    uint64_t pos = header_size + mesh_table.size()*mesh_entry_size
+        + material_table.size()*sizeof(format::MaterialEntry)
+        + bone_table.size()*sizeof(format::BoneEntry)
+        + lod_table.size()*sizeof(format::LodEntry) + strings.size();
+
+    std::vector<Material*> materials;
+    for(const auto& entry: material_table) {
+        auto mat = new Material;
+        mat->ambient = glm::make_vec3(entry.ambient);
+        mat->diffuse = glm::make_vec3(entry.diffuse);
+        mat->specular = glm::make_vec3(entry.specular);
+        mat->shininess = entry.shininess;
+        mat->albedo = glm::make_vec3(entry.albedo);
+        mat->metallic = entry.metallic;
+        mat->roughness = entry.roughness;
+        mat->diffuse_id = entry.diffuse_id;
+        mat->specular_id = entry.specular_id;
+        mat->metallic_id = entry.metallic_id;
+        mat->roughness_id = entry.roughness_id;
+        mat->ao_id = entry.ao_id;
+        mat->normal_id = entry.normal_id;
+        for(size_t i=0; i<std::min<size_t>(entry.texture_count, format::MAX_MATERIAL_TEXTURES); i++)
+            mat->add_texture(texture_load(directory + '/' + format::get_string(strings, entry.textures[i])));
+        materials.push_back(mat);
+    }
+
+    auto lod = lod_table.begin();
+    for(size_t i=0; i<mesh_table.size(); i++) {
+        const auto& entry = mesh_table[i];
+        if(entry.material >= materials.size()) {
+            glp_logv("mesh references missing material %u", entry.material);
+            return;
+        }
+        VertexLayout layout;
+        layout.flags = entry.flags;
+        layout.position_offset = glm::make_vec3(entry.position_offset);
+        layout.position_scale = glm::make_vec3(entry.position_scale);
+        if(layout.stride() != entry.vertex_stride) {
+            glp_logv("unsupported vertex layout %#x", entry.flags);
+            return;
+        }
+        std::vector<Vertex> verts;
+        std::string packed;
+        std::vector<unsigned int> idxs(entry.index_count);
+        if(!format::skip_to(s, pos, header.blobs_offset+entry.vertex_offset)) {
+            glp_log("model vertex blob is truncated");
+            return;
+        }
+        if(layout.is_full()) {
+            verts.resize(entry.vertex_count);
+            if(!format::read(s, verts.data(), verts.size())) {
+                glp_log("model vertex blob is truncated");
+                return;
+            }
+        } else {
+            // the packed blob is uploaded as is, vertices are unpacked for cpu side users
+            packed.resize(entry.vertex_count*entry.vertex_stride);
+            if(!format::read(s, packed.data(), packed.size())) {
+                glp_log("model vertex blob is truncated");
+                return;
+            }
+            verts = layout.unpack(packed.data(), entry.vertex_count);
+        }
+        pos += static_cast<uint64_t>(entry.vertex_count)*entry.vertex_stride;
+        if(!read_indices(s, pos, header.blobs_offset+entry.index_offset, entry.index_size, idxs.data(), idxs.size())) {
+            glp_log("model index blob is truncated");
+            return;
+        }
+        MeshData mesh {std::move(verts), std::move(idxs), materials[entry.material]};
+        mesh.layout = layout;
+        mesh.packed = std::move(packed);
+
+        for(; lod != lod_table.end() && lod->mesh == i; lod++) {
+            size_t offset = mesh.lod_indices.size();
+            mesh.lod_indices.resize(offset+lod->index_count);
+            if(!read_indices(s, pos, header.blobs_offset+lod->index_offset, entry.index_size,
+                        mesh.lod_indices.data()+offset, lod->index_count)) {
+                glp_log("model lod blob is truncated");
+                return;
+            }
+            mesh.lods.push_back(MeshLod{offset, lod->index_count, lod->error});
+        }
+        meshes.push_back(create_mesh(std::move(mesh)));
+    }
+
+    for(const auto& entry: bone_table)
+        bones.emplace_back(format::get_string(strings, entry.name), glm::make_mat4(entry.offset));
+}
+
 }
@@ -0,0 +1,264 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include "obj/render-queue.hh"
+#include "obj/renderable.hh"
+
+namespace glp {
+
+namespace Object {
+
+static const Uniform<std::vector<glm::mat4>> pose_uniform {"pose"};
+static const Uniform<int> instanced_uniform {"instanced"};
+
+#ifndef __vita__
+static const bool pose_unit = [] {
+    set_sampler_unit("pose_buffer", RenderQueue::POSE_UNIT);
+    return true;
+}();
+#endif
+
+RenderQueue::~RenderQueue() {
+#ifndef __vita__
+    if(instance_buffer) glDeleteBuffers(1, &instance_buffer);
+    if(bone_buffer) glDeleteBuffers(1, &bone_buffer);
+    if(bone_texture) glDeleteTextures(1, &bone_texture);
+#endif
+}
+
+uint64_t RenderQueue::id(std::unordered_map<const void*, uint64_t>& ids, const void* p, unsigned bits) {
+    auto [it, inserted] = ids.try_emplace(p, ids.size());
+    return std::min(it->second, (uint64_t{1} << bits) - 1);
+}
+
+void RenderQueue::begin(Camera& camera) {
+    stats = RenderStats{};
+    frustum = Frustum{camera.view_projection()};
+}
+
+void RenderQueue::cull(const std::vector<glm::vec4>& spheres, std::vector<uint8_t>& visible) {
+    visible.resize(spheres.size());
+    size_t passed = frustum.cull(spheres.data(), spheres.size(), visible.data());
+    stats.visible_objects += passed;
+    stats.culled_objects += spheres.size() - passed;
+}
+
+void RenderQueue::add(Model* model, const glm::mat4& transform, float pixels_per_unit, Camera& camera,
+        const std::vector<glm::mat4>* pose, uint8_t pass) {
+    Shader* shader = model->get_shader();
+    if(!shader) return;
+
+    // front to back over the camera's range
+    glm::vec3 center = transform * glm::vec4(model->get_bounds_center(), 1.0f);
+    float depth = std::clamp(glm::length(center - camera.get_position())/camera.get_far(), 0.0f, 1.0f);
+    uint64_t depth_key = static_cast<uint64_t>(depth * ((1 << DEPTH_BITS) - 1));
+
+    uint64_t program_key = id(programs, shader, PROGRAM_BITS);
+    float max_error = pixels_per_unit > 0.0f ? model->get_lod_threshold()/pixels_per_unit : 0.0f;
+    auto model_meshes = model->get_meshes();
+    // a pose moves vertices outside the meshes' spheres
+    bool cull_meshes = !pose && model_meshes.size() > 1;
+    float scale = std::max({glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])),
+            glm::length(glm::vec3(transform[2]))});
+    for(auto& mesh: model_meshes) {
+        if(!mesh->uploaded()) continue;
+        if(cull_meshes && !frustum.contains(transform * glm::vec4(mesh->bounds_center, 1.0f), mesh->bounds_radius*scale)) {
+            stats.culled_meshes++;
+            continue;
+        }
+        uint64_t key = uint64_t{std::min<uint8_t>(pass, (1 << PASS_BITS) - 1)};
+        key = key << PROGRAM_BITS | program_key;
+        key = key << MATERIAL_BITS | id(materials, mesh->material, MATERIAL_BITS);
+        key = key << MESH_BITS | id(meshes, mesh, MESH_BITS);
+        key = key << DEPTH_BITS | depth_key;
+        items.push_back({key, shader, model->get_shading_type(), mesh, mesh->select_lod(max_error), transform, pose});
+    }
+}
+
+#ifndef __vita__
+int32_t RenderQueue::palette(const std::vector<glm::mat4>* pose) {
+    if(!pose) return 0;
+    auto [it, inserted] = palettes.try_emplace(pose, static_cast<int32_t>(bones.size()));
+    if(inserted) bones.insert(bones.end(), pose->begin(), pose->end());
+    return it->second;
+}
+
+void RenderQueue::batch() {
+    instances.clear();
+    bones.clear();
+    palettes.clear();
+    if(!max_bones) {
+        GLint texels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &texels);
+        max_bones = static_cast<size_t>(std::max(texels, 0))/4;
+    }
+
+    Shader* checked {nullptr};
+    bool instancing {false}, skinned {false};
+    for(size_t i=0; i<items.size(); ) {
+        auto& first = items[i];
+        if(first.shader != checked) {
+            checked = first.shader;
+            instancing = checked->location("instanced") >= 0;
+            skinned = instancing && checked->location("pose_buffer") >= 0;
+        }
+        // the mesh fixes the material; programs reading poses from the bone
+        // buffer take any pose, others only draw a run sharing one
+        auto same_pose = [&](const Item& item) { return item.pose == first.pose || (skinned && item.pose && first.pose); };
+        size_t end = i+1;
+        while(end < items.size() && items[end].shader == first.shader && items[end].mesh == first.mesh &&
+                items[end].lod == first.lod && same_pose(items[end]))
+            end++;
+
+        // a full bone buffer leaves the rest of the frame's skinned runs to plain draws
+        bool fits = !first.pose || bones.size() + (end-i)*MAX_BONES <= max_bones;
+        if(instancing && fits && end-i >= MIN_INSTANCES) {
+            first.instances = static_cast<GLsizei>(end-i);
+            first.first_instance = instances.size();
+            for(size_t j=i; j<end; j++) {
+                auto& model = items[j].transform;
+                instances.push_back({model, glm::transpose(glm::inverse(glm::mat3(model))),
+                    skinned ? palette(items[j].pose) : 0});
+            }
+        }
+        i = end;
+    }
+    if(instances.empty()) return;
+
+    if(!instance_buffer) glGenBuffers(1, &instance_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+    // orphaned each frame so the driver doesn't wait on last frame's draws
+    glBufferData(GL_ARRAY_BUFFER, instances.size()*sizeof(Instance), instances.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if(bones.empty()) return;
+
+    if(!bone_buffer) {
+        glGenBuffers(1, &bone_buffer);
+        glGenTextures(1, &bone_texture);
+        glBindTexture(GL_TEXTURE_BUFFER, bone_texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, bone_buffer);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, bone_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, bones.size()*sizeof(glm::mat4), bones.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    // materials stay below POSE_UNIT, the texture stays bound through the frame
+    glActiveTexture(GL_TEXTURE0 + POSE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, bone_texture);
+}
+
+void RenderQueue::bind_instances(size_t first) {
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+    size_t offset = first*sizeof(Instance);
+    for(GLuint i=0; i<4; i++) {
+        GLuint index = INSTANCE_MODEL_ATTRIBUTE_INDEX + i;
+        glVertexAttribPointer(index, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+            (void*)(offset + offsetof(Instance, model) + i*sizeof(glm::vec4)));
+        glVertexAttribDivisor(index, 1);
+        glEnableVertexAttribArray(index);
+    }
+    for(GLuint i=0; i<3; i++) {
+        GLuint index = INSTANCE_NORMAL_ATTRIBUTE_INDEX + i;
+        glVertexAttribPointer(index, 3, GL_FLOAT, GL_FALSE, sizeof(Instance),
+            (void*)(offset + offsetof(Instance, normal) + i*sizeof(glm::vec3)));
+        glVertexAttribDivisor(index, 1);
+        glEnableVertexAttribArray(index);
+    }
+    glVertexAttribIPointer(INSTANCE_BONES_ATTRIBUTE_INDEX, 1, GL_INT, sizeof(Instance),
+        (void*)(offset + offsetof(Instance, bones)));
+    glVertexAttribDivisor(INSTANCE_BONES_ATTRIBUTE_INDEX, 1);
+    glEnableVertexAttribArray(INSTANCE_BONES_ATTRIBUTE_INDEX);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void RenderQueue::unbind_instances() {
+    // the attributes live in the mesh's vertex array, plain draws of it must not see them
+    for(GLuint i=0; i<4; i++) glDisableVertexAttribArray(INSTANCE_MODEL_ATTRIBUTE_INDEX + i);
+    for(GLuint i=0; i<3; i++) glDisableVertexAttribArray(INSTANCE_NORMAL_ATTRIBUTE_INDEX + i);
+    glDisableVertexAttribArray(INSTANCE_BONES_ATTRIBUTE_INDEX);
+}
+#endif
+
+void RenderQueue::submit(Camera& camera) {
+    stats.items = items.size();
+    std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) { return a.key < b.key; });
+#ifndef __vita__
+    batch();
+#endif
+
+    Shader* program {nullptr};
+    const Material* material {nullptr};
+    Mesh* mesh {nullptr};
+    const glm::mat4* transform {nullptr};
+    const std::vector<glm::mat4>* pose {nullptr};
+    // programs are also used outside the queue, which expects instanced off
+    bool instanced {false};
+    auto set_instanced = [&](bool on) {
+        if(on == instanced) return;
+        instanced = on;
+        program->set(instanced_uniform, on);
+    };
+    for(size_t i=0; i<items.size(); i += items[i].instances) {
+        auto& item = items[i];
+        // per program uniforms have to be sent again to a new program
+        if(item.shader != program) {
+            if(program) set_instanced(false);
+            program = item.shader;
+            program->bind();
+            send_camera(program, camera);
+            material = nullptr;
+            mesh = nullptr;
+            transform = nullptr;
+            pose = nullptr;
+            stats.program_changes++;
+        }
+        if(item.mesh->material != material) {
+            material = item.mesh->material;
+            item.mesh->bind_material(program, item.shading);
+            stats.material_changes++;
+        }
+        set_instanced(item.instances > 1);
+        if(!instanced && (!transform || std::memcmp(transform, &item.transform, sizeof(glm::mat4)) != 0)) {
+            transform = &item.transform;
+            send_transform(program, item.transform);
+            stats.object_changes++;
+        }
+        // instanced skinned draws read their poses from the bone buffer
+        if(!instanced && item.pose && item.pose != pose) {
+            pose = item.pose;
+            program->set(pose_uniform, *pose);
+        }
+        if(item.mesh != mesh) {
+            mesh = item.mesh;
+            mesh->bind(program);
+            stats.mesh_changes++;
+        }
+        stats.draw_calls++;
+#ifndef __vita__
+        if(instanced) {
+            bind_instances(item.first_instance);
+            item.mesh->draw(item.lod, item.instances);
+            unbind_instances();
+            stats.instanced_draws++;
+            stats.instances += item.instances;
+            continue;
+        }
+#endif
+        item.mesh->draw(item.lod);
+    }
+
+    if(program) {
+        set_instanced(false);
+        glBindVertexArray(0);
+        program->unbind();
+    }
+    items.clear();
+    frustum = Frustum{};
+    programs.clear();
+    materials.clear();
+    meshes.clear();
+}
+
+}
+
+}
@@ -1,20 +1,107 @@
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
 #include "obj/renderable.hh"
 
 namespace glp {
 
 namespace Object {
 
+#ifndef __vita__
+// std140 CameraBlock of the builtin shaders
+struct CameraBlock {
+    glm::mat4 vp;
+    glm::vec3 camera_position;
+    float padding;
+};
+static_assert(sizeof(CameraBlock) == 80, "CameraBlock has to match std140");
+
+// the camera and object blocks are shared by every program, so the camera goes
+// out once for all objects drawn from it and each object sends only its matrix
+static UniformBuffer& camera_block() {
+    static UniformBuffer* block = [] {
+        auto block = new UniformBuffer{"CameraBlock", sizeof(CameraBlock)};
+        block->bind();
+        return block;
+    }();
+    return *block;
+}
+
+static UniformBuffer& object_block() {
+    static UniformBuffer* block = [] {
+        auto block = new UniformBuffer{"ObjectBlock", sizeof(glm::mat4)};
+        block->bind();
+        return block;
+    }();
+    return *block;
+}
+
+void send_camera(Shader*, Camera& camera) {
+    static CameraBlock sent {};
+    static bool any_sent = false;
+
+    CameraBlock data {camera.view_projection(), camera.get_position(), 0.0f};
+    if(any_sent && std::memcmp(&data, &sent, sizeof(data)) == 0) return;
+    camera_block().update(&data);
+    sent = data;
+    any_sent = true;
+}
+
+void send_transform(Shader*, const glm::mat4& transform) {
+    object_block().update(&transform);
+}
+#else
+static const struct ObjectUniforms {
+    Uniform<glm::mat4> vp {"vp"};
+    Uniform<glm::mat4> model {"model"};
+    Uniform<glm::vec3> camera_position {"camera_position"};
+} uniforms;
+
+void send_camera(Shader* shader, Camera& camera) {
+    shader->set(uniforms.vp, camera.view_projection());
+    shader->set(uniforms.camera_position, camera.get_position());
+}
+
+void send_transform(Shader* shader, const glm::mat4& transform) {
+    shader->set(uniforms.model, transform);
+}
+#endif
+
+static const Uniform<std::vector<glm::mat4>> pose_uniform {"pose"};
+
+// largest axis scale of a transform, what a bounding radius grows by
+static float max_scale(const glm::mat4& transform) {
+    return std::max({glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])),
+            glm::length(glm::vec3(transform[2]))});
+}
+
+float Renderable::lod_scale(Camera& camera) {
+    float scale = max_scale(transform);
+    glm::vec3 center = transform * glm::vec4(model->get_bounds_center(), 1.0f);
+    float distance = glm::length(center - camera.get_position()) - model->get_bounds_radius()*scale;
+    return camera.pixels_per_unit(distance) * scale;
+}
+
 void Renderable::render(Camera& camera) {
     if(shader) {
         shader->bind();
-        shader->set("vp", camera.view_projection());
-        shader->set("model", transform);
-        shader->set("camera_position", camera.get_position());
-        model->render();
+        send_camera(shader, camera);
+        send_transform(shader, transform);
+        model->render(lod_scale(camera));
         shader->unbind();
     }
 }
 
+void Renderable::submit(RenderQueue& queue, Camera& camera) {
+    if(shader) queue.add(model, transform, lod_scale(camera), camera);
+}
+
+glm::vec4 Renderable::bounding_sphere() {
+    glm::vec3 center = transform * glm::vec4(model->get_bounds_center(), 1.0f);
+    return glm::vec4(center, model->get_bounds_radius()*max_scale(transform));
+}
+
 void Renderable::load(const std::string& path, Shader* shader_, ShadingType shading_type) {
     model = new Model(path, shader_, shading_type);
     shader = shader_;
@@ -49,14 +136,25 @@ void Animated::add_animation(const std::string& anim_path) {
 
 void Animated::render(Camera& camera) {
     shader->bind();
-    shader->set("vp", camera.view_projection());
-    shader->set("model", transform);
-    shader->set("camera_position", camera.get_position());
+    send_camera(shader, camera);
+    send_transform(shader, transform);
     animator.update(*dt);
-    model->render();
+    shader->set(pose_uniform, animator.get_bone_matrices());
+    model->render(lod_scale(camera));
     shader->unbind();
 }
 
+void Animated::submit(RenderQueue& queue, Camera& camera) {
+    animator.update(*dt);
+    queue.add(model, transform, lod_scale(camera), camera, &animator.get_bone_matrices());
+}
+
+glm::vec4 Animated::bounding_sphere() {
+    // culling would also stop submit() from advancing the animation
+    glm::vec3 center = transform * glm::vec4(model->get_bounds_center(), 1.0f);
+    return glm::vec4(center, std::numeric_limits<float>::infinity());
+}
+
 Animated::Animated(const std::string& path, const std::string& anim_path, float* dt_, Shader* shader_, ShadingType shading_type)
     : dt{dt_}, animation_path{anim_path} {
     model = new Model(path, shader_, shading_type);
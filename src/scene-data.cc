@@ -0,0 +1,239 @@
+#include <cstring>
+#include <unordered_map>
+
+#include "utils.hh"
+#include "obj/scene-data.hh"
+
+namespace glp {
+
+namespace Object {
+
+bool SceneData::load(const std::string& path) {
+    util::AssetStream s{path};
+    if(s.empty()) {
+        glp_logv("could not read scene %s", path.c_str());
+        return false;
+    }
+    if(format::is_binary(s.get())) return deserialize_binary(s.get());
+    return deserialize_data(s.get());
+}
+
+static void write_vec3(float* out, const glm::vec3& v) {
+    out[0] = v.x;
+    out[1] = v.y;
+    out[2] = v.z;
+}
+
+static glm::vec3 read_vec3(const float* in) {
+    return glm::vec3(in[0], in[1], in[2]);
+}
+
+static std::ostream& write_text(std::ostream& s, const glm::vec3& v) {
+    return s << v.x << ' ' << v.y << ' ' << v.z << ' ';
+}
+
+static std::istream& read_text(std::istream& s, glm::vec3& v) {
+    return s >> v.x >> v.y >> v.z;
+}
+
+std::stringstream SceneData::serialize_data() const {
+    std::stringstream s;
+    s << "cam " << camera_fov << ' ' << camera_near << ' ' << camera_far << ' ';
+    write_text(s, camera_position);
+    s << "pl " << player_speed << ' ';
+    s << "fog ";
+    write_text(s, fog_color) << fog_near << ' ' << fog_far << ' ';
+    s << "lt " << (light_directional ? "dir" : "pt") << ' ';
+    write_text(s, light_position);
+    write_text(s, light_direction);
+    write_text(s, light_ambient);
+    write_text(s, light_diffuse);
+    write_text(s, light_specular);
+    s << light_linear << ' ' << light_quadratic << ' ';
+    s << "objs " << objects.size() << ' ';
+
+    for(const auto& obj: objects) {
+        s << "obj ";
+        s << (obj.model < 0 ? "null" : models[obj.model]) << ' ';
+        write_text(s, obj.position)
+            << obj.rotation.x << ' '
+            << obj.rotation.y << ' '
+            << obj.rotation.z << ' '
+            << obj.rotation.w << ' ';
+    }
+
+    return s;
+}
+
+bool SceneData::deserialize_data(std::istream& s) {
+    std::string name;
+    size_t count;
+    auto expect = [&](const char* token) {
+        if(s >> name && name == token) return true;
+        glp_logv("scene expected %s, got %s", token, name.c_str());
+        return false;
+    };
+
+    if(!expect("cam")) return false;
+    s >> camera_fov >> camera_near >> camera_far;
+    read_text(s, camera_position);
+    if(!expect("pl")) return false;
+    s >> player_speed;
+    if(!expect("fog")) return false;
+    read_text(s, fog_color) >> fog_near >> fog_far;
+    if(!expect("lt")) return false;
+    s >> name;
+    light_directional = name == "dir";
+    read_text(s, light_position);
+    read_text(s, light_direction);
+    read_text(s, light_ambient);
+    read_text(s, light_diffuse);
+    read_text(s, light_specular);
+    s >> light_linear >> light_quadratic;
+    if(!expect("objs")) return false;
+    s >> count;
+
+    std::unordered_map<std::string, int32_t> indices;
+    for(size_t i=0; i<models.size(); i++) indices.emplace(models[i], i);
+    objects.reserve(objects.size()+count);
+    for(size_t i=0; i<count; i++) {
+        if(!expect("obj")) return false;
+        SceneObjectData obj;
+        s >> name;
+        read_text(s, obj.position) >> obj.rotation.x >> obj.rotation.y >> obj.rotation.z >> obj.rotation.w;
+        if(name == "null") continue;
+        auto it = indices.find(name);
+        if(it == indices.end()) {
+            it = indices.emplace(name, models.size()).first;
+            models.push_back(name);
+        }
+        obj.model = it->second;
+        objects.push_back(obj);
+    }
+    return static_cast<bool>(s);
+}
+
+std::string SceneData::serialize_binary() const {
+    std::vector<format::StringRef> model_table;
+    std::vector<format::SceneObject> object_table;
+    std::string strings;
+
+    for(const auto& path: models) model_table.push_back(format::add_string(strings, path));
+
+    object_table.reserve(objects.size());
+    for(const auto& obj: objects) {
+        format::SceneObject entry {};
+        entry.model = obj.model;
+        entry.shape = obj.shape;
+        entry.mass = obj.mass;
+        write_vec3(entry.position, obj.position);
+        entry.rotation[0] = obj.rotation.x;
+        entry.rotation[1] = obj.rotation.y;
+        entry.rotation[2] = obj.rotation.z;
+        entry.rotation[3] = obj.rotation.w;
+        write_vec3(entry.extents, obj.extents);
+        object_table.push_back(entry);
+    }
+
+    format::SceneHeader header {};
+    std::memcpy(header.magic, format::SCENE_MAGIC, sizeof(header.magic));
+    header.version = format::SCENE_VERSION;
+    header.model_count = model_table.size();
+    header.object_count = object_table.size();
+    header.strings_size = strings.size();
+
+    header.camera_fov = camera_fov;
+    header.camera_near = camera_near;
+    header.camera_far = camera_far;
+    write_vec3(header.camera_position, camera_position);
+    header.player_speed = player_speed;
+
+    write_vec3(header.fog_color, fog_color);
+    header.fog_near = fog_near;
+    header.fog_far = fog_far;
+
+    header.light_type = light_directional ? 0 : 1;
+    write_vec3(header.light_position, light_position);
+    write_vec3(header.light_direction, light_direction);
+    write_vec3(header.light_ambient, light_ambient);
+    write_vec3(header.light_diffuse, light_diffuse);
+    write_vec3(header.light_specular, light_specular);
+    header.light_linear = light_linear;
+    header.light_quadratic = light_quadratic;
+
+    std::string s;
+    format::write(s, header);
+    format::write(s, model_table.data(), model_table.size());
+    format::write(s, object_table.data(), object_table.size());
+    s += strings;
+
+    return s;
+}
+
+bool SceneData::deserialize_binary(std::istream& s) {
+    format::SceneHeader header;
+    if(!format::read(s, header) || !format::check_magic(header.magic, format::SCENE_MAGIC)) {
+        glp_log("scene has no valid binary header");
+        return false;
+    }
+    if(header.version > format::SCENE_VERSION) {
+        glp_logv("unsupported scene version %u", header.version);
+        return false;
+    }
+
+    std::vector<format::StringRef> model_table(header.model_count);
+    std::vector<format::SceneObject> object_table(header.object_count);
+    std::string strings(header.strings_size, '\0');
+    if(!format::read(s, model_table.data(), model_table.size())
+            || !format::read(s, object_table.data(), object_table.size())
+            || !format::read(s, strings.data(), strings.size())) {
+        glp_log("scene tables are truncated");
+        return false;
+    }
+
+    camera_fov = header.camera_fov;
+    camera_near = header.camera_near;
+    camera_far = header.camera_far;
+    camera_position = read_vec3(header.camera_position);
+    player_speed = header.player_speed;
+
+    fog_color = read_vec3(header.fog_color);
+    fog_near = header.fog_near;
+    fog_far = header.fog_far;
+
+    light_directional = header.light_type == 0;
+    light_position = read_vec3(header.light_position);
+    light_direction = read_vec3(header.light_direction);
+    light_ambient = read_vec3(header.light_ambient);
+    light_diffuse = read_vec3(header.light_diffuse);
+    light_specular = read_vec3(header.light_specular);
+    light_linear = header.light_linear;
+    light_quadratic = header.light_quadratic;
+
+    models.clear();
+    models.reserve(model_table.size());
+    for(const auto& ref: model_table) models.push_back(format::get_string(strings, ref));
+
+    objects.clear();
+    objects.reserve(object_table.size());
+    for(const auto& entry: object_table) {
+        if(entry.model < 0) continue;
+        if(static_cast<uint32_t>(entry.model) >= header.model_count) {
+            glp_logv("scene object refers to missing model %d", entry.model);
+            continue;
+        }
+        SceneObjectData obj;
+        obj.model = entry.model;
+        obj.mass = entry.mass;
+        obj.position = read_vec3(entry.position);
+        obj.rotation = glm::quat(entry.rotation[3], entry.rotation[0], entry.rotation[1], entry.rotation[2]);
+        obj.shape = static_cast<format::SceneShape>(entry.shape);
+        obj.extents = read_vec3(entry.extents);
+        objects.push_back(obj);
+    }
+    return true;
+}
+
+}
+
+}
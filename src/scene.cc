@@ -1,10 +1,12 @@
 #include "obj/collidable.hh"
+#include "obj/collision-scene.hh"
 #include "obj/light.hh"
 #include "obj/player.hh"
 #include "obj/renderable.hh"
 #include <obj/scene.hh>
 #include <sstream>
-#include <map>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace glp {
 
@@ -32,14 +34,11 @@ PhysicsScene::PhysicsScene(size_t width, size_t height, std::vector<SDL_Event>*
     world->get_bullet_world()->setDebugDrawer(debug_draw);
 }
 
-PhysicsScene::PhysicsScene(const std::string& path, size_t width, size_t height, std::vector<SDL_Event>* ev, Shader* shader_, ShadingType shading_t) : shader{shader_}, fog{shader_}, light{LightType::DIRECTIONAL, shader_} {
-    auto file = util::read_file(path);
-    auto decompressed = util::decompress(file);
-    std::stringstream s;
-    s << decompressed;
-
+PhysicsScene::PhysicsScene(const std::string& path, size_t width, size_t height, std::vector<SDL_Event>* ev, Shader* shader_, ShadingType shading_t, bool stream) : shader{shader_}, fog{shader_}, light{LightType::DIRECTIONAL, shader_} {
     world = new World{};
-    deserialize_data(s, width, height, ev, shading_t, path);
+    SceneData data;
+    if(data.load(path)) build(data, width, height, ev, shading_t, path, stream);
+    if(!camera) camera = new Camera{glm::vec2(width, height), 60.0f};
     debug_draw = new BulletDebugDraw{};
 }
 
@@ -48,16 +47,52 @@ void PhysicsScene::new_object(CollRenderableModel* object) {
     world->add_collidable(object);
 }
 
+void PhysicsScene::stream_object(const std::string& path, ShadingType shading_t, float mass, const btVector3& position, const btQuaternion& rotation) {
+    if(!loader) loader = new Loader{};
+    auto it = streamed_models.find(path);
+    if(it == streamed_models.end())
+        it = streamed_models.emplace(path, loader->load_model(path, shader, shading_t)).first;
+    pending.push_back(PendingObject{it->second, shading_t, mass, position, rotation});
+}
+
+void PhysicsScene::add_pending_objects() {
+    loader->process_uploads(upload_budget);
+    for(size_t i=0; i<pending.size();) {
+        auto& p = pending[i];
+        if(!is_ready(p.model)) {
+            i++;
+            continue;
+        }
+        if(p.shape) new_object(new CollRenderableModel{p.model.get(), shader, p.shading, p.shape, p.mass, p.position, p.rotation});
+        else new_object(new CollRenderableModel{p.model.get(), shader, p.shading, p.mass, p.position, p.rotation});
+        pending.erase(pending.begin()+i);
+    }
+}
+
 void PhysicsScene::update(float dt) {
+    if(loader) add_pending_objects();
     if(player) {
         player->fpp_movement_keys();
         player->update();
     }
     world->update(dt);
+    // other scenes may have bound their own fog and light since the last frame
+    fog.bind();
+    light.bind();
     world->render(*camera);
 }
 
 PhysicsScene::~PhysicsScene() {
+    // finishes the streamed loads, every pending future is ready after
+    delete loader;
+    // models only pending objects were waiting on have no other owner
+    std::unordered_set<Model*> added, freed;
+    for(auto& obj: objects) added.insert(obj->get_model());
+    for(auto& p: pending) {
+        delete p.shape;
+        Model* model = is_ready(p.model) ? p.model.get() : nullptr;
+        if(model && !added.count(model) && freed.insert(model).second) delete model;
+    }
     delete world;
     delete debug_draw;
     delete player;
@@ -65,122 +100,129 @@ PhysicsScene::~PhysicsScene() {
     for(auto& obj: objects) delete obj;
 }
 
-std::stringstream PhysicsScene::serialize_data() {
-    std::stringstream s;
-    s << "cam " << camera->get_fov() << ' '
-        << camera->get_near() << ' '
-        << camera->get_far() << ' '
-        << camera->get_position().x << ' '
-        << camera->get_position().y << ' '
-        << camera->get_position().z << ' ';
-    if(player) {
-        s << "pl " << player->get_speed() << ' ';
+static void write_shape(SceneObjectData& obj, const btCollisionShape* shape) {
+    if(shape->getShapeType() == SPHERE_SHAPE_PROXYTYPE) {
+        obj.shape = format::SCENE_SHAPE_SPHERE;
+        obj.extents.x = static_cast<const btSphereShape*>(shape)->getRadius();
+        return;
+    }
+    // anything that is not a sphere is stored as its bounding box
+    btVector3 extents;
+    if(shape->getShapeType() == BOX_SHAPE_PROXYTYPE) {
+        extents = static_cast<const btBoxShape*>(shape)->getHalfExtentsWithMargin();
     } else {
-        s << "pl " << 25 << ' ';
+        btTransform t;
+        t.setIdentity();
+        btVector3 min, max;
+        shape->getAabb(t, min, max);
+        extents = (max-min)/2;
     }
-    s << "fog " << fog.get_color().x << ' '
-        << fog.get_color().y << ' '
-        << fog.get_color().z << ' '
-        << fog.get_near() << ' '
-        << fog.get_far() << ' ';
-    s << "lt " << (light.get_type()==LightType::DIRECTIONAL ? "dir" : "pt") << ' ';
-    s << light.get_position().x << ' '
-        << light.get_position().y << ' '
-        << light.get_position().z << ' '
-        << light.get_direction().x << ' '
-        << light.get_direction().y << ' '
-        << light.get_direction().z << ' '
-        << light.get_ambient().x << ' '
-        << light.get_ambient().y << ' '
-        << light.get_ambient().z << ' '
-        << light.get_diffuse().x << ' '
-        << light.get_diffuse().y << ' '
-        << light.get_diffuse().z << ' '
-        << light.get_specular().x << ' '
-        << light.get_specular().y << ' '
-        << light.get_specular().z << ' '
-        << light.get_linear() << ' ' << light.get_quadratic() << ' ';
-    s << "objs " << objects.size() << ' ';
-
-    for(auto& obj : objects) {
-        s << "obj ";
-        s << (obj->get_model()->get_directory().empty() ? "null" : obj->get_model()->get_directory()) << ' ';
-        auto t = obj->get_rigidbody()->getWorldTransform();
+    obj.shape = format::SCENE_SHAPE_BOX;
+    obj.extents = glm::vec3(extents.getX(), extents.getY(), extents.getZ());
+}
+
+SceneData PhysicsScene::get_data() {
+    SceneData data;
+    data.camera_fov = camera->get_fov();
+    data.camera_near = camera->get_near();
+    data.camera_far = camera->get_far();
+    data.camera_position = camera->get_position();
+    if(player) data.player_speed = player->get_speed();
+
+    data.fog_color = fog.get_color();
+    data.fog_near = fog.get_near();
+    data.fog_far = fog.get_far();
+
+    data.light_directional = light.get_type()==LightType::DIRECTIONAL;
+    data.light_position = light.get_position();
+    data.light_direction = light.get_direction();
+    data.light_ambient = light.get_ambient();
+    data.light_diffuse = light.get_diffuse();
+    data.light_specular = light.get_specular();
+    data.light_linear = light.get_linear();
+    data.light_quadratic = light.get_quadratic();
+
+    std::unordered_map<std::string, int32_t> model_indices;
+    data.objects.reserve(objects.size());
+    for(auto& obj: objects) {
+        SceneObjectData entry;
+        const auto& dir = obj->get_model()->get_directory();
+        if(!dir.empty()) {
+            auto it = model_indices.find(dir);
+            if(it == model_indices.end()) {
+                it = model_indices.emplace(dir, data.models.size()).first;
+                data.models.push_back(dir);
+            }
+            entry.model = it->second;
+        }
+        auto rigidbody = obj->get_rigidbody();
+        auto t = rigidbody->getWorldTransform();
         auto pos = t.getOrigin();
         auto rot = t.getRotation();
-        s << pos.getX() << ' '
-            << pos.getY() << ' '
-            << pos.getZ() << ' '
-            << rot.getX() << ' '
-            << rot.getY() << ' '
-            << rot.getZ() << ' '
-            << rot.getW() << ' ';
+        entry.mass = obj->get_mass();
+        entry.position = glm::vec3(pos.getX(), pos.getY(), pos.getZ());
+        entry.rotation = glm::quat(rot.getW(), rot.getX(), rot.getY(), rot.getZ());
+        write_shape(entry, rigidbody->getCollisionShape());
+        data.objects.push_back(entry);
     }
+    return data;
+}
 
-    return s;
+std::stringstream PhysicsScene::serialize_data() {
+    return get_data().serialize_data();
 }
 
-void PhysicsScene::deserialize_data(std::stringstream& s, size_t width, size_t height, std::vector<SDL_Event>* ev, ShadingType shading_t, const std::string& path) {
+std::string PhysicsScene::serialize_binary() {
+    return get_data().serialize_binary();
+}
+
+void PhysicsScene::build(const SceneData& data, size_t width, size_t height, std::vector<SDL_Event>* ev, ShadingType shading_t, const std::string& path, bool stream) {
     auto scene_path = path.substr(0, path.find_last_of('/')) + '/';
     glp_logv("scene path: %s", scene_path.c_str());
-    std::string name;
-    size_t count;
-
-    s >> name; assert(name=="cam");
-    {
-        float posx, posy, posz, fov, near, far;
-        s >> fov >> near >> far >> posx >> posy >> posz;
-        camera = new Camera{glm::vec3(posx, posy, posz), glm::vec2(width, height), fov, near, far};
-    }
-    s >> name; assert(name=="pl");
-    {
-        float spd;
-        s >> spd;
-        player = new PlayerCollFPP{spd, camera, ev};
-        world->add_collidable(player);
-    }
-    s >> name; assert(name=="fog");
-    {
-        float r, g, b, n, f;
-        s >> r >> g >> b >> n >> f;
-        fog.set_color(glm::vec3(r, g, b));
-        fog.set_far(f);
-        fog.set_near(n);
-    }
-    s >> name; assert(name=="lt");
-    {
-        s >> name;
-        light.set_type(name=="dir" ? LightType::DIRECTIONAL : LightType::POINT);
-        float posx, posy, posz, dirx, diry, dirz,
-              ar, ag, ab, dr, dg, db, sr, sg, sb, l, q;
-        s >> posx >> posy >> posz >> dirx >> diry >> dirz
-            >> ar >> ag >> ab >> dr >> dg >> db >> sr >> sg
-            >> sb >> l >> q;
-        light.set_position(glm::vec3(posx, posy, posz));
-        light.set_direction(glm::vec3(dirx, diry, dirz));
-        light.set_ambient(glm::vec3(ar, ag, ab));
-        light.set_diffuse(glm::vec3(dr,dg,db));
-        light.set_specular(glm::vec3(sr,sg,sb));
-        light.set_linear(l);
-        light.set_quadratic(q);
-    }
-    s >> name; assert(name=="objs");
-    s >> count;
-    objects.resize(count);
-    std::map<std::string, Model*> dirs;
-    for(size_t i=0; i<count; i++) {
-        s >> name; assert(name=="obj");
-        s >> name; if(name=="null") continue;
-        Model* mod{nullptr};
-        for(auto& dir: dirs) if(dir.first==name) mod = dir.second;
-        if(!mod) {
-            mod = new Model{scene_path+name, shader, shading_t};
-            dirs.emplace(name, mod);
+
+    camera = new Camera{data.camera_position, glm::vec2(width, height), data.camera_fov, data.camera_near, data.camera_far};
+    player = new PlayerCollFPP{data.player_speed, camera, ev};
+    world->add_collidable(player);
+
+    fog.set_color(data.fog_color);
+    fog.set_far(data.fog_far);
+    fog.set_near(data.fog_near);
+
+    light.set_type(data.light_directional ? LightType::DIRECTIONAL : LightType::POINT);
+    light.set_position(data.light_position);
+    light.set_direction(data.light_direction);
+    light.set_ambient(data.light_ambient);
+    light.set_diffuse(data.light_diffuse);
+    light.set_specular(data.light_specular);
+    light.set_linear(data.light_linear);
+    light.set_quadratic(data.light_quadratic);
+
+    // every model is loaded once up front, objects then only index into the table
+    std::vector<Model*> models(data.models.size(), nullptr);
+    std::vector<std::shared_future<Model*>> streamed(data.models.size());
+    if(stream && !loader) loader = new Loader{};
+    for(size_t i=0; i<data.models.size(); i++) {
+        auto model_path = scene_path + data.models[i];
+        if(stream) {
+            auto it = streamed_models.find(model_path);
+            if(it == streamed_models.end())
+                it = streamed_models.emplace(model_path, loader->load_model(model_path, shader, shading_t)).first;
+            streamed[i] = it->second;
+        } else {
+            models[i] = new Model{model_path, shader, shading_t};
         }
-        float posx, posy, posz, rotx, roty, rotz, rotw;
-        s >> posx >> posy >> posz >> rotx >> roty >> rotz >> rotw;
-        new_object(new CollRenderableModel{mod, shader, shading_t, 0.0f, btVector3(posx,posy,posz), btQuaternion(rotx,roty,rotz,rotw)});
+    }
 
+    if(stream) pending.reserve(pending.size()+data.objects.size());
+    else objects.reserve(objects.size()+data.objects.size());
+    for(const auto& obj: data.objects) {
+        if(obj.model < 0 || static_cast<size_t>(obj.model) >= data.models.size()) continue;
+        btVector3 position {obj.position.x, obj.position.y, obj.position.z};
+        btQuaternion rotation {obj.rotation.x, obj.rotation.y, obj.rotation.z, obj.rotation.w};
+        auto shape = make_shape(obj);
+        if(stream) pending.push_back(PendingObject{streamed[obj.model], shading_t, obj.mass, position, rotation, shape});
+        else if(shape) new_object(new CollRenderableModel{models[obj.model], shader, shading_t, shape, obj.mass, position, rotation});
+        else new_object(new CollRenderableModel{models[obj.model], shader, shading_t, obj.mass, position, rotation});
     }
 }
 
@@ -1,8 +1,138 @@
+#include <mutex>
+
 #include "shader.hh"
 #include "utils.hh"
 
 namespace glp {
 
+struct UniformNames {
+    std::mutex mutex;
+    std::unordered_map<std::string, uint32_t> slots;
+    std::vector<std::string> names {""};
+};
+
+static UniformNames& uniform_names() {
+    static UniformNames names;
+    return names;
+}
+
+uint32_t uniform_slot(const std::string& name) {
+    auto& names = uniform_names();
+    std::lock_guard<std::mutex> lock{names.mutex};
+    auto [it, inserted] = names.slots.try_emplace(name, names.names.size());
+    if(inserted) names.names.push_back(name);
+    return it->second;
+}
+
+struct SharedBindings {
+    std::mutex mutex;
+    std::unordered_map<std::string, GLint> samplers;
+    std::unordered_map<std::string, GLuint> blocks;
+};
+
+static SharedBindings& shared_bindings() {
+    static SharedBindings bindings;
+    return bindings;
+}
+
+void set_sampler_unit(const std::string& name, GLint unit) {
+    auto& bindings = shared_bindings();
+    std::lock_guard<std::mutex> lock{bindings.mutex};
+    bindings.samplers[name] = unit;
+}
+
+#ifndef __vita__
+GLuint uniform_block_binding(const std::string& name) {
+    auto& bindings = shared_bindings();
+    std::lock_guard<std::mutex> lock{bindings.mutex};
+    auto [it, inserted] = bindings.blocks.try_emplace(name, bindings.blocks.size());
+    return it->second;
+}
+
+UniformBuffer::UniformBuffer(const std::string& block, size_t size_) : binding{uniform_block_binding(block)}, size{size_} {
+    glGenBuffers(1, &ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+UniformBuffer::~UniformBuffer() {
+    glDeleteBuffers(1, &ubo);
+}
+
+void UniformBuffer::update(const void* data) {
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferData(GL_UNIFORM_BUFFER, size, data, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+#endif
+
+void Shader::reflect() {
+    locations.clear();
+    slots.clear();
+    GLint count = 0;
+    glGetProgramiv(handle, GL_ACTIVE_UNIFORMS, &count);
+    for(GLint i=0; i<count; i++) {
+        char name[256];
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(handle, i, sizeof(name), nullptr, &size, &type, name);
+        GLint location = glGetUniformLocation(handle, name);
+        std::string s = name;
+        locations[s] = location;
+        // arrays are reported as their first element, reachable by the bare name too
+        if(s.size() > 3 && s.compare(s.size()-3, 3, "[0]") == 0)
+            locations[s.substr(0, s.size()-3)] = location;
+    }
+
+    std::vector<std::pair<GLint, GLint>> units;
+    {
+        auto& bindings = shared_bindings();
+        std::lock_guard<std::mutex> lock{bindings.mutex};
+        for(auto& [name, unit]: bindings.samplers) {
+            auto it = locations.find(name);
+            if(it != locations.end() && it->second >= 0) units.emplace_back(it->second, unit);
+        }
+    }
+    if(!units.empty()) {
+        GLint current = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+        glUseProgram(handle);
+        for(auto [location, unit]: units) glUniform1i(location, unit);
+        glUseProgram(current);
+    }
+
+#ifndef __vita__
+    GLint blocks = 0;
+    glGetProgramiv(handle, GL_ACTIVE_UNIFORM_BLOCKS, &blocks);
+    for(GLint i=0; i<blocks; i++) {
+        char name[256];
+        glGetActiveUniformBlockName(handle, i, sizeof(name), nullptr, name);
+        glUniformBlockBinding(handle, i, uniform_block_binding(name));
+    }
+#endif
+}
+
+GLint Shader::location(const std::string& name) const {
+    auto it = locations.find(name);
+    if(it != locations.end()) return it->second;
+    GLint location = glGetUniformLocation(handle, name.c_str());
+    locations.emplace(name, location);
+    return location;
+}
+
+GLint Shader::resolve(uint32_t slot) const {
+    std::string name;
+    {
+        auto& names = uniform_names();
+        std::lock_guard<std::mutex> lock{names.mutex};
+        if(slots.size() <= slot) slots.resize(names.names.size(), UNRESOLVED);
+        name = names.names[slot];
+    }
+    slots[slot] = slot == 0 ? -1 : location(name);
+    return slots[slot];
+}
+
 GLuint Shader::compile(const GLenum shader, const std::string& code) {
     GLuint s = glCreateShader(shader);
     const char* source = code.c_str();
@@ -22,17 +152,17 @@ GLuint Shader::compile(const GLenum shader, const std::string& code) {
     return s;
 }
 
-bool Shader::link_shaders(GLuint vertex, GLuint fragment) {
-    glAttachShader(handle, vertex);
-    glAttachShader(handle, fragment);
-    glLinkProgram(handle);
+bool Shader::link_shaders(GLuint program, GLuint vertex, GLuint fragment) {
+    glAttachShader(program, vertex);
+    glAttachShader(program, fragment);
+    glLinkProgram(program);
 
     int res = 0;
     bool ret = true;
-    glGetProgramiv(handle, GL_LINK_STATUS, &res);
+    glGetProgramiv(program, GL_LINK_STATUS, &res);
     if(!res) {
         char log[512];
-        glGetProgramInfoLog(handle, 512, NULL, log);
+        glGetProgramInfoLog(program, 512, NULL, log);
         glp_logv("shader linking failed: %s", log);
         ret = false;
     }
@@ -49,17 +179,114 @@ void Shader::make(const std::string& v, const std::string& f) {
     auto frag_s = util::read_file(f);
     auto frag = compile(GL_FRAGMENT_SHADER, frag_s);
 
-    link_shaders(vert, frag);
+    link_shaders(handle, vert, frag);
 }
 
 Shader::Shader(const std::string& vertex, const std::string& fragment, bool path) {
     handle = glCreateProgram();
-    if(path) make(vertex, fragment);
-    else {
+    if(path) {
+        vertex_path = vertex;
+        fragment_path = fragment;
+        make(vertex, fragment);
+    } else {
         auto vert = compile(GL_VERTEX_SHADER, vertex);
         auto frag = compile(GL_FRAGMENT_SHADER, fragment);
-        link_shaders(vert, frag);
+        link_shaders(handle, vert, frag);
+    }
+    reflect();
+}
+
+// floats each element of a uniform type takes, 0 for types that are not carried over
+static GLint uniform_floats(GLenum type) {
+    switch(type) {
+        case GL_FLOAT: return 1;
+        case GL_FLOAT_VEC2: return 2;
+        case GL_FLOAT_VEC3: return 3;
+        case GL_FLOAT_VEC4: return 4;
+        case GL_FLOAT_MAT4: return 16;
+        default: return 0;
+    }
+}
+
+static bool uniform_int(GLenum type) {
+    return type == GL_INT || type == GL_BOOL || type == GL_SAMPLER_2D;
+}
+
+// copies every int, float, vector and mat4 uniform the programs share, element
+// by element for arrays; to has to be bound
+static void copy_uniforms(GLuint from, GLuint to) {
+    GLint count = 0;
+    glGetProgramiv(from, GL_ACTIVE_UNIFORMS, &count);
+    for(GLint i=0; i<count; i++) {
+        char name[256];
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(from, i, sizeof(name), nullptr, &size, &type, name);
+        GLint floats = uniform_floats(type);
+        if(!floats && !uniform_int(type)) continue;
+
+        std::string base = name;
+        if(auto bracket = base.find('['); bracket != std::string::npos) base.resize(bracket);
+        for(GLint element=0; element<size; element++) {
+            auto element_name = size > 1 ? base + '[' + std::to_string(element) + ']' : std::string{name};
+            GLint src = glGetUniformLocation(from, element_name.c_str());
+            GLint dst = glGetUniformLocation(to, element_name.c_str());
+            if(src < 0 || dst < 0) continue;
+            if(!floats) {
+                GLint value;
+                glGetUniformiv(from, src, &value);
+                glUniform1i(dst, value);
+                continue;
+            }
+            GLfloat value[16];
+            glGetUniformfv(from, src, value);
+            switch(type) {
+                case GL_FLOAT: glUniform1fv(dst, 1, value); break;
+                case GL_FLOAT_VEC2: glUniform2fv(dst, 1, value); break;
+                case GL_FLOAT_VEC3: glUniform3fv(dst, 1, value); break;
+                case GL_FLOAT_VEC4: glUniform4fv(dst, 1, value); break;
+                case GL_FLOAT_MAT4: glUniformMatrix4fv(dst, 1, GL_FALSE, value); break;
+            }
+        }
+    }
+}
+
+bool Shader::reload(const std::string& vertex_code, const std::string& fragment_code) {
+    auto vert = compile(GL_VERTEX_SHADER, vertex_code);
+    auto frag = compile(GL_FRAGMENT_SHADER, fragment_code);
+    if(!vert || !frag) {
+        glDeleteShader(vert);
+        glDeleteShader(frag);
+        return false;
+    }
+
+    GLuint program = glCreateProgram();
+    GLint attributes = 0;
+    glGetProgramiv(handle, GL_ACTIVE_ATTRIBUTES, &attributes);
+    for(GLint i=0; i<attributes; i++) {
+        char name[256];
+        GLint size;
+        GLenum type;
+        glGetActiveAttrib(handle, i, sizeof(name), nullptr, &size, &type, name);
+        GLint location = glGetAttribLocation(handle, name);
+        if(location >= 0) glBindAttribLocation(program, location, name);
     }
+    if(!link_shaders(program, vert, frag)) {
+        glDeleteProgram(program);
+        return false;
+    }
+
+    GLint current = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+    glUseProgram(program);
+    copy_uniforms(handle, program);
+    glUseProgram(static_cast<GLuint>(current) == handle ? program : current);
+
+    glDeleteProgram(handle);
+    handle = program;
+    // locations may differ in the new program
+    reflect();
+    return true;
 }
 
 }
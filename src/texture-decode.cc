@@ -0,0 +1,333 @@
+#include <algorithm>
+#include <cstring>
+
+#include "material.hh"
+
+namespace glp {
+
+struct Color {
+    int r, g, b, a;
+};
+
+static inline unsigned char clamp_byte(int v) {
+    return static_cast<unsigned char>(std::clamp(v, 0, 255));
+}
+
+static inline uint64_t load_le(const unsigned char* p, int bytes) {
+    uint64_t v = 0;
+    for(int i=bytes-1; i>=0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static inline uint64_t load_be(const unsigned char* p) {
+    uint64_t v = 0;
+    for(int i=0; i<8; i++) v = (v << 8) | p[i];
+    return v;
+}
+
+static Color unpack_565(uint16_t c) {
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    return Color{(r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2), 255};
+}
+
+// block is 16 rgba pixels row by row
+static void decode_bc1(const unsigned char* in, unsigned char* block, bool color_only) {
+    uint16_t c0 = load_le(in, 2), c1 = load_le(in+2, 2);
+    uint32_t indices = load_le(in+4, 4);
+    Color palette[4] = {unpack_565(c0), unpack_565(c1)};
+    if(c0 > c1 || color_only) {
+        palette[2] = Color{(2*palette[0].r + palette[1].r)/3, (2*palette[0].g + palette[1].g)/3, (2*palette[0].b + palette[1].b)/3, 255};
+        palette[3] = Color{(palette[0].r + 2*palette[1].r)/3, (palette[0].g + 2*palette[1].g)/3, (palette[0].b + 2*palette[1].b)/3, 255};
+    } else {
+        palette[2] = Color{(palette[0].r + palette[1].r)/2, (palette[0].g + palette[1].g)/2, (palette[0].b + palette[1].b)/2, 255};
+        palette[3] = Color{0, 0, 0, 0};
+    }
+    for(int i=0; i<16; i++) {
+        const Color& c = palette[(indices >> (2*i)) & 3];
+        block[i*4+0] = c.r;
+        block[i*4+1] = c.g;
+        block[i*4+2] = c.b;
+        block[i*4+3] = c.a;
+    }
+}
+
+// one interpolated channel (bc4), written to every 4th byte of block
+static void decode_bc4(const unsigned char* in, unsigned char* block) {
+    int a0 = in[0], a1 = in[1];
+    uint64_t indices = load_le(in+2, 6);
+    int palette[8] = {a0, a1};
+    if(a0 > a1) {
+        for(int k=1; k<7; k++) palette[k+1] = ((7-k)*a0 + k*a1 + 3)/7;
+    } else {
+        for(int k=1; k<5; k++) palette[k+1] = ((5-k)*a0 + k*a1 + 2)/5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+    for(int i=0; i<16; i++) block[i*4] = palette[(indices >> (3*i)) & 7];
+}
+
+class BitReader {
+    private:
+        const unsigned char* data;
+        int pos {0};
+
+    public:
+        BitReader(const unsigned char* data_) : data{data_} {}
+
+        int read(int bits) {
+            int v = 0;
+            for(int i=0; i<bits; i++, pos++)
+                v |= ((data[pos >> 3] >> (pos & 7)) & 1) << i;
+            return v;
+        }
+};
+
+static inline int bc7_interpolate(int e0, int e1, int weight) {
+    return ((64-weight)*e0 + weight*e1 + 32) >> 6;
+}
+
+static inline int bc7_expand(int v, int bits) {
+    v <<= 8-bits;
+    return v | (v >> bits);
+}
+
+// single subset modes 4, 5 and 6, the only ones glp-conv writes
+static bool decode_bc7(const unsigned char* in, unsigned char* block) {
+    int mode = 0;
+    while(mode < 8 && !(in[0] & (1 << mode))) mode++;
+    if(mode < 4 || mode == 7) return false;
+
+    BitReader bits {in};
+    bits.read(mode+1);
+    int color[2][4];
+    if(mode == 6) {
+        for(int c=0; c<4; c++) {
+            color[0][c] = bits.read(7);
+            color[1][c] = bits.read(7);
+        }
+        int p0 = bits.read(1), p1 = bits.read(1);
+        for(int c=0; c<4; c++) {
+            color[0][c] = (color[0][c] << 1) | p0;
+            color[1][c] = (color[1][c] << 1) | p1;
+        }
+        int indices[16];
+        for(int i=0; i<16; i++) indices[i] = bits.read(i == 0 ? 3 : 4);
+        for(int i=0; i<16; i++) {
+            for(int c=0; c<4; c++)
+                block[i*4+c] = bc7_interpolate(color[0][c], color[1][c], format::BC7_WEIGHTS4[indices[i]]);
+        }
+        return true;
+    }
+
+    int rotation = bits.read(2);
+    int index_mode = mode == 4 ? bits.read(1) : 0;
+    int color_bits = mode == 4 ? 5 : 7, alpha_bits = mode == 4 ? 6 : 8;
+    for(int c=0; c<3; c++) {
+        color[0][c] = bc7_expand(bits.read(color_bits), color_bits);
+        color[1][c] = bc7_expand(bits.read(color_bits), color_bits);
+    }
+    color[0][3] = bc7_expand(bits.read(alpha_bits), alpha_bits);
+    color[1][3] = bc7_expand(bits.read(alpha_bits), alpha_bits);
+
+    // mode 4 has a 2 and a 3 bit index set, index_mode picks which one is alpha's
+    int primary_bits = 2, secondary_bits = mode == 4 ? 3 : 2;
+    int primary[16], secondary[16];
+    for(int i=0; i<16; i++) primary[i] = bits.read(i == 0 ? primary_bits-1 : primary_bits);
+    for(int i=0; i<16; i++) secondary[i] = bits.read(i == 0 ? secondary_bits-1 : secondary_bits);
+    auto weight = [](int index, int bits) { return bits == 2 ? format::BC7_WEIGHTS2[index] : format::BC7_WEIGHTS3[index]; };
+
+    for(int i=0; i<16; i++) {
+        int color_weight = index_mode ? weight(secondary[i], secondary_bits) : weight(primary[i], primary_bits);
+        int alpha_weight = index_mode ? weight(primary[i], primary_bits) : weight(secondary[i], secondary_bits);
+        int px[4];
+        for(int c=0; c<3; c++) px[c] = bc7_interpolate(color[0][c], color[1][c], color_weight);
+        px[3] = bc7_interpolate(color[0][3], color[1][3], alpha_weight);
+        if(rotation) std::swap(px[3], px[rotation-1]);
+        for(int c=0; c<4; c++) block[i*4+c] = px[c];
+    }
+    return true;
+}
+
+static inline int etc_extend4(int v) { return v | (v << 4); }
+static inline int etc_extend5(int v) { return (v << 3) | (v >> 2); }
+static inline int etc_extend6(int v) { return (v << 2) | (v >> 4); }
+static inline int etc_extend7(int v) { return (v << 1) | (v >> 6); }
+
+static inline int etc_bits(uint64_t v, int high, int low) {
+    return (v >> low) & ((1u << (high-low+1)) - 1);
+}
+
+// 2 bit index of pixel (x, y), indices are stored column by column
+static inline int etc_index(uint64_t v, int x, int y) {
+    int i = x*4 + y;
+    return (((v >> (i+16)) & 1) << 1) | ((v >> i) & 1);
+}
+
+static void etc_write(unsigned char* block, int x, int y, int r, int g, int b) {
+    unsigned char* px = &block[(y*4+x)*4];
+    px[0] = clamp_byte(r);
+    px[1] = clamp_byte(g);
+    px[2] = clamp_byte(b);
+}
+
+// etc2 rgb: etc1 individual and differential blocks plus the t, h and planar
+// modes signalled by overflowing differential colors
+static void decode_etc2(const unsigned char* in, unsigned char* block) {
+    uint64_t v = load_be(in);
+    bool differential = (v >> 33) & 1;
+    bool flip = (v >> 32) & 1;
+    int base[2][3];
+
+    if(!differential) {
+        for(int c=0; c<3; c++) {
+            base[0][c] = etc_extend4(etc_bits(v, 63-8*c, 60-8*c));
+            base[1][c] = etc_extend4(etc_bits(v, 59-8*c, 56-8*c));
+        }
+    } else {
+        int r = etc_bits(v, 63, 59), g = etc_bits(v, 55, 51), b = etc_bits(v, 47, 43);
+        auto delta = [&](int high) { int d = etc_bits(v, high, high-2); return d >= 4 ? d-8 : d; };
+        int r2 = r + delta(58), g2 = g + delta(50), b2 = b + delta(42);
+
+        if(r2 < 0 || r2 > 31) {
+            // t mode: one color and a second with a distance either side of it
+            int c0[3] = {
+                etc_extend4((etc_bits(v, 60, 59) << 2) | etc_bits(v, 57, 56)),
+                etc_extend4(etc_bits(v, 55, 52)),
+                etc_extend4(etc_bits(v, 51, 48))};
+            int c1[3] = {etc_extend4(etc_bits(v, 47, 44)), etc_extend4(etc_bits(v, 43, 40)), etc_extend4(etc_bits(v, 39, 36))};
+            int d = format::ETC_DISTANCES[(etc_bits(v, 35, 34) << 1) | etc_bits(v, 32, 32)];
+            int paint[4][3];
+            for(int c=0; c<3; c++) {
+                paint[0][c] = c0[c];
+                paint[1][c] = c1[c] + d;
+                paint[2][c] = c1[c];
+                paint[3][c] = c1[c] - d;
+            }
+            for(int y=0; y<4; y++) {
+                for(int x=0; x<4; x++) {
+                    const int* p = paint[etc_index(v, x, y)];
+                    etc_write(block, x, y, p[0], p[1], p[2]);
+                }
+            }
+            return;
+        }
+        if(g2 < 0 || g2 > 31) {
+            // h mode: two colors each with a distance either side
+            int c0[3] = {
+                etc_extend4(etc_bits(v, 62, 59)),
+                etc_extend4((etc_bits(v, 58, 56) << 1) | etc_bits(v, 52, 52)),
+                etc_extend4((etc_bits(v, 51, 51) << 3) | etc_bits(v, 49, 47))};
+            int c1[3] = {etc_extend4(etc_bits(v, 46, 43)), etc_extend4(etc_bits(v, 42, 39)), etc_extend4(etc_bits(v, 38, 35))};
+            int order = ((c0[0] << 16) | (c0[1] << 8) | c0[2]) >= ((c1[0] << 16) | (c1[1] << 8) | c1[2]);
+            int d = format::ETC_DISTANCES[(etc_bits(v, 34, 34) << 2) | (etc_bits(v, 32, 32) << 1) | order];
+            int paint[4][3];
+            for(int c=0; c<3; c++) {
+                paint[0][c] = c0[c] + d;
+                paint[1][c] = c0[c] - d;
+                paint[2][c] = c1[c] + d;
+                paint[3][c] = c1[c] - d;
+            }
+            for(int y=0; y<4; y++) {
+                for(int x=0; x<4; x++) {
+                    const int* p = paint[etc_index(v, x, y)];
+                    etc_write(block, x, y, p[0], p[1], p[2]);
+                }
+            }
+            return;
+        }
+        if(b2 < 0 || b2 > 31) {
+            // planar: colors at the origin, right and bottom interpolated over the block
+            int o[3] = {
+                etc_extend6(etc_bits(v, 62, 57)),
+                etc_extend7((etc_bits(v, 56, 56) << 6) | etc_bits(v, 54, 49)),
+                etc_extend6((etc_bits(v, 48, 48) << 5) | (etc_bits(v, 44, 43) << 3) | etc_bits(v, 41, 39))};
+            int h[3] = {
+                etc_extend6((etc_bits(v, 38, 34) << 1) | etc_bits(v, 32, 32)),
+                etc_extend7(etc_bits(v, 31, 25)),
+                etc_extend6(etc_bits(v, 24, 19))};
+            int vc[3] = {etc_extend6(etc_bits(v, 18, 13)), etc_extend7(etc_bits(v, 12, 6)), etc_extend6(etc_bits(v, 5, 0))};
+            for(int y=0; y<4; y++) {
+                for(int x=0; x<4; x++) {
+                    int px[3];
+                    for(int c=0; c<3; c++) px[c] = (x*(h[c]-o[c]) + y*(vc[c]-o[c]) + 4*o[c] + 2) >> 2;
+                    etc_write(block, x, y, px[0], px[1], px[2]);
+                }
+            }
+            return;
+        }
+        int first[3] = {r, g, b}, second[3] = {r2, g2, b2};
+        for(int c=0; c<3; c++) {
+            base[0][c] = etc_extend5(first[c]);
+            base[1][c] = etc_extend5(second[c]);
+        }
+    }
+
+    int tables[2] = {etc_bits(v, 39, 37), etc_bits(v, 36, 34)};
+    for(int y=0; y<4; y++) {
+        for(int x=0; x<4; x++) {
+            int sub = flip ? y >= 2 : x >= 2;
+            int m = format::ETC_MODIFIERS[tables[sub]][etc_index(v, x, y)];
+            etc_write(block, x, y, base[sub][0]+m, base[sub][1]+m, base[sub][2]+m);
+        }
+    }
+}
+
+// eac alpha, written to every 4th byte of block
+static void decode_eac(const unsigned char* in, unsigned char* block) {
+    uint64_t v = load_be(in);
+    int base = etc_bits(v, 63, 56), multiplier = etc_bits(v, 55, 52);
+    const int* modifiers = format::EAC_MODIFIERS[etc_bits(v, 51, 48)];
+    for(int x=0; x<4; x++) {
+        for(int y=0; y<4; y++) {
+            int i = x*4 + y;
+            int index = (v >> (45 - 3*i)) & 7;
+            block[(y*4+x)*4] = clamp_byte(base + modifiers[index]*multiplier);
+        }
+    }
+}
+
+bool decode_blocks(uint32_t format, const unsigned char* data, uint32_t width, uint32_t height, unsigned char* rgba) {
+    uint32_t block_size = format::texture_block_size(format);
+    if(!block_size) return false;
+    unsigned char block[16*4];
+    for(uint32_t by=0; by<(height+3)/4; by++) {
+        for(uint32_t bx=0; bx<(width+3)/4; bx++, data += block_size) {
+            switch(format) {
+                case format::TEXTURE_BC1:
+                    decode_bc1(data, block, false);
+                    break;
+                case format::TEXTURE_BC3:
+                    decode_bc1(data+8, block, true);
+                    decode_bc4(data, block+3);
+                    break;
+                case format::TEXTURE_BC5:
+                    decode_bc4(data, block);
+                    decode_bc4(data+8, block+1);
+                    for(int i=0; i<16; i++) {
+                        block[i*4+2] = 0;
+                        block[i*4+3] = 255;
+                    }
+                    break;
+                case format::TEXTURE_BC7:
+                    if(!decode_bc7(data, block)) return false;
+                    break;
+                case format::TEXTURE_ETC2_RGB:
+                    decode_etc2(data, block);
+                    for(int i=0; i<16; i++) block[i*4+3] = 255;
+                    break;
+                case format::TEXTURE_ETC2_RGBA:
+                    decode_etc2(data+8, block);
+                    decode_eac(data, block+3);
+                    break;
+            }
+            // blocks hanging over the edge are cropped
+            for(uint32_t y=0; y<4 && by*4+y<height; y++) {
+                uint32_t columns = std::min<uint32_t>(4, width-bx*4);
+                std::memcpy(&rgba[((by*4+y)*width + bx*4)*4], &block[y*16], columns*4);
+            }
+        }
+    }
+    return true;
+}
+
+}
@@ -1,19 +1,34 @@
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <cstring>
+#include <map>
+#include <mutex>
 
 #include "utils.hh"
+#include "vfs.hh"
+
+#ifndef __vita__
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
 
 namespace glp {
 
 namespace util {
 
 std::string read_file(const std::string& path) {
+    const char* packed;
+    size_t packed_size;
+    if(vfs::find(path, packed, packed_size)) return std::string(packed, packed_size);
+
     std::ifstream file;
     std::stringstream content;
     file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
     try {
-        file.open(path);
+        file.open(path, std::ios::in | std::ios::binary);
         content << file.rdbuf();
         file.close();
     } catch(std::ifstream::failure& e) {
@@ -22,13 +37,79 @@ std::string read_file(const std::string& path) {
     return content.str();
 }
 
-std::string compress(const std::string& data, int compress_level) {
+struct Dictionary {
+    std::string data;
+    ZSTD_DDict* ddict;
+    std::map<int, ZSTD_CDict*> cdicts;
+};
+
+static std::mutex dict_mutex;
+static std::map<unsigned, Dictionary> dictionaries;
+
+unsigned add_dictionary(const std::string& data) {
+    unsigned id = ZSTD_getDictID_fromDict(data.data(), data.size());
+    if(id == 0) {
+        glp_log("could not add dictionary -- not a trained zstd dictionary");
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock{dict_mutex};
+    if(dictionaries.count(id)) return id;
+    auto& dict = dictionaries[id];
+    dict.data = data;
+    dict.ddict = ZSTD_createDDict(dict.data.data(), dict.data.size());
+    return id;
+}
+
+unsigned load_dictionary(const std::string& path) {
+    return add_dictionary(read_file(path));
+}
+
+static ZSTD_DDict* find_ddict(unsigned id) {
+    std::lock_guard<std::mutex> lock{dict_mutex};
+    auto it = dictionaries.find(id);
+    if(it == dictionaries.end()) {
+        glp_logv("dictionary %u is not loaded", id);
+        return nullptr;
+    }
+    return it->second.ddict;
+}
+
+static ZSTD_CDict* find_cdict(unsigned id, int compress_level) {
+    std::lock_guard<std::mutex> lock{dict_mutex};
+    auto it = dictionaries.find(id);
+    if(it == dictionaries.end()) {
+        glp_logv("dictionary %u is not loaded", id);
+        return nullptr;
+    }
+    auto& dict = it->second;
+    auto cdict = dict.cdicts.find(compress_level);
+    if(cdict != dict.cdicts.end()) return cdict->second;
+    auto created = ZSTD_createCDict(dict.data.data(), dict.data.size(), compress_level);
+    dict.cdicts.emplace(compress_level, created);
+    return created;
+}
+
+std::string compress(const std::string& data, int compress_level, unsigned dict_id) {
+    compress_level = std::clamp(compress_level, 1, ZSTD_maxCLevel());
     size_t est_size = ZSTD_compressBound(data.size());
     std::string compressed{};
 
     compressed.resize(est_size);
-    auto size = ZSTD_compress((void*)compressed.data(),
-            est_size, data.data(), data.size(), compress_level);
+    size_t size;
+    ZSTD_CDict* cdict = dict_id ? find_cdict(dict_id, compress_level) : nullptr;
+    if(cdict) {
+        auto ctx = ZSTD_createCCtx();
+        size = ZSTD_compress_usingCDict(ctx, (void*)compressed.data(),
+                est_size, data.data(), data.size(), cdict);
+        ZSTD_freeCCtx(ctx);
+    } else {
+        size = ZSTD_compress((void*)compressed.data(),
+                est_size, data.data(), data.size(), compress_level);
+    }
+    if(ZSTD_isError(size)) {
+        glp_logv("could not compress data -- %s", ZSTD_getErrorName(size));
+        return {};
+    }
     compressed.resize(size);
     compressed.shrink_to_fit();
 
@@ -36,18 +117,185 @@ std::string compress(const std::string& data, int compress_level) {
 }
 
 std::string decompress(const std::string& data) {
-    auto const est_size = ZSTD_getFrameContentSize(data.data(), data.size());
+    return decompress(data.data(), data.size());
+}
+
+std::string decompress(const char* data, size_t data_size) {
+    auto const est_size = ZSTD_getFrameContentSize(data, data_size);
     std::string decompressed{};
 
+    if(est_size == ZSTD_CONTENTSIZE_ERROR) {
+        glp_log("could not decompress data -- not a zstd frame");
+        return decompressed;
+    }
+
+    if(est_size == ZSTD_CONTENTSIZE_UNKNOWN) {
+        DecompressStreamBuf buf;
+        buf.open(data, data_size);
+        char chunk[16384];
+        std::streamsize n;
+        while((n = buf.sgetn(chunk, sizeof(chunk))) > 0)
+            decompressed.append(chunk, n);
+        return decompressed;
+    }
+
+    ZSTD_DDict* ddict {nullptr};
+    if(unsigned dict_id = ZSTD_getDictID_fromFrame(data, data_size)) {
+        ddict = find_ddict(dict_id);
+        if(!ddict) return decompressed;
+    }
+
+    auto ctx = acquire_dctx();
     decompressed.resize(est_size);
-    size_t const size = ZSTD_decompress((void*)decompressed.data(),
-            est_size, data.data(), data.size());
+    size_t size;
+    if(ddict) {
+        size = ZSTD_decompress_usingDDict(ctx, (void*)decompressed.data(),
+                est_size, data, data_size, ddict);
+    } else {
+        size = ZSTD_decompressDCtx(ctx, (void*)decompressed.data(),
+                est_size, data, data_size);
+    }
+    release_dctx(ctx);
+    if(ZSTD_isError(size)) {
+        glp_logv("could not decompress data -- %s", ZSTD_getErrorName(size));
+        return {};
+    }
     decompressed.resize(size);
-    decompressed.shrink_to_fit();
     
     return decompressed;
 }
 
+static std::mutex dctx_mutex;
+static std::vector<ZSTD_DCtx*> dctx_pool;
+
+ZSTD_DCtx* acquire_dctx() {
+    std::lock_guard<std::mutex> lock{dctx_mutex};
+    if(dctx_pool.empty()) return ZSTD_createDCtx();
+    auto ctx = dctx_pool.back();
+    dctx_pool.pop_back();
+    return ctx;
+}
+
+void release_dctx(ZSTD_DCtx* ctx) {
+    ZSTD_DCtx_reset(ctx, ZSTD_reset_session_and_parameters);
+    std::lock_guard<std::mutex> lock{dctx_mutex};
+    dctx_pool.push_back(ctx);
+}
+
+void DecompressStreamBuf::open(const char* data, size_t size) {
+    if(!ctx) ctx = acquire_dctx();
+    else ZSTD_DCtx_reset(ctx, ZSTD_reset_session_and_parameters);
+    input = {data, size, 0};
+    if(unsigned dict_id = ZSTD_getDictID_fromFrame(data, size))
+        ZSTD_DCtx_refDDict(ctx, find_ddict(dict_id));
+    buffer.resize(ZSTD_DStreamOutSize());
+    setg(buffer.data(), buffer.data(), buffer.data());
+}
+
+DecompressStreamBuf::~DecompressStreamBuf() {
+    if(ctx) release_dctx(ctx);
+}
+
+size_t DecompressStreamBuf::decompress_into(char* dst, size_t size) {
+    if(!ctx) return 0;
+    ZSTD_outBuffer out {dst, size, 0};
+    while(out.pos < out.size) {
+        size_t in_before = input.pos, out_before = out.pos;
+        size_t ret = ZSTD_decompressStream(ctx, &out, &input);
+        if(ZSTD_isError(ret)) {
+            glp_logv("could not decompress stream -- %s", ZSTD_getErrorName(ret));
+            input.pos = input.size;
+            break;
+        }
+        if(input.pos == in_before && out.pos == out_before) break;
+    }
+    return out.pos;
+}
+
+DecompressStreamBuf::int_type DecompressStreamBuf::underflow() {
+    if(gptr() < egptr()) return traits_type::to_int_type(*gptr());
+    size_t n = decompress_into(buffer.data(), buffer.size());
+    if(n == 0) return traits_type::eof();
+    setg(buffer.data(), buffer.data(), buffer.data()+n);
+    return traits_type::to_int_type(*gptr());
+}
+
+std::streamsize DecompressStreamBuf::xsgetn(char* s, std::streamsize n) {
+    std::streamsize done = 0;
+    while(done < n) {
+        std::streamsize buffered = egptr()-gptr();
+        if(buffered > 0) {
+            auto count = std::min(buffered, n-done);
+            std::memcpy(s+done, gptr(), count);
+            gbump(count);
+            done += count;
+            continue;
+        }
+        size_t remaining = n-done;
+        if(remaining >= buffer.size()) {
+            size_t got = decompress_into(s+done, remaining);
+            if(got == 0) break;
+            done += got;
+        } else if(underflow() == traits_type::eof()) break;
+    }
+    return done;
+}
+
+bool is_compressed(const char* data, size_t size) {
+    uint32_t magic;
+    if(size < sizeof(magic)) return false;
+    std::memcpy(&magic, data, sizeof(magic));
+    return magic == ZSTD_MAGICNUMBER;
+}
+
+uint64_t hash(const char* data, size_t size) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for(size_t i=0; i<size; i++) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+MappedFile::MappedFile(const std::string& path) {
+    if(vfs::find(path, view, length)) return;
+#ifndef __vita__
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        glp_logv("could not open file %s", path.c_str());
+        return;
+    }
+    struct stat st;
+    if(fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(m != MAP_FAILED) {
+            map = m;
+            length = st.st_size;
+            madvise(map, length, MADV_SEQUENTIAL);
+        }
+    }
+    close(fd);
+    if(map) return;
+#endif
+    fallback = read_file(path);
+}
+
+MappedFile::~MappedFile() {
+#ifndef __vita__
+    if(map) munmap(map, length);
+#endif
+}
+
+AssetStream::AssetStream(const std::string& path) : file{path} {
+    if(is_compressed(file.data(), file.size())) {
+        zstd.open(file.data(), file.size());
+        stream.rdbuf(&zstd);
+    } else {
+        raw.set(file.data(), file.size());
+        stream.rdbuf(&raw);
+    }
+}
+
 };
 
 }
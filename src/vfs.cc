@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <filesystem>
+#include <mutex>
+
+#include "vfs.hh"
+
+namespace glp {
+
+Pak::Pak(const std::string& path, const std::string& root_) : file{path}, root{vfs::normalize(root_)} {
+    if(file.size() < sizeof(format::PakHeader)) {
+        glp_logv("could not mount %s -- file too small", path.c_str());
+        return;
+    }
+    auto h = reinterpret_cast<const format::PakHeader*>(file.data());
+    if(!format::check_magic(h->magic, format::PAK_MAGIC) || h->version > format::PAK_VERSION) {
+        glp_logv("could not mount %s -- not a supported pak", path.c_str());
+        return;
+    }
+    // 64 bit so a huge entry count can't wrap on 32 bit targets
+    uint64_t tables = sizeof(format::PakHeader) + uint64_t{h->entry_count}*sizeof(format::PakEntry) + h->strings_size;
+    if(tables > file.size() || h->data_offset > file.size()) {
+        glp_logv("could not mount %s -- index is truncated", path.c_str());
+        return;
+    }
+    auto e = reinterpret_cast<const format::PakEntry*>(file.data()+sizeof(format::PakHeader));
+    // find() reads paths straight from the string table, every one has to lie inside it
+    for(uint32_t i=0; i<h->entry_count; i++) {
+        if(uint64_t{e[i].path.offset} + e[i].path.size > h->strings_size) {
+            glp_logv("could not mount %s -- entry %u has a path outside the string table", path.c_str(), i);
+            return;
+        }
+    }
+    header = h;
+    entries = e;
+    strings = reinterpret_cast<const char*>(entries+header->entry_count);
+}
+
+bool Pak::find(const std::string& path, const char*& data, size_t& size) const {
+    if(!is_open()) return false;
+    uint64_t hash = util::hash(path.data(), path.size());
+    auto end = entries+header->entry_count;
+    auto it = std::lower_bound(entries, end, hash,
+            [](const format::PakEntry& e, uint64_t h) { return e.hash < h; });
+    for(; it != end && it->hash == hash; it++) {
+        if(it->path.size != path.size() || path.compare(0, path.size(), strings+it->path.offset, it->path.size) != 0)
+            continue;
+        // data_offset is checked at mount, compared by subtraction so offsets can't wrap
+        uint64_t available = file.size() - header->data_offset;
+        if(it->offset > available || it->size > available - it->offset) return false;
+        data = file.data()+header->data_offset+it->offset;
+        size = it->size;
+        return true;
+    }
+    return false;
+}
+
+namespace vfs {
+
+static std::mutex mounts_mutex;
+static std::vector<std::unique_ptr<Pak>> mounts;
+
+std::string normalize(const std::string& path) {
+    auto normal = std::filesystem::path(path).lexically_normal().generic_string();
+    if(normal == ".") return {};
+    if(!normal.empty() && normal.back() == '/') normal.pop_back();
+    return normal;
+}
+
+bool mount(const std::string& pak_path, const std::string& root) {
+    auto pak = std::make_unique<Pak>(pak_path, root);
+    if(!pak->is_open()) return false;
+    glp_logv("mounted %s with %zu files", pak_path.c_str(), pak->get_entry_count());
+    std::lock_guard<std::mutex> lock{mounts_mutex};
+    mounts.push_back(std::move(pak));
+    return true;
+}
+
+void unmount_all() {
+    std::lock_guard<std::mutex> lock{mounts_mutex};
+    mounts.clear();
+}
+
+bool find(const std::string& path, const char*& data, size_t& size) {
+    std::lock_guard<std::mutex> lock{mounts_mutex};
+    if(mounts.empty()) return false;
+    auto normal = normalize(path);
+    for(auto it = mounts.rbegin(); it != mounts.rend(); it++) {
+        const auto& root = (*it)->get_root();
+        if(root.empty()) {
+            if((*it)->find(normal, data, size)) return true;
+        } else if(normal.size() > root.size() && normal.compare(0, root.size(), root) == 0
+                && normal[root.size()] == '/') {
+            if((*it)->find(normal.substr(root.size()+1), data, size)) return true;
+        }
+    }
+    return false;
+}
+
+}
+
+}
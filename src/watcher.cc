@@ -0,0 +1,246 @@
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+
+#ifdef __linux__
+    #include <poll.h>
+    #include <sys/inotify.h>
+    #include <unistd.h>
+#endif
+
+#include "watcher.hh"
+#include "utils.hh"
+
+namespace glp {
+
+// editors save in several writes and renames, a file reloads once it has been
+// quiet this long
+static constexpr int DEBOUNCE_MS = 100;
+
+static std::string normalize(const std::string& path) {
+    std::error_code ec;
+    auto absolute = std::filesystem::absolute(path, ec);
+    if(ec) return path;
+    return absolute.lexically_normal().string();
+}
+
+AssetWatcher::AssetWatcher() {
+#ifdef __linux__
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(inotify_fd < 0) {
+        glp_log("could not initialize inotify, assets will not reload");
+        return;
+    }
+    thread = std::thread(&AssetWatcher::work, this);
+#else
+    glp_log("asset reloading needs inotify, assets will not reload");
+#endif
+}
+
+AssetWatcher::~AssetWatcher() {
+    stopping = true;
+    if(thread.joinable()) thread.join();
+#ifdef __linux__
+    if(inotify_fd >= 0) close(inotify_fd);
+#endif
+}
+
+void AssetWatcher::add_directory(const std::string& file) {
+#ifdef __linux__
+    if(inotify_fd < 0) return;
+    auto dir = std::filesystem::path(file).parent_path().string();
+    for(auto& [wd, path]: directories)
+        if(path == dir) return;
+    int wd = inotify_add_watch(inotify_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    if(wd < 0) {
+        glp_logv("could not watch %s", dir.c_str());
+        return;
+    }
+    directories[wd] = dir;
+#endif
+}
+
+void AssetWatcher::refresh() {
+    std::lock_guard<std::mutex> lock{mutex};
+    texture_files.clear();
+    for(auto& [handle, watch]: watches) {
+        for(auto& file: watch.files) add_directory(file);
+        if(!watch.textures) continue;
+        for(auto& tex: watch.textures()) {
+            if(tex->path.empty()) continue;
+            auto file = normalize(tex->path);
+            texture_files.insert(file);
+            add_directory(file);
+        }
+    }
+}
+
+void AssetWatcher::add(const void* handle, Watch&& watch) {
+    for(auto& file: watch.files) file = normalize(file);
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        watch.generation = next_generation++;
+        watches[handle] = std::move(watch);
+    }
+    refresh();
+}
+
+void AssetWatcher::watch(Model* model) {
+    std::string path = model->get_path();
+    add(model, Watch{0, {path}, [model, path]() -> std::function<void()> {
+        // decoded without GL, replace() uploads with the watched model's shader
+        auto fresh = std::make_shared<Model>(path, nullptr, ShadingType::PBR, false, false);
+        if(fresh->get_meshes().empty()) {
+            glp_logv("could not reload model %s", path.c_str());
+            return {};
+        }
+        return [model, fresh]{ model->replace(*fresh); };
+    }, [model]{ return model->get_textures(); }});
+}
+
+void AssetWatcher::watch(Texture* tex) {
+    add(tex, Watch{0, {}, {}, [tex]{ return std::vector<Texture*>{tex}; }});
+}
+
+void AssetWatcher::watch(Shader* shader) {
+    std::string vertex = shader->get_vertex_path();
+    std::string fragment = shader->get_fragment_path();
+    if(vertex.empty()) {
+        glp_log("shaders made from code can't be watched");
+        return;
+    }
+    add(shader, Watch{0, {vertex, fragment}, [shader, vertex, fragment]() -> std::function<void()> {
+        auto vertex_code = util::read_file(vertex);
+        auto fragment_code = util::read_file(fragment);
+        return [shader, vertex_code, fragment_code]{
+            if(!shader->reload(vertex_code, fragment_code))
+                glp_log("shader reload failed, keeping the old program");
+        };
+    }, {}});
+}
+
+void AssetWatcher::watch(Animation::Animation* anim, const ModelData* model) {
+    std::string path = anim->get_path();
+    add(anim, Watch{0, {path}, [anim, model, path]() -> std::function<void()> {
+        // parsing looks bones up in the model, which a model reload swaps on the main thread
+        return [anim, model, path]{
+            Animation::Animation fresh{path, *model};
+            if(!fresh.get_root_node()) {
+                glp_logv("could not reload animation %s", path.c_str());
+                return;
+            }
+            anim->swap(fresh);
+        };
+    }, {}});
+}
+
+void AssetWatcher::unwatch(const void* handle) {
+    std::lock_guard<std::mutex> lock{mutex};
+    watches.erase(handle);
+}
+
+Texture* AssetWatcher::find_texture(const std::string& path) {
+    std::lock_guard<std::mutex> lock{mutex};
+    for(auto& [handle, watch]: watches) {
+        if(!watch.textures) continue;
+        for(auto& tex: watch.textures())
+            if(!tex->path.empty() && normalize(tex->path) == path) return tex;
+    }
+    return nullptr;
+}
+
+std::function<void()> AssetWatcher::prepare_texture(const std::string& path) {
+    util::MappedFile file{path};
+    if(!file.size()) return {};
+    uint64_t hash = util::hash(file.data(), file.size());
+    auto fresh = std::make_shared<Texture>(reinterpret_cast<const unsigned char*>(file.data()),
+        static_cast<unsigned int>(file.size()), false);
+    if(!fresh->pixels && fresh->levels.empty()) {
+        glp_logv("could not reload texture %s", path.c_str());
+        return {};
+    }
+    // measured before upload frees the pixels
+    size_t bytes = fresh->size();
+    // textures are shared through the TextureCache, so the one handle found
+    // is what every model using the file draws with
+    return [this, path, fresh, hash, bytes]{
+        Texture* tex = find_texture(path);
+        if(!tex) return;
+        fresh->upload();
+        tex->replace(*fresh);
+        TextureCache::get().update(tex, hash, bytes);
+    };
+}
+
+void AssetWatcher::reload(const std::string& path) {
+    std::vector<Pending> jobs;
+    std::vector<std::function<std::function<void()>()>> prepares;
+    bool texture = false;
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        for(auto& [handle, watch]: watches) {
+            if(std::find(watch.files.begin(), watch.files.end(), path) == watch.files.end()) continue;
+            jobs.push_back({handle, watch.generation, {}});
+            prepares.push_back(watch.prepare);
+        }
+        texture = texture_files.count(path);
+    }
+
+    for(size_t i=0; i<jobs.size(); i++) jobs[i].apply = prepares[i]();
+    if(texture) jobs.push_back({nullptr, 0, prepare_texture(path)});
+
+    std::lock_guard<std::mutex> lock{pending_mutex};
+    for(auto& job: jobs)
+        if(job.apply) pending.push_back(std::move(job));
+}
+
+void AssetWatcher::work() {
+#ifdef __linux__
+    std::set<std::string> changed;
+    alignas(inotify_event) char buffer[4096];
+    while(!stopping) {
+        pollfd fd {inotify_fd, POLLIN, 0};
+        if(poll(&fd, 1, DEBOUNCE_MS) > 0) {
+            ssize_t len = read(inotify_fd, buffer, sizeof(buffer));
+            std::lock_guard<std::mutex> lock{mutex};
+            for(ssize_t i=0; i<len; ) {
+                auto event = reinterpret_cast<const inotify_event*>(&buffer[i]);
+                i += sizeof(inotify_event) + event->len;
+                auto dir = directories.find(event->wd);
+                if(!event->len || dir == directories.end()) continue;
+                changed.insert((std::filesystem::path(dir->second) / event->name).string());
+            }
+            continue;
+        }
+
+        // nothing happened for DEBOUNCE_MS, everything written so far is complete
+        for(auto& path: changed) reload(path);
+        changed.clear();
+    }
+#endif
+}
+
+size_t AssetWatcher::process() {
+    std::deque<Pending> ready;
+    {
+        std::lock_guard<std::mutex> lock{pending_mutex};
+        ready.swap(pending);
+    }
+
+    size_t count = 0;
+    for(auto& job: ready) {
+        if(job.handle) {
+            std::lock_guard<std::mutex> lock{mutex};
+            auto it = watches.find(job.handle);
+            // unwatched since, possibly deleted
+            if(it == watches.end() || it->second.generation != job.generation) continue;
+        }
+        job.apply();
+        count++;
+    }
+    // model reloads can bring new textures
+    if(count) refresh();
+    return count;
+}
+
+}
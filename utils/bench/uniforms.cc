@@ -0,0 +1,169 @@
+// Per draw cost of setting a mesh's uniforms three ways: the glGetUniformLocation
+// per set the shaders used to do, Shader::set by name through the table reflected
+// at link, and Uniform<T> handles. GL is stubbed through the glad function
+// pointers so no context is needed; the stub looks names up with a linear
+// strcmp where a driver hashes, which makes the first path a lower bound.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "shader.hh"
+
+using namespace glp;
+
+// active uniforms of the fake program, roughly what the builtin phong shader has
+static const char* uniform_names[] = {
+    "vp", "model", "camera_position", "position_scale", "position_offset",
+    "material.ambient", "material.diffuse", "material.specular", "material.shininess",
+    "material.diffuse_tex_exists", "material.normal_tex_exists", "material.specular_tex_exists",
+    "light.position", "light.direction", "light.ambient", "light.diffuse", "light.specular",
+    "fog.color", "fog.near", "fog.far", "diffuse_tex", "normal_tex", "specular_tex",
+};
+static constexpr GLint UNIFORM_COUNT = sizeof(uniform_names)/sizeof(uniform_names[0]);
+
+// written by the uniform stubs so the calls have an effect
+static volatile float sink;
+
+static GLuint stub_create_program() { return 1; }
+static GLuint stub_create_shader(GLenum) { return 1; }
+static void stub_shader_source(GLuint, GLsizei, const GLchar* const*, const GLint*) {}
+static void stub_shader(GLuint) {}
+static void stub_attach(GLuint, GLuint) {}
+static void stub_use(GLuint) {}
+static void stub_get_shaderiv(GLuint, GLenum, GLint* out) { *out = 1; }
+static void stub_get_integerv(GLenum, GLint* out) { *out = 0; }
+
+static void stub_get_programiv(GLuint, GLenum what, GLint* out) {
+    switch(what) {
+        case GL_ACTIVE_UNIFORMS: *out = UNIFORM_COUNT; break;
+        case GL_ACTIVE_UNIFORM_BLOCKS: *out = 0; break;
+        default: *out = 1;
+    }
+}
+
+static void stub_get_active_uniform(GLuint, GLuint index, GLsizei size, GLsizei*, GLint* count, GLenum* type, GLchar* name) {
+    std::snprintf(name, size, "%s", uniform_names[index]);
+    *count = 1;
+    *type = GL_FLOAT;
+}
+
+static GLint stub_get_uniform_location(GLuint, const GLchar* name) {
+    for(GLint i=0; i<UNIFORM_COUNT; i++)
+        if(!std::strcmp(name, uniform_names[i])) return i;
+    return -1;
+}
+
+static void stub_uniform1i(GLint location, GLint value) { sink = location + value; }
+static void stub_uniform1f(GLint location, GLfloat value) { sink = location + value; }
+static void stub_uniformfv(GLint location, GLsizei, const GLfloat* value) { sink = location + value[0]; }
+static void stub_uniform_matrix(GLint location, GLsizei, GLboolean, const GLfloat* value) { sink = location + value[0]; }
+
+static void stub_gl() {
+    glad_glCreateProgram = stub_create_program;
+    glad_glCreateShader = stub_create_shader;
+    glad_glShaderSource = stub_shader_source;
+    glad_glCompileShader = stub_shader;
+    glad_glDeleteShader = stub_shader;
+    glad_glDeleteProgram = stub_shader;
+    glad_glLinkProgram = stub_shader;
+    glad_glAttachShader = stub_attach;
+    glad_glUseProgram = stub_use;
+    glad_glGetShaderiv = stub_get_shaderiv;
+    glad_glGetProgramiv = stub_get_programiv;
+    glad_glGetIntegerv = stub_get_integerv;
+    glad_glGetActiveUniform = stub_get_active_uniform;
+    glad_glGetUniformLocation = stub_get_uniform_location;
+    glad_glUniform1i = stub_uniform1i;
+    glad_glUniform1f = stub_uniform1f;
+    glad_glUniform3fv = stub_uniformfv;
+    glad_glUniformMatrix4fv = stub_uniform_matrix;
+}
+
+struct DrawState {
+    glm::mat4 model {1.0f};
+    glm::vec3 position_scale {1.0f};
+    glm::vec3 position_offset {0.0f};
+    glm::vec3 ambient {0.1f}, diffuse {0.8f}, specular {0.5f};
+    float shininess {32.0f};
+};
+
+// what Shader::set did before locations were cached, a lookup by string per call
+static void draw_lookup(GLuint program, const DrawState& s) {
+    auto set3 = [program](const std::string& name, const glm::vec3& v) { glUniform3fv(glGetUniformLocation(program, name.c_str()), 1, &v[0]); };
+    auto set1i = [program](const std::string& name, int v) { glUniform1i(glGetUniformLocation(program, name.c_str()), v); };
+    glUniformMatrix4fv(glGetUniformLocation(program, std::string{"model"}.c_str()), 1, GL_FALSE, &s.model[0][0]);
+    set3("position_scale", s.position_scale);
+    set3("position_offset", s.position_offset);
+    set3("material.ambient", s.ambient);
+    set3("material.diffuse", s.diffuse);
+    set3("material.specular", s.specular);
+    glUniform1f(glGetUniformLocation(program, std::string{"material.shininess"}.c_str()), s.shininess);
+    set1i("material.diffuse_tex_exists", 1);
+    set1i("material.normal_tex_exists", 0);
+}
+
+static void draw_by_name(const Shader& shader, const DrawState& s) {
+    shader.set("model", s.model);
+    shader.set("position_scale", s.position_scale);
+    shader.set("position_offset", s.position_offset);
+    shader.set("material.ambient", s.ambient);
+    shader.set("material.diffuse", s.diffuse);
+    shader.set("material.specular", s.specular);
+    shader.set("material.shininess", s.shininess);
+    shader.set("material.diffuse_tex_exists", 1);
+    shader.set("material.normal_tex_exists", 0);
+}
+
+static const struct {
+    Uniform<glm::mat4> model {"model"};
+    Uniform<glm::vec3> position_scale {"position_scale"};
+    Uniform<glm::vec3> position_offset {"position_offset"};
+    Uniform<glm::vec3> ambient {"material.ambient"};
+    Uniform<glm::vec3> diffuse {"material.diffuse"};
+    Uniform<glm::vec3> specular {"material.specular"};
+    Uniform<float> shininess {"material.shininess"};
+    Uniform<int> diffuse_tex_exists {"material.diffuse_tex_exists"};
+    Uniform<int> normal_tex_exists {"material.normal_tex_exists"};
+} handles;
+
+static void draw_handles(const Shader& shader, const DrawState& s) {
+    shader.set(handles.model, s.model);
+    shader.set(handles.position_scale, s.position_scale);
+    shader.set(handles.position_offset, s.position_offset);
+    shader.set(handles.ambient, s.ambient);
+    shader.set(handles.diffuse, s.diffuse);
+    shader.set(handles.specular, s.specular);
+    shader.set(handles.shininess, s.shininess);
+    shader.set(handles.diffuse_tex_exists, 1);
+    shader.set(handles.normal_tex_exists, 0);
+}
+
+template<typename F>
+static double ns_per_draw(size_t draws, F draw) {
+    // the first round resolves lazily cached locations
+    draw();
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i=0; i<draws; i++) draw();
+    std::chrono::duration<double, std::nano> spent = std::chrono::steady_clock::now() - start;
+    return spent.count()/draws;
+}
+
+int main(int argc, char* argv[]) {
+    size_t draws = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    if(!draws) draws = 1;
+    stub_gl();
+    Shader shader {"", "", false};
+    DrawState state;
+
+    double lookup = ns_per_draw(draws, [&]{ draw_lookup(shader.get(), state); });
+    double by_name = ns_per_draw(draws, [&]{ draw_by_name(shader, state); });
+    double by_handle = ns_per_draw(draws, [&]{ draw_handles(shader, state); });
+
+    std::printf("%zu draws of 9 uniforms, stubbed GL\n", draws);
+    std::printf("glGetUniformLocation per set  %8.1f ns/draw\n", lookup);
+    std::printf("Shader::set by name           %8.1f ns/draw\n", by_name);
+    std::printf("Uniform<T> handles            %8.1f ns/draw\n", by_handle);
+    return 0;
+}
@@ -0,0 +1,487 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "format.hh"
+#include "blocks.hh"
+
+struct Vec4 {
+    float v[4] {};
+
+    float& operator[](int i) { return v[i]; }
+    float operator[](int i) const { return v[i]; }
+};
+
+static inline int clamp_byte(int v) {
+    return std::clamp(v, 0, 255);
+}
+
+static inline int square(int v) {
+    return v*v;
+}
+
+static void store_le(unsigned char* out, uint64_t v, int bytes) {
+    for(int i=0; i<bytes; i++) out[i] = (v >> (8*i)) & 0xff;
+}
+
+static void store_be(unsigned char* out, uint64_t v) {
+    for(int i=0; i<8; i++) out[i] = (v >> (56-8*i)) & 0xff;
+}
+
+// principal axis of the first channels of the block's pixels through their mean,
+// found by power iteration on the covariance
+static void principal_axis(const unsigned char* block, int channels, Vec4& mean, Vec4& axis) {
+    for(int i=0; i<16; i++)
+        for(int c=0; c<channels; c++) mean[c] += block[i*4+c]/16.0f;
+    float cov[4][4] {};
+    for(int i=0; i<16; i++) {
+        float d[4];
+        for(int c=0; c<channels; c++) d[c] = block[i*4+c]-mean[c];
+        for(int a=0; a<channels; a++)
+            for(int b=0; b<channels; b++) cov[a][b] += d[a]*d[b];
+    }
+    for(int c=0; c<channels; c++) axis[c] = 1.0f;
+    for(int iter=0; iter<8; iter++) {
+        Vec4 next;
+        float length = 0.0f;
+        for(int a=0; a<channels; a++) {
+            for(int b=0; b<channels; b++) next[a] += cov[a][b]*axis[b];
+            length = std::max(length, std::abs(next[a]));
+        }
+        if(length < 1e-6f) break;
+        for(int c=0; c<channels; c++) axis[c] = next[c]/length;
+    }
+}
+
+// ends of the pixels' projection onto the axis
+static void fit_endpoints(const unsigned char* block, int channels, Vec4& e0, Vec4& e1) {
+    Vec4 mean, axis;
+    principal_axis(block, channels, mean, axis);
+    float length = 0.0f;
+    for(int c=0; c<channels; c++) length += axis[c]*axis[c];
+    float lo = 0.0f, hi = 0.0f;
+    if(length > 1e-6f) {
+        lo = std::numeric_limits<float>::max();
+        hi = std::numeric_limits<float>::lowest();
+        for(int i=0; i<16; i++) {
+            float t = 0.0f;
+            for(int c=0; c<channels; c++) t += (block[i*4+c]-mean[c])*axis[c];
+            lo = std::min(lo, t/length);
+            hi = std::max(hi, t/length);
+        }
+    }
+    for(int c=0; c<channels; c++) {
+        e0[c] = std::clamp(mean[c] + axis[c]*lo, 0.0f, 255.0f);
+        e1[c] = std::clamp(mean[c] + axis[c]*hi, 0.0f, 255.0f);
+    }
+}
+
+// endpoints minimizing the squared error for fixed interpolation weights t of each pixel
+static bool least_squares(const unsigned char* block, int channels, const float* t, Vec4& e0, Vec4& e1) {
+    float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+    Vec4 ax, bx;
+    for(int i=0; i<16; i++) {
+        float a = 1.0f-t[i], b = t[i];
+        aa += a*a;
+        bb += b*b;
+        ab += a*b;
+        for(int c=0; c<channels; c++) {
+            ax[c] += a*block[i*4+c];
+            bx[c] += b*block[i*4+c];
+        }
+    }
+    float det = aa*bb - ab*ab;
+    if(std::abs(det) < 1e-6f) return false;
+    for(int c=0; c<channels; c++) {
+        e0[c] = std::clamp((ax[c]*bb - bx[c]*ab)/det, 0.0f, 255.0f);
+        e1[c] = std::clamp((bx[c]*aa - ax[c]*ab)/det, 0.0f, 255.0f);
+    }
+    return true;
+}
+
+static uint16_t pack_565(const Vec4& c) {
+    int r = std::lround(c[0]*31/255.0f), g = std::lround(c[1]*63/255.0f), b = std::lround(c[2]*31/255.0f);
+    return (r << 11) | (g << 5) | b;
+}
+
+static void unpack_565(uint16_t c, int* out) {
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    out[0] = (r << 3) | (r >> 2);
+    out[1] = (g << 2) | (g >> 4);
+    out[2] = (b << 3) | (b >> 2);
+}
+
+// four color bc1 block for endpoints c0, c1, returns the squared error
+static int bc1_indices(const unsigned char* block, uint16_t c0, uint16_t c1, uint32_t& indices) {
+    int palette[4][3];
+    unpack_565(c0, palette[0]);
+    unpack_565(c1, palette[1]);
+    for(int c=0; c<3; c++) {
+        palette[2][c] = (2*palette[0][c] + palette[1][c])/3;
+        palette[3][c] = (palette[0][c] + 2*palette[1][c])/3;
+    }
+    int total = 0;
+    indices = 0;
+    for(int i=0; i<16; i++) {
+        int best = 0, best_error = std::numeric_limits<int>::max();
+        for(int p=0; p<4; p++) {
+            int error = 0;
+            for(int c=0; c<3; c++) error += square(block[i*4+c]-palette[p][c]);
+            if(error < best_error) {
+                best = p;
+                best_error = error;
+            }
+        }
+        indices |= best << (2*i);
+        total += best_error;
+    }
+    return total;
+}
+
+// always in four color mode, which needs c0 > c1; equal endpoints only use index 0
+static void encode_bc1(const unsigned char* block, unsigned char* out) {
+    static const float weights[4] = {0.0f, 1.0f, 1.0f/3, 2.0f/3};
+    Vec4 e0, e1;
+    fit_endpoints(block, 3, e0, e1);
+    uint16_t c0 = pack_565(e1), c1 = pack_565(e0);
+    uint32_t indices;
+    int error = bc1_indices(block, c0, c1, indices);
+
+    float t[16];
+    for(int i=0; i<16; i++) t[i] = weights[(indices >> (2*i)) & 3];
+    if(least_squares(block, 3, t, e0, e1)) {
+        uint16_t r0 = pack_565(e0), r1 = pack_565(e1);
+        uint32_t refined_indices;
+        if(bc1_indices(block, r0, r1, refined_indices) < error) {
+            c0 = r0;
+            c1 = r1;
+            indices = refined_indices;
+        }
+    }
+
+    if(c0 < c1) {
+        std::swap(c0, c1);
+        // 0 <-> 1 and 2 <-> 3
+        indices ^= 0x55555555;
+    } else if(c0 == c1) {
+        indices = 0;
+    }
+    store_le(out, c0, 2);
+    store_le(out+2, c1, 2);
+    store_le(out+4, indices, 4);
+}
+
+// one channel in eight value mode, read from every 4th byte of block
+static void encode_bc4(const unsigned char* block, unsigned char* out) {
+    int lo = 255, hi = 0;
+    for(int i=0; i<16; i++) {
+        lo = std::min<int>(lo, block[i*4]);
+        hi = std::max<int>(hi, block[i*4]);
+    }
+    int palette[8] = {hi, lo};
+    for(int k=1; k<7; k++) palette[k+1] = ((7-k)*hi + k*lo + 3)/7;
+    uint64_t indices = 0;
+    if(hi != lo) {
+        for(int i=0; i<16; i++) {
+            int best = 0;
+            for(int p=1; p<8; p++)
+                if(std::abs(block[i*4]-palette[p]) < std::abs(block[i*4]-palette[best])) best = p;
+            indices |= static_cast<uint64_t>(best) << (3*i);
+        }
+    }
+    out[0] = hi;
+    out[1] = lo;
+    store_le(out+2, indices, 6);
+}
+
+class BitWriter {
+    private:
+        unsigned char* data;
+        int pos {0};
+
+    public:
+        BitWriter(unsigned char* data_) : data{data_} { std::fill(data, data+16, 0); }
+
+        void write(int v, int bits) {
+            for(int i=0; i<bits; i++, pos++)
+                data[pos >> 3] |= ((v >> i) & 1) << (pos & 7);
+        }
+};
+
+// 7 bit endpoint with a shared lsb for every channel
+struct Bc7Endpoint {
+    int q[4];
+    int p;
+
+    int value(int c) const { return (q[c] << 1) | p; }
+};
+
+static Bc7Endpoint bc7_quantize(const Vec4& e, int p) {
+    Bc7Endpoint endpoint {};
+    endpoint.p = p;
+    for(int c=0; c<4; c++) endpoint.q[c] = std::clamp(static_cast<int>(std::lround((e[c]-p)/2.0f)), 0, 127);
+    return endpoint;
+}
+
+static int bc7_indices(const unsigned char* block, const Bc7Endpoint& e0, const Bc7Endpoint& e1, int* indices) {
+    int palette[16][4];
+    for(int k=0; k<16; k++) {
+        int w = glp::format::BC7_WEIGHTS4[k];
+        for(int c=0; c<4; c++) palette[k][c] = ((64-w)*e0.value(c) + w*e1.value(c) + 32) >> 6;
+    }
+    int total = 0;
+    for(int i=0; i<16; i++) {
+        int best = 0, best_error = std::numeric_limits<int>::max();
+        for(int k=0; k<16; k++) {
+            int error = 0;
+            for(int c=0; c<4; c++) error += square(block[i*4+c]-palette[k][c]);
+            if(error < best_error) {
+                best = k;
+                best_error = error;
+            }
+        }
+        indices[i] = best;
+        total += best_error;
+    }
+    return total;
+}
+
+// quantizes both endpoints with the pair of shared lsbs that fits best; blocks of a
+// single alpha, opaque ones above all, keep it exact
+static int bc7_fit(const unsigned char* block, const Vec4& f0, const Vec4& f1, Bc7Endpoint& e0, Bc7Endpoint& e1, int* indices) {
+    bool flat_alpha = true;
+    for(int i=1; i<16; i++) flat_alpha = flat_alpha && block[i*4+3] == block[3];
+    int best_error = std::numeric_limits<int>::max();
+    for(int p=0; p<4; p++) {
+        if(flat_alpha && p != (block[3] & 1)*3) continue;
+        Bc7Endpoint q0 = bc7_quantize(f0, p & 1), q1 = bc7_quantize(f1, p >> 1);
+        int candidate[16];
+        int error = bc7_indices(block, q0, q1, candidate);
+        if(error < best_error) {
+            best_error = error;
+            e0 = q0;
+            e1 = q1;
+            std::copy(candidate, candidate+16, indices);
+        }
+    }
+    return best_error;
+}
+
+// mode 6 only: one rgba subset with 4 bit indices, good for smooth color and alpha
+static void encode_bc7(const unsigned char* block, unsigned char* out) {
+    Vec4 f0, f1;
+    fit_endpoints(block, 4, f0, f1);
+    Bc7Endpoint e0, e1;
+    int indices[16];
+    int error = bc7_fit(block, f0, f1, e0, e1, indices);
+
+    float t[16];
+    for(int i=0; i<16; i++) t[i] = glp::format::BC7_WEIGHTS4[indices[i]]/64.0f;
+    if(least_squares(block, 4, t, f0, f1)) {
+        Bc7Endpoint r0, r1;
+        int refined[16];
+        if(bc7_fit(block, f0, f1, r0, r1, refined) < error) {
+            e0 = r0;
+            e1 = r1;
+            std::copy(refined, refined+16, indices);
+        }
+    }
+
+    // the first index drops its msb, so it has to be in the lower half
+    if(indices[0] >= 8) {
+        std::swap(e0, e1);
+        for(int i=0; i<16; i++) indices[i] = 15-indices[i];
+    }
+
+    BitWriter bits {out};
+    bits.write(1 << 6, 7);
+    for(int c=0; c<4; c++) {
+        bits.write(e0.q[c], 7);
+        bits.write(e1.q[c], 7);
+    }
+    bits.write(e0.p, 1);
+    bits.write(e1.p, 1);
+    for(int i=0; i<16; i++) bits.write(indices[i], i == 0 ? 3 : 4);
+}
+
+// best modifier table of an etc subblock around base, the pixels' indices are
+// stored column by column into indices
+static int etc_subblock(const unsigned char* block, const int* base, bool flip, int sub, int& table, uint32_t& indices) {
+    int best_total = std::numeric_limits<int>::max();
+    for(int t=0; t<8; t++) {
+        int total = 0;
+        uint32_t table_indices = 0;
+        for(int y=0; y<4; y++) {
+            for(int x=0; x<4; x++) {
+                if((flip ? y >= 2 : x >= 2) != static_cast<bool>(sub)) continue;
+                const unsigned char* px = &block[(y*4+x)*4];
+                int best = 0, best_error = std::numeric_limits<int>::max();
+                for(int k=0; k<4; k++) {
+                    int m = glp::format::ETC_MODIFIERS[t][k], error = 0;
+                    for(int c=0; c<3; c++) error += square(px[c]-clamp_byte(base[c]+m));
+                    if(error < best_error) {
+                        best = k;
+                        best_error = error;
+                    }
+                }
+                int i = x*4 + y;
+                table_indices |= ((best >> 1) << (i+16)) | ((best & 1) << i);
+                total += best_error;
+            }
+        }
+        if(total < best_total) {
+            best_total = total;
+            table = t;
+            indices = table_indices;
+        }
+    }
+    return best_total;
+}
+
+// etc1 individual and differential blocks, which every etc2 decoder reads as they are
+static void encode_etc2(const unsigned char* block, unsigned char* out) {
+    int best_error = std::numeric_limits<int>::max();
+    uint64_t best = 0;
+    for(int flip=0; flip<2; flip++) {
+        float average[2][3] {};
+        for(int y=0; y<4; y++)
+            for(int x=0; x<4; x++)
+                for(int c=0; c<3; c++) average[flip ? y >= 2 : x >= 2][c] += block[(y*4+x)*4+c]/8.0f;
+
+        for(int differential=0; differential<2; differential++) {
+            int q[2][3], base[2][3];
+            bool valid = true;
+            for(int s=0; s<2; s++) {
+                for(int c=0; c<3; c++) {
+                    if(differential) {
+                        q[s][c] = std::lround(average[s][c]*31/255.0f);
+                        base[s][c] = (q[s][c] << 3) | (q[s][c] >> 2);
+                    } else {
+                        q[s][c] = std::lround(average[s][c]*15/255.0f);
+                        base[s][c] = q[s][c]*17;
+                    }
+                }
+            }
+            if(differential)
+                for(int c=0; c<3; c++) valid = valid && q[1][c]-q[0][c] >= -4 && q[1][c]-q[0][c] <= 3;
+            if(!valid) continue;
+
+            int tables[2];
+            uint32_t indices[2];
+            int error = etc_subblock(block, base[0], flip, 0, tables[0], indices[0])
+                + etc_subblock(block, base[1], flip, 1, tables[1], indices[1]);
+            if(error >= best_error) continue;
+            best_error = error;
+
+            uint64_t v = 0;
+            for(int c=0; c<3; c++) {
+                if(differential) {
+                    v |= static_cast<uint64_t>(q[0][c]) << (59-8*c);
+                    v |= static_cast<uint64_t>((q[1][c]-q[0][c]) & 7) << (56-8*c);
+                } else {
+                    v |= static_cast<uint64_t>(q[0][c]) << (60-8*c);
+                    v |= static_cast<uint64_t>(q[1][c]) << (56-8*c);
+                }
+            }
+            v |= static_cast<uint64_t>(tables[0]) << 37;
+            v |= static_cast<uint64_t>(tables[1]) << 34;
+            v |= static_cast<uint64_t>(differential) << 33;
+            v |= static_cast<uint64_t>(flip) << 32;
+            v |= indices[0] | indices[1];
+            best = v;
+        }
+    }
+    store_be(out, best);
+}
+
+// eac alpha, read from every 4th byte of block; the multiplier is searched
+// around the one spanning the block's range with each table
+static void encode_eac(const unsigned char* block, unsigned char* out) {
+    int lo = 255, hi = 0;
+    for(int i=0; i<16; i++) {
+        lo = std::min<int>(lo, block[i*4]);
+        hi = std::max<int>(hi, block[i*4]);
+    }
+    uint64_t best = static_cast<uint64_t>(lo) << 56;
+    if(lo != hi) {
+        int best_error = std::numeric_limits<int>::max();
+        for(int t=0; t<16; t++) {
+            const int* modifiers = glp::format::EAC_MODIFIERS[t];
+            int low = *std::min_element(modifiers, modifiers+8), high = *std::max_element(modifiers, modifiers+8);
+            int span = std::lround(float(hi-lo)/(high-low));
+            for(int multiplier=std::max(1, span-1); multiplier<=std::min(15, span+1); multiplier++) {
+                int bases[2] = {clamp_byte(lo - low*multiplier), clamp_byte(std::lround((lo+hi)/2.0f - (low+high)*multiplier/2.0f))};
+                for(int base: bases) {
+                    int error = 0;
+                    uint64_t indices = 0;
+                    for(int x=0; x<4; x++) {
+                        for(int y=0; y<4; y++) {
+                            int a = block[(y*4+x)*4];
+                            int index = 0, index_error = std::numeric_limits<int>::max();
+                            for(int k=0; k<8; k++) {
+                                int e = square(a-clamp_byte(base + modifiers[k]*multiplier));
+                                if(e < index_error) {
+                                    index = k;
+                                    index_error = e;
+                                }
+                            }
+                            indices |= static_cast<uint64_t>(index) << (45 - 3*(x*4+y));
+                            error += index_error;
+                        }
+                    }
+                    if(error < best_error) {
+                        best_error = error;
+                        best = (static_cast<uint64_t>(base) << 56) | (static_cast<uint64_t>(multiplier) << 52)
+                            | (static_cast<uint64_t>(t) << 48) | indices;
+                    }
+                }
+            }
+        }
+    }
+    store_be(out, best);
+}
+
+std::string encode_blocks(uint32_t format, const unsigned char* rgba, int width, int height) {
+    uint32_t block_size = glp::format::texture_block_size(format);
+    std::string out;
+    if(!block_size) return out;
+    int columns = (width+3)/4, rows = (height+3)/4;
+    out.resize(static_cast<size_t>(columns)*rows*block_size);
+    auto data = reinterpret_cast<unsigned char*>(out.data());
+
+    unsigned char block[16*4];
+    for(int by=0; by<rows; by++) {
+        for(int bx=0; bx<columns; bx++, data += block_size) {
+            for(int y=0; y<4; y++) {
+                for(int x=0; x<4; x++) {
+                    int sx = std::min(bx*4+x, width-1), sy = std::min(by*4+y, height-1);
+                    std::copy_n(&rgba[(static_cast<size_t>(sy)*width + sx)*4], 4, &block[(y*4+x)*4]);
+                }
+            }
+            switch(format) {
+                case glp::format::TEXTURE_BC1:
+                    encode_bc1(block, data);
+                    break;
+                case glp::format::TEXTURE_BC3:
+                    encode_bc4(block+3, data);
+                    encode_bc1(block, data+8);
+                    break;
+                case glp::format::TEXTURE_BC5:
+                    encode_bc4(block, data);
+                    encode_bc4(block+1, data+8);
+                    break;
+                case glp::format::TEXTURE_BC7:
+                    encode_bc7(block, data);
+                    break;
+                case glp::format::TEXTURE_ETC2_RGB:
+                    encode_etc2(block, data);
+                    break;
+                case glp::format::TEXTURE_ETC2_RGBA:
+                    encode_eac(block+3, data);
+                    encode_etc2(block, data+8);
+                    break;
+            }
+        }
+    }
+    return out;
+}
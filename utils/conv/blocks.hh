@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// encodes a level of tightly packed rgba8 pixels into rows of 4x4 blocks of a
+// block compressed format::TextureFormat, edge blocks repeat the last row and column
+std::string encode_blocks(uint32_t format, const unsigned char* rgba, int width, int height);
@@ -1,37 +1,539 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <filesystem>
 #include <fstream>
+#include <mutex>
+#include <set>
 #include <sstream>
 #include <string>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <zdict.h>
+#include "format.hh"
 #include "utils.hh"
+#include "vfs.hh"
 #include "model.hh"
-#include "shader.hh"
-#include "sdl.hh"
 #include "anim.hh"
-#include <obj/builtin-shaders.hh>
+#include "optimize.hh"
+#include "texture.hh"
 
-int main(int argc, char* argv[]) {
+constexpr size_t DICTIONARY_SIZE = 112640;
+constexpr size_t DEFAULT_LODS = 3;
+constexpr float DEFAULT_LOD_ERROR = 0.005f;
+// a lod has to drop at least this much of the previous level's triangles
+constexpr float MIN_LOD_REDUCTION = 0.2f;
+// written to the batch output directory, holds the content hash of every output's inputs
+constexpr const char* BATCH_CACHE = ".glp-conv-cache";
+
+enum class Kind {
+    ANIM = 0,
+    MODEL = 1,
+    // diffuse maps and other color, mips are filtered in linear space
+    COLOR_TEXTURE = 2,
+    // roughness and other data, filtered as stored
+    DATA_TEXTURE = 3,
+    // tangent space normals, the only textures -c bc5 stores in two channels
+    NORMAL_TEXTURE = 4,
+};
+
+static bool valid_kind(int kind) {
+    return kind >= static_cast<int>(Kind::ANIM) && kind <= static_cast<int>(Kind::NORMAL_TEXTURE);
+}
+
+struct Options {
+    bool text = false;
+    bool raw = false;
+    bool optimized = true;
+    bool overdraw = false;
+    bool compact = false;
+    bool quantize_position = false;
+    bool weights16 = false;
+    size_t lods = DEFAULT_LODS;
+    float lod_error = DEFAULT_LOD_ERROR;
+    float anim_tolerance = 0.0f;
+    bool textures = false;
+    size_t max_texture_size = 0;
+    MipFilter mip_filter = MipFilter::BOX;
+    TextureCompression compression = TextureCompression::NONE;
+    int level = glp::util::DEFAULT_COMPRESS_LEVEL;
+    unsigned dict = 0;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // everything that changes the output, hashed along with the input
+    std::string fingerprint() const {
+        std::stringstream s;
+        s << text << raw << optimized << overdraw << compact << quantize_position << weights16
+            << ' ' << lods << ' ' << lod_error << ' ' << anim_tolerance << ' ' << level << ' ' << dict
+            << ' ' << textures << ' ' << max_texture_size << ' ' << static_cast<int>(mip_filter)
+            << ' ' << static_cast<int>(compression);
+        return s.str();
+    }
+};
+
+static bool parse_compression(const char* name, TextureCompression& compression) {
+    static const std::pair<const char*, TextureCompression> names[] = {
+        {"bc", TextureCompression::BC},
+        {"bc5", TextureCompression::BC5},
+        {"bc7", TextureCompression::BC7},
+        {"etc2", TextureCompression::ETC2},
+    };
+    for(const auto& [key, value]: names) {
+        if(!strcmp(name, key)) {
+            compression = value;
+            return true;
+        }
+    }
+    return false;
+}
 
-    if(argc != 4) {
-        fprintf(stderr, "usage: %s [1 - model; 0 - anim] [model path] [output file]", argv[0]);
+static const char* format_name(uint32_t format) {
+    static const char* names[] = {"rgb8", "rgba8", "bc1", "bc3", "bc5", "bc7", "etc2 rgb", "etc2 rgba"};
+    return format < std::size(names) ? names[format] : "unknown";
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "usage: %s [options] [1 - model; 0 - anim; 2 - color texture; 3 - data texture; 4 - normal map] [path] [output file]\n"
+            "       %s [options] [-j threads] batch [source directory or manifest] [output directory]\n"
+            "       %s train [asset directory] [dictionary output]\n"
+            "       %s pack [asset directory] [pak output]\n"
+            "options: [-t] [-r] [-n] [-o] [-q] [-p] [-w] [-x] [-k] [-s size] [-c bc|bc5|bc7|etc2] [-L lods] [-e error] [-a tolerance] [-l level] [-d dictionary]\n"
+            "  -t  write the legacy text formats instead of binary .model and .anim\n"
+            "  -r  write uncompressed so the file is read in place from a memory map\n"
+            "  -n  keep authoring order instead of optimizing meshes for the vertex cache\n"
+            "  -o  also reorder triangles to reduce overdraw, may cost a little cache efficiency\n"
+            "  -q  compact vertices: 10-10-10-2 normals, half float uvs, uint8 joints and unorm8 weights\n"
+            "  -p  unorm16 positions with a per mesh dequantization, shaders apply position_scale/offset\n"
+            "  -w  unorm16 weights with -q\n"
+            "  -L  number of simplified lods to generate (default %zu)\n"
+            "  -e  error budget of the first lod relative to the model radius, doubled each level (default %g)\n"
+            "  -a  compress animations: drop keys within tolerance of a joint position and pack the rest\n"
+            "  -x  convert a model's textures to .tex next to the output and refer to those\n"
+            "  -k  filter mips with a kaiser windowed sinc instead of a box\n"
+            "  -s  scale textures down so their largest side is at most size\n"
+            "  -c  block compress textures: bc for bc1/bc3, bc5 for bc with two channel bc5 normal maps, bc7 or etc2\n"
+            "  -l  zstd compression level (default %d)\n"
+            "  -d  compress with a dictionary made by train, the game has to load it too\n"
+            "  -j  batch worker threads (default one per core)\n"
+            "batch converts every file assimp can import in the directory to a .model, or each\n"
+            "\"[kind] [source] [output]\" line of a manifest, and skips outputs whose source and\n"
+            "options are unchanged since the last batch\n",
+            name, name, name, name, DEFAULT_LODS, DEFAULT_LOD_ERROR, glp::util::DEFAULT_COMPRESS_LEVEL);
+}
+
+// batch jobs run concurrently, so each one collects its report and prints it whole
+static void report(std::string& log, const char* fmt, ...) {
+    char buf[512];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    log += buf;
+}
+
+static int train(const std::string& dir, const std::string& output) {
+    std::string samples;
+    std::vector<size_t> sizes;
+    for(const auto& entry: std::filesystem::recursive_directory_iterator(dir)) {
+        auto ext = entry.path().extension();
+        if(!entry.is_regular_file() || (ext != ".model" && ext != ".anim" && ext != ".scene")) continue;
+        auto file = glp::util::read_file(entry.path().string());
+        if(glp::util::is_compressed(file.data(), file.size()))
+            file = glp::util::decompress(file);
+        samples += file;
+        sizes.push_back(file.size());
+    }
+
+    std::string dict(DICTIONARY_SIZE, '\0');
+    size_t size = ZDICT_trainFromBuffer(dict.data(), dict.size(), samples.data(), sizes.data(), sizes.size());
+    if(ZDICT_isError(size)) {
+        fprintf(stderr, "could not train dictionary over %zu assets: %s\n", sizes.size(), ZDICT_getErrorName(size));
         return 1;
     }
+    dict.resize(size);
+
+    std::fstream out(output, std::ios::out | std::ios::trunc | std::ios::binary);
+    out << dict;
+    printf("trained dictionary %u (%zu bytes) over %zu assets\n", ZDICT_getDictID(dict.data(), dict.size()), dict.size(), sizes.size());
+    return 0;
+}
+
+static void optimize(glp::ModelData& model, bool overdraw, std::string& log) {
+    size_t triangles = 0;
+    float acmr_before = 0.0f, acmr_after = 0.0f, atvr_before = 0.0f, atvr_after = 0.0f;
+    auto meshes = model.get_meshes();
+    for(size_t i=0; i<meshes.size(); i++) {
+        auto& vertices = meshes[i]->vertices;
+        auto& indices = meshes[i]->indices;
+        auto before = analyze_vertex_cache(indices, vertices.size());
+        optimize_vertex_cache(indices, vertices.size());
+        if(overdraw) optimize_overdraw(indices, vertices);
+        optimize_vertex_fetch(vertices, indices);
+        auto after = analyze_vertex_cache(indices, vertices.size());
+        report(log, "mesh %zu: %zu triangles, acmr %.3f -> %.3f, atvr %.3f -> %.3f\n",
+                i, indices.size()/3, before.acmr, after.acmr, before.atvr, after.atvr);
+
+        // totals are weighted by triangle count
+        size_t n = indices.size()/3;
+        triangles += n;
+        acmr_before += before.acmr*n;
+        acmr_after += after.acmr*n;
+        atvr_before += before.atvr*n;
+        atvr_after += after.atvr*n;
+    }
+    if(triangles)
+        report(log, "total: %zu triangles, acmr %.3f -> %.3f, atvr %.3f -> %.3f\n", triangles,
+                acmr_before/triangles, acmr_after/triangles, atvr_before/triangles, atvr_after/triangles);
+}
 
-    glp::Window sdl {"glp-util", 1, 1};
-    auto [sh, sh_t] = glp::Object::make_static_phong();
+static void generate_lods(glp::ModelData& model, size_t levels, float error, bool optimized, std::string& log) {
+    auto meshes = model.get_meshes();
+    for(size_t i=0; i<meshes.size(); i++) {
+        auto mesh = meshes[i];
+        mesh->lods.clear();
+        mesh->lod_indices.clear();
+        size_t previous = mesh->indices.size();
+        for(size_t level=1; level<=levels; level++) {
+            float budget = error * model.get_bounds_radius() * (1 << (level-1));
+            float lod_error;
+            // every level starts from the full mesh so errors don't compound
+            auto idxs = simplify(mesh->indices, mesh->vertices, mesh->indices.size() >> level, budget, lod_error);
+            if(idxs.empty() || idxs.size() > previous*(1.0f-MIN_LOD_REDUCTION)) break;
+            if(optimized) optimize_vertex_cache(idxs, mesh->vertices.size());
+            mesh->lods.push_back(glp::MeshLod{mesh->lod_indices.size(), idxs.size(), lod_error});
+            mesh->lod_indices.insert(mesh->lod_indices.end(), idxs.begin(), idxs.end());
+            report(log, "mesh %zu lod %zu: %zu -> %zu triangles, error %g\n",
+                    i, level, mesh->indices.size()/3, idxs.size()/3, lod_error);
+            previous = idxs.size();
+        }
+    }
+}
+
+static void select_layout(glp::ModelData& model, bool compact, bool quantize_position, bool weights16, std::string& log) {
+    size_t before = 0, after = 0;
+    for(auto mesh: model.get_meshes()) {
+        mesh->layout = glp::VertexLayout::select(mesh->vertices, compact, quantize_position);
+        if(compact && weights16) mesh->layout.flags |= glp::format::VERTEX_WEIGHTS16;
+        before += mesh->vertices.size()*sizeof(glp::Vertex);
+        after += mesh->vertices.size()*mesh->layout.stride();
+    }
+    report(log, "vertex data: %zu -> %zu bytes\n", before, after);
+}
+
+static void compress(glp::Animation::Animation& anim, const glp::Animation::Animation& original, float tolerance, std::string& log) {
+    size_t keys = count_keys(anim.get_root_node());
+    size_t size = anim.serialize_binary().size();
+    size_t compressed_keys = compress_animation(anim, tolerance);
+    size_t compressed_size = anim.serialize_binary().size();
+    report(log, "animation: %zu -> %zu keys, %zu -> %zu bytes (%.2fx), max joint error %g\n",
+            keys, compressed_keys, size, compressed_size, compressed_size ? float(size)/compressed_size : 0.0f,
+            animation_error(original, anim));
+}
+
+// written to a temporary that replaces the output, batch jobs sharing a texture
+// may write it at the same time
+static bool write_output(const std::string& data, const std::filesystem::path& output, const Options& opt, std::string& log) {
+    auto temp = output;
+    temp += ".tmp" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    {
+        std::fstream out(temp, std::ios::out | std::ios::trunc | std::ios::binary);
+        out << (opt.raw ? data : glp::util::compress(data, opt.level, opt.dict));
+        if(!out) {
+            report(log, "could not write %s\n", output.string().c_str());
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temp, output, error);
+    if(error) {
+        report(log, "could not write %s: %s\n", output.string().c_str(), error.message().c_str());
+        std::filesystem::remove(temp, error);
+        return false;
+    }
+    return true;
+}
+
+static std::string convert_texture(const glp::Texture& tex, const std::string& name, TextureRole role, const Options& opt, std::string& log) {
+    auto data = build_texture(tex.pixels, tex.width, tex.height, tex.component, role,
+            opt.mip_filter, opt.max_texture_size, opt.compression);
+    glp::format::TextureHeader header;
+    std::memcpy(&header, data.data(), sizeof(header));
+    report(log, "texture %s: %dx%d -> %ux%u %s, %u levels, %zu bytes%s\n", name.c_str(), tex.width, tex.height,
+            header.width, header.height, format_name(header.format), header.level_count,
+            data.size()-header.data_offset, role == TextureRole::COLOR ? ", srgb" : role == TextureRole::NORMAL ? ", normal map" : "");
+    return data;
+}
 
-    if(atoi(argv[1])) {
-        auto model = glp::Model(argv[2], sh, sh_t);
-        std::fstream output(argv[3], std::ios::out | std::ios::trunc);
-        std::stringstream data = model.serialize_data();
-        auto compressed = glp::util::compress(data.str(), 90);
-        output << compressed;
+// every decoded texture of the model becomes a .tex in out_dir, diffuse maps are
+// color, normal maps normal and everything else data
+static bool convert_textures(glp::ModelData& model, const std::filesystem::path& out_dir, const Options& opt, std::string& log) {
+    std::set<const glp::Texture*> color, normal;
+    for(auto mesh: model.get_meshes()) {
+        auto mat = mesh->material;
+        if(!mat) continue;
+        if(mat->diffuse_id >= 0 && static_cast<size_t>(mat->diffuse_id) < mat->textures.size())
+            color.insert(mat->textures[mat->diffuse_id]);
+        if(mat->normal_id >= 0 && static_cast<size_t>(mat->normal_id) < mat->textures.size())
+            normal.insert(mat->textures[mat->normal_id]);
+    }
+    for(auto tex: model.get_textures()) {
+        // containers are already converted
+        if(!tex->pixels) continue;
+        auto name = std::filesystem::path(model.get_texture_name(tex)).replace_extension(".tex").string();
+        auto role = color.count(tex) ? TextureRole::COLOR : normal.count(tex) ? TextureRole::NORMAL : TextureRole::DATA;
+        auto data = convert_texture(*tex, name, role, opt, log);
+        if(!write_output(data, out_dir / name, opt, log)) return false;
+        model.rename_texture(tex, name);
+    }
+    return true;
+}
+
+// ModelData never touches GL, so no context is needed
+static bool convert(Kind kind, const std::string& input, const std::string& output, const Options& opt, std::string& log) {
+    std::string data;
+    if(kind == Kind::COLOR_TEXTURE || kind == Kind::DATA_TEXTURE || kind == Kind::NORMAL_TEXTURE) {
+        glp::Texture tex {input, false};
+        if(!tex.pixels) {
+            report(log, "%s is not an image\n", input.c_str());
+            return false;
+        }
+        auto role = kind == Kind::COLOR_TEXTURE ? TextureRole::COLOR
+            : kind == Kind::NORMAL_TEXTURE ? TextureRole::NORMAL : TextureRole::DATA;
+        data = convert_texture(tex, input, role, opt, log);
+        return write_output(data, output, opt, log);
+    }
+
+    glp::ModelData model {input};
+    if(kind == Kind::MODEL) {
+        if(model.get_meshes().empty()) {
+            report(log, "%s has no meshes\n", input.c_str());
+            return false;
+        }
+        if(size_t split = model.split_meshes())
+            report(log, "split %zu meshes to fit 16 bit indices\n", split);
+        if(opt.optimized) optimize(model, opt.overdraw, log);
+        // lods and vertex layouts are only stored in the binary format
+        if(!opt.text) {
+            generate_lods(model, opt.lods, opt.lod_error, opt.optimized, log);
+            select_layout(model, opt.compact, opt.quantize_position, opt.weights16, log);
+        }
+        if(opt.textures && !convert_textures(model, std::filesystem::path(output).parent_path(), opt, log))
+            return false;
+        data = opt.text ? model.serialize_data().str() : model.serialize_binary();
+    } else {
+        auto anim = glp::Animation::Animation(input, model);
+        if(!anim.get_root_node()) {
+            report(log, "%s has no animation\n", input.c_str());
+            return false;
+        }
+        if(opt.anim_tolerance > 0.0f) compress(anim, glp::Animation::Animation(input, model), opt.anim_tolerance, log);
+        data = opt.text ? anim.serialize_data().str() : anim.serialize_binary();
+    }
+    return write_output(data, output, opt, log);
+}
+
+static int batch(const std::string& source, const std::string& out_dir, const Options& opt) {
+    struct Job {
+        Kind kind;
+        std::filesystem::path input;
+        std::filesystem::path output;
+        uint64_t hash;
+        bool ok;
+    };
+    std::vector<Job> jobs;
+    if(std::filesystem::is_directory(source)) {
+        Assimp::Importer importer;
+        for(const auto& entry: std::filesystem::recursive_directory_iterator(source)) {
+            if(!entry.is_regular_file() || !importer.IsExtensionSupported(entry.path().extension().string())) continue;
+            auto output = std::filesystem::path(out_dir) / std::filesystem::relative(entry.path(), source);
+            jobs.push_back(Job{Kind::MODEL, entry.path(), output.replace_extension(".model"), 0, false});
+        }
     } else {
-        auto model = glp::Model(argv[2], sh, sh_t);
-        auto anim = glp::Animation::Animation(argv[2], model);
-        std::fstream output(argv[3], std::ios::out | std::ios::trunc);
-        std::stringstream data = anim.serialize_data();
-        auto compressed = glp::util::compress(data.str(), 90);
-        output << compressed;
+        std::ifstream manifest(source);
+        if(!manifest) {
+            fprintf(stderr, "could not open %s\n", source.c_str());
+            return 1;
+        }
+        auto base = std::filesystem::path(source).parent_path();
+        int kind;
+        std::string input, output;
+        while(manifest >> kind >> input >> output) {
+            if(!valid_kind(kind)) {
+                fprintf(stderr, "unknown kind %d for %s\n", kind, input.c_str());
+                continue;
+            }
+            jobs.push_back(Job{static_cast<Kind>(kind), base / input, std::filesystem::path(out_dir) / output, 0, false});
+        }
     }
 
+    // outputs are up to date when the hash of their source and options is the cached one
+    auto cache_path = std::filesystem::path(out_dir) / BATCH_CACHE;
+    std::unordered_map<std::string, uint64_t> cache;
+    {
+        std::ifstream s(cache_path);
+        uint64_t hash;
+        std::string output;
+        while(s >> std::hex >> hash >> output) cache[output] = hash;
+    }
+    auto fingerprint = opt.fingerprint();
+    for(auto& job: jobs) {
+        if(!std::filesystem::is_regular_file(job.input)) continue;
+        auto content = glp::util::read_file(job.input.string()) + fingerprint;
+        job.hash = glp::util::hash(content.data(), content.size());
+    }
+
+    std::atomic<size_t> next {0}, converted {0}, skipped {0}, failed {0};
+    std::mutex print_mutex;
+    auto start = std::chrono::steady_clock::now();
+    auto work = [&] {
+        for(size_t i; (i = next++) < jobs.size();) {
+            auto& job = jobs[i];
+            auto cached = cache.find(job.output.string());
+            if(cached != cache.end() && cached->second == job.hash && std::filesystem::exists(job.output)) {
+                job.ok = true;
+                skipped++;
+                continue;
+            }
+            std::string log;
+            auto job_start = std::chrono::steady_clock::now();
+            if(!std::filesystem::is_regular_file(job.input)) {
+                report(log, "%s does not exist\n", job.input.string().c_str());
+            } else {
+                std::filesystem::create_directories(job.output.parent_path());
+                job.ok = convert(job.kind, job.input.string(), job.output.string(), opt, log);
+            }
+            std::chrono::duration<float, std::milli> ms = std::chrono::steady_clock::now()-job_start;
+            (job.ok ? converted : failed)++;
+
+            std::lock_guard<std::mutex> lock{print_mutex};
+            printf("%s %s -> %s in %.1f ms\n%s", job.ok ? "converted" : "failed",
+                    job.input.string().c_str(), job.output.string().c_str(), ms.count(), log.c_str());
+        }
+    };
+    std::vector<std::thread> workers;
+    for(size_t i=1; i<std::min(opt.threads, jobs.size()); i++) workers.emplace_back(work);
+    work();
+    for(auto& worker: workers) worker.join();
+    std::chrono::duration<float, std::milli> ms = std::chrono::steady_clock::now()-start;
+
+    // failed outputs are left out so the next batch retries them
+    std::filesystem::create_directories(out_dir);
+    std::fstream s(cache_path, std::ios::out | std::ios::trunc);
+    for(const auto& job: jobs)
+        if(job.ok) s << std::hex << job.hash << ' ' << job.output.string() << '\n';
+
+    printf("batch: %zu converted, %zu up to date, %zu failed in %.1f ms\n",
+            converted.load(), skipped.load(), failed.load(), ms.count());
+    return failed ? 1 : 0;
+}
+
+static int pack(const std::string& dir, const std::string& output) {
+    struct File {
+        std::filesystem::path source;
+        std::string path;
+        uint64_t size;
+    };
+    std::vector<File> files;
+    for(const auto& entry: std::filesystem::recursive_directory_iterator(dir)) {
+        if(!entry.is_regular_file()) continue;
+        auto path = glp::vfs::normalize(std::filesystem::relative(entry.path(), dir).string());
+        files.push_back(File{entry.path(), path, entry.file_size()});
+    }
+
+    std::vector<glp::format::PakEntry> entries;
+    std::string strings;
+    uint64_t offset = 0;
+    for(const auto& file: files) {
+        offset = (offset+glp::format::BLOB_ALIGNMENT-1)/glp::format::BLOB_ALIGNMENT*glp::format::BLOB_ALIGNMENT;
+        glp::format::PakEntry entry {};
+        entry.hash = glp::util::hash(file.path.data(), file.path.size());
+        entry.path = glp::format::add_string(strings, file.path);
+        entry.offset = offset;
+        entry.size = file.size;
+        entries.push_back(entry);
+        offset += file.size;
+    }
+    // file data stays in directory order, only the index is sorted
+    std::vector<glp::format::PakEntry> index = entries;
+    std::sort(index.begin(), index.end(), [](const auto& a, const auto& b) { return a.hash < b.hash; });
+
+    glp::format::PakHeader header {};
+    std::memcpy(header.magic, glp::format::PAK_MAGIC, sizeof(header.magic));
+    header.version = glp::format::PAK_VERSION;
+    header.entry_count = index.size();
+    header.strings_size = strings.size();
+
+    std::string head;
+    glp::format::write(head, header);
+    glp::format::write(head, index.data(), index.size());
+    head += strings;
+    glp::format::align(head);
+    header.data_offset = head.size();
+    std::memcpy(head.data(), &header, sizeof(header));
+
+    std::fstream out(output, std::ios::out | std::ios::trunc | std::ios::binary);
+    out << head;
+    uint64_t written = 0;
+    for(size_t i=0; i<files.size(); i++) {
+        std::string padding(entries[i].offset-written, '\0');
+        out << padding << glp::util::read_file(files[i].source.string());
+        written = entries[i].offset+entries[i].size;
+    }
+    printf("packed %zu files (%llu bytes) into %s\n", files.size(), static_cast<unsigned long long>(header.data_offset+written), output.c_str());
     return 0;
 }
+
+int main(int argc, char* argv[]) {
+    if(argc == 4 && !strcmp(argv[1], "train"))
+        return train(argv[2], argv[3]);
+    if(argc == 4 && !strcmp(argv[1], "pack"))
+        return pack(argv[2], argv[3]);
+
+    Options opt;
+    int arg = 1;
+    for(; arg<argc && argv[arg][0] == '-'; arg++) {
+        if(!strcmp(argv[arg], "-t")) opt.text = true;
+        else if(!strcmp(argv[arg], "-r")) opt.raw = true;
+        else if(!strcmp(argv[arg], "-n")) opt.optimized = false;
+        else if(!strcmp(argv[arg], "-o")) opt.overdraw = true;
+        else if(!strcmp(argv[arg], "-q")) opt.compact = true;
+        else if(!strcmp(argv[arg], "-p")) opt.quantize_position = true;
+        else if(!strcmp(argv[arg], "-w")) opt.weights16 = true;
+        else if(!strcmp(argv[arg], "-x")) opt.textures = true;
+        else if(!strcmp(argv[arg], "-k")) opt.mip_filter = MipFilter::KAISER;
+        else if(!strcmp(argv[arg], "-s") && arg+1<argc) opt.max_texture_size = atoi(argv[++arg]);
+        else if(!strcmp(argv[arg], "-c") && arg+1<argc && parse_compression(argv[arg+1], opt.compression)) arg++;
+        else if(!strcmp(argv[arg], "-l") && arg+1<argc) opt.level = atoi(argv[++arg]);
+        else if(!strcmp(argv[arg], "-L") && arg+1<argc) opt.lods = atoi(argv[++arg]);
+        else if(!strcmp(argv[arg], "-e") && arg+1<argc) opt.lod_error = atof(argv[++arg]);
+        else if(!strcmp(argv[arg], "-a") && arg+1<argc) opt.anim_tolerance = atof(argv[++arg]);
+        else if(!strcmp(argv[arg], "-j") && arg+1<argc) opt.threads = std::max(1, atoi(argv[++arg]));
+        else if(!strcmp(argv[arg], "-d") && arg+1<argc) {
+            if(!(opt.dict = glp::util::load_dictionary(argv[++arg]))) return 1;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(argc-arg != 3) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(!strcmp(argv[arg], "batch"))
+        return batch(argv[arg+1], argv[arg+2], opt);
+
+    int kind = atoi(argv[arg]);
+    if(!valid_kind(kind)) {
+        usage(argv[0]);
+        return 1;
+    }
+    std::string log;
+    bool ok = convert(static_cast<Kind>(kind), argv[arg+1], argv[arg+2], opt, log);
+    printf("%s", log.c_str());
+    return ok ? 0 : 1;
+}
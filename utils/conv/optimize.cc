@@ -0,0 +1,480 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <tuple>
+
+#include "optimize.hh"
+
+CacheStats analyze_vertex_cache(const std::vector<unsigned int>& indices, size_t vertex_count, size_t cache_size) {
+    // fifo is modelled with timestamps, a vertex is cached when it missed
+    // less than cache_size misses ago
+    std::vector<size_t> missed_at(vertex_count, 0);
+    std::vector<bool> referenced(vertex_count, false);
+    size_t misses = 0, unique = 0;
+    for(auto i: indices) {
+        if(i >= vertex_count) continue;
+        if(!referenced[i]) {
+            referenced[i] = true;
+            unique++;
+        } else if(misses+1 - missed_at[i] <= cache_size) continue;
+        misses++;
+        missed_at[i] = misses;
+    }
+    size_t triangles = indices.size()/3;
+    return CacheStats{triangles ? float(misses)/triangles : 0.0f, unique ? float(misses)/unique : 0.0f};
+}
+
+static float vertex_score(int cache_pos, unsigned live) {
+    if(live == 0) return -1.0f;
+    float score = 0.0f;
+    if(cache_pos >= 0) {
+        // the last triangle's vertices get a fixed score so it isn't reused right away
+        if(cache_pos < 3) score = 0.75f;
+        else score = std::pow(1.0f - float(cache_pos-3)/(OPTIMIZE_CACHE_SIZE-3), 1.5f);
+    }
+    // prefer vertices with few triangles left to get rid of them early
+    return score + 2.0f/std::sqrt(float(live));
+}
+
+void optimize_vertex_cache(std::vector<unsigned int>& indices, size_t vertex_count) {
+    size_t triangle_count = indices.size()/3;
+    if(triangle_count == 0) return;
+
+    // live triangles of each vertex, packed per vertex
+    std::vector<unsigned> live(vertex_count, 0);
+    for(auto i: indices) live[i]++;
+    std::vector<size_t> offsets(vertex_count+1, 0);
+    for(size_t v=0; v<vertex_count; v++) offsets[v+1] = offsets[v] + live[v];
+    std::vector<size_t> adjacency(indices.size());
+    std::vector<unsigned> filled(vertex_count, 0);
+    for(size_t t=0; t<triangle_count; t++)
+        for(size_t k=0; k<3; k++) {
+            auto v = indices[t*3+k];
+            adjacency[offsets[v] + filled[v]++] = t;
+        }
+
+    std::vector<int> cache_pos(vertex_count, -1);
+    std::vector<float> score(vertex_count);
+    for(size_t v=0; v<vertex_count; v++) score[v] = vertex_score(-1, live[v]);
+
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<unsigned> cache, next_cache;
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+
+    size_t best = 0, scan = 0;
+    while(result.size() < indices.size()) {
+        if(best == std::numeric_limits<size_t>::max()) {
+            // nothing in the cache has triangles left, continue in input order
+            while(emitted[scan]) scan++;
+            best = scan;
+        }
+        emitted[best] = true;
+
+        const unsigned* tri = &indices[best*3];
+        result.insert(result.end(), tri, tri+3);
+        for(size_t k=0; k<3; k++) {
+            auto v = tri[k];
+            auto begin = adjacency.begin()+offsets[v];
+            auto it = std::find(begin, begin+live[v], best);
+            std::iter_swap(it, begin+live[v]-1);
+            live[v]--;
+        }
+
+        next_cache.assign(tri, tri+3);
+        for(auto v: cache)
+            if(v != tri[0] && v != tri[1] && v != tri[2]) next_cache.push_back(v);
+        for(size_t i=OPTIMIZE_CACHE_SIZE; i<next_cache.size(); i++) {
+            cache_pos[next_cache[i]] = -1;
+            score[next_cache[i]] = vertex_score(-1, live[next_cache[i]]);
+        }
+        if(next_cache.size() > OPTIMIZE_CACHE_SIZE) next_cache.resize(OPTIMIZE_CACHE_SIZE);
+        std::swap(cache, next_cache);
+        for(size_t i=0; i<cache.size(); i++) {
+            cache_pos[cache[i]] = i;
+            score[cache[i]] = vertex_score(i, live[cache[i]]);
+        }
+
+        // next triangle is the best scoring one that touches the cache
+        best = std::numeric_limits<size_t>::max();
+        float best_score = -1.0f;
+        for(auto v: cache)
+            for(size_t j=offsets[v]; j<offsets[v]+live[v]; j++) {
+                size_t t = adjacency[j];
+                float s = score[indices[t*3]] + score[indices[t*3+1]] + score[indices[t*3+2]];
+                if(s > best_score) {
+                    best_score = s;
+                    best = t;
+                }
+            }
+    }
+    indices = std::move(result);
+}
+
+void optimize_overdraw(std::vector<unsigned int>& indices, const std::vector<glp::Vertex>& vertices, float threshold) {
+    size_t triangle_count = indices.size()/3;
+    if(triangle_count < 2) return;
+
+    // clusters start where a triangle misses the cache with all vertices,
+    // so drawing them in any order keeps the cache behaviour close
+    std::vector<size_t> clusters;
+    std::vector<size_t> missed_at(vertices.size(), 0);
+    size_t misses = 0;
+    for(size_t t=0; t<triangle_count; t++) {
+        size_t tri_misses = 0;
+        for(size_t k=0; k<3; k++) {
+            auto v = indices[t*3+k];
+            if(missed_at[v] && misses+1 - missed_at[v] <= REPORT_CACHE_SIZE) continue;
+            missed_at[v] = ++misses;
+            tri_misses++;
+        }
+        if(t == 0 || tri_misses == 3) clusters.push_back(t);
+    }
+    if(clusters.size() < 2) return;
+    clusters.push_back(triangle_count);
+
+    struct Cluster {
+        size_t begin, end;
+        glm::vec3 centroid;
+        glm::vec3 normal;
+        float area;
+        float sort_key;
+    };
+    std::vector<Cluster> sorted;
+    glm::vec3 mesh_centroid {0.0f};
+    float mesh_area = 0.0f;
+    for(size_t c=0; c+1<clusters.size(); c++) {
+        Cluster cl {clusters[c], clusters[c+1], glm::vec3{0.0f}, glm::vec3{0.0f}, 0.0f, 0.0f};
+        for(size_t t=cl.begin; t<cl.end; t++) {
+            auto& a = vertices[indices[t*3]].position;
+            auto& b = vertices[indices[t*3+1]].position;
+            auto& c = vertices[indices[t*3+2]].position;
+            glm::vec3 n = glm::cross(b-a, c-a);
+            float area = glm::length(n);
+            cl.centroid += (a+b+c) * (area/3.0f);
+            cl.normal += n;
+            cl.area += area;
+        }
+        mesh_centroid += cl.centroid;
+        mesh_area += cl.area;
+        if(cl.area > 0.0f) cl.centroid /= cl.area;
+        sorted.push_back(cl);
+    }
+    if(mesh_area > 0.0f) mesh_centroid /= mesh_area;
+
+    for(auto& cl: sorted) {
+        float len = glm::length(cl.normal);
+        cl.sort_key = len > 0.0f ? glm::dot(cl.centroid - mesh_centroid, cl.normal/len) : 0.0f;
+    }
+    // clusters facing away from the center occlude the rest, draw them first
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) {
+        return a.sort_key > b.sort_key;
+    });
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for(auto& cl: sorted)
+        result.insert(result.end(), indices.begin()+cl.begin*3, indices.begin()+cl.end*3);
+
+    float before = analyze_vertex_cache(indices, vertices.size()).acmr;
+    if(analyze_vertex_cache(result, vertices.size()).acmr <= before*threshold)
+        indices = std::move(result);
+}
+
+void optimize_vertex_fetch(std::vector<glp::Vertex>& vertices, std::vector<unsigned int>& indices) {
+    constexpr unsigned int unused = std::numeric_limits<unsigned int>::max();
+    std::vector<unsigned int> remap(vertices.size(), unused);
+    std::vector<glp::Vertex> result;
+    result.reserve(vertices.size());
+    for(auto& i: indices) {
+        if(remap[i] == unused) {
+            remap[i] = result.size();
+            result.push_back(vertices[i]);
+        }
+        i = remap[i];
+    }
+    vertices = std::move(result);
+}
+
+namespace {
+
+// symmetric 4x4 error quadric of planes
+struct Quadric {
+    double a00 {0}, a01 {0}, a02 {0}, a11 {0}, a12 {0}, a22 {0};
+    double b0 {0}, b1 {0}, b2 {0};
+    double c {0};
+    double weight {0};
+
+    void add_plane(const glm::dvec3& n, double d, double weight) {
+        a00 += weight*n.x*n.x; a01 += weight*n.x*n.y; a02 += weight*n.x*n.z;
+        a11 += weight*n.y*n.y; a12 += weight*n.y*n.z; a22 += weight*n.z*n.z;
+        b0 += weight*n.x*d; b1 += weight*n.y*d; b2 += weight*n.z*d;
+        c += weight*d*d;
+        this->weight += weight;
+    }
+
+    Quadric& operator+=(const Quadric& q) {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+        b0 += q.b0; b1 += q.b1; b2 += q.b2;
+        c += q.c;
+        weight += q.weight;
+        return *this;
+    }
+
+    double error(const glm::dvec3& p) const {
+        double e = a00*p.x*p.x + a11*p.y*p.y + a22*p.z*p.z
+            + 2.0*(a01*p.x*p.y + a02*p.x*p.z + a12*p.y*p.z)
+            + 2.0*(b0*p.x + b1*p.y + b2*p.z) + c;
+        // planes are area weighted, normalizing keeps the error a squared distance
+        return weight > 0.0 ? std::max(e, 0.0)/weight : 0.0;
+    }
+};
+
+struct Collapse {
+    unsigned int from, to;
+    double cost;
+};
+
+}
+
+// vertices that can't move: seams where several vertices share a position
+// and borders where an edge belongs to a single triangle
+static std::vector<bool> locked_vertices(const std::vector<unsigned int>& indices, const std::vector<glp::Vertex>& vertices) {
+    std::vector<unsigned int> welded(vertices.size());
+    std::vector<bool> locked(vertices.size(), false);
+    {
+        std::vector<unsigned int> order(vertices.size());
+        for(size_t i=0; i<order.size(); i++) order[i] = i;
+        auto less = [&](unsigned int a, unsigned int b) {
+            const auto& pa = vertices[a].position;
+            const auto& pb = vertices[b].position;
+            return std::tie(pa.x, pa.y, pa.z) < std::tie(pb.x, pb.y, pb.z);
+        };
+        std::sort(order.begin(), order.end(), less);
+        for(size_t i=0; i<order.size(); i++) {
+            if(i > 0 && vertices[order[i]].position == vertices[order[i-1]].position) {
+                welded[order[i]] = welded[order[i-1]];
+                locked[order[i]] = locked[order[i-1]] = true;
+            } else welded[order[i]] = order[i];
+        }
+    }
+
+    std::vector<std::pair<unsigned int, unsigned int>> edges;
+    for(size_t i=0; i+2<indices.size(); i+=3)
+        for(size_t k=0; k<3; k++) {
+            unsigned int a = welded[indices[i+k]], b = welded[indices[i+(k+1)%3]];
+            edges.emplace_back(std::min(a, b), std::max(a, b));
+        }
+    std::sort(edges.begin(), edges.end());
+    std::vector<bool> border(vertices.size(), false);
+    for(size_t i=0; i<edges.size(); ) {
+        size_t j = i;
+        while(j < edges.size() && edges[j] == edges[i]) j++;
+        if(j-i == 1) border[edges[i].first] = border[edges[i].second] = true;
+        i = j;
+    }
+    for(size_t v=0; v<vertices.size(); v++)
+        if(border[welded[v]]) locked[v] = true;
+    return locked;
+}
+
+static bool flips(const std::vector<unsigned int>& indices, const std::vector<glp::Vertex>& vertices,
+        const std::vector<size_t>& triangles, unsigned int from, unsigned int to) {
+    const glm::vec3& target = vertices[to].position;
+    for(auto t: triangles) {
+        const unsigned int* tri = &indices[t*3];
+        if(tri[0] == to || tri[1] == to || tri[2] == to) continue;
+        glm::vec3 p[3], q[3];
+        for(size_t k=0; k<3; k++) {
+            p[k] = vertices[tri[k]].position;
+            q[k] = tri[k] == from ? target : p[k];
+        }
+        glm::vec3 before = glm::cross(p[1]-p[0], p[2]-p[0]);
+        glm::vec3 after = glm::cross(q[1]-q[0], q[2]-q[0]);
+        if(glm::dot(before, after) <= 0.0f) return true;
+    }
+    return false;
+}
+
+std::vector<unsigned int> simplify(const std::vector<unsigned int>& indices, const std::vector<glp::Vertex>& vertices,
+        size_t target_index_count, float target_error, float& result_error) {
+    result_error = 0.0f;
+    std::vector<unsigned int> result = indices;
+    if(result.size() <= target_index_count) return result;
+
+    auto locked = locked_vertices(indices, vertices);
+
+    std::vector<Quadric> quadrics(vertices.size());
+    for(size_t i=0; i+2<result.size(); i+=3) {
+        glm::dvec3 p0 = vertices[result[i]].position;
+        glm::dvec3 p1 = vertices[result[i+1]].position;
+        glm::dvec3 p2 = vertices[result[i+2]].position;
+        glm::dvec3 n = glm::cross(p1-p0, p2-p0);
+        double area = glm::length(n);
+        if(area <= 0.0) continue;
+        n /= area;
+        for(auto v: {result[i], result[i+1], result[i+2]})
+            quadrics[v].add_plane(n, -glm::dot(n, p0), area);
+    }
+
+    double max_cost = double(target_error)*target_error;
+    double max_collapsed = 0.0;
+    for(;;) {
+        size_t triangle_count = result.size()/3;
+        std::vector<std::vector<size_t>> adjacency(vertices.size());
+        for(size_t t=0; t<triangle_count; t++)
+            for(size_t k=0; k<3; k++) adjacency[result[t*3+k]].push_back(t);
+
+        std::vector<Collapse> collapses;
+        for(size_t t=0; t<triangle_count; t++)
+            for(size_t k=0; k<3; k++) {
+                unsigned int a = result[t*3+k], b = result[t*3+(k+1)%3];
+                for(auto [from, to]: {std::make_pair(a, b), std::make_pair(b, a)}) {
+                    if(locked[from]) continue;
+                    Quadric q = quadrics[from];
+                    q += quadrics[to];
+                    collapses.push_back(Collapse{from, to, q.error(vertices[to].position)});
+                }
+            }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+            return a.cost < b.cost;
+        });
+
+        // collapses in one pass don't share vertices so their costs stay valid
+        std::vector<bool> touched(vertices.size(), false);
+        size_t removed = 0, remaining = triangle_count;
+        for(const auto& c: collapses) {
+            if(c.cost > max_cost || remaining*3 <= target_index_count) break;
+            if(touched[c.from] || touched[c.to]) continue;
+            if(flips(result, vertices, adjacency[c.from], c.from, c.to)) continue;
+
+            for(auto t: adjacency[c.from]) {
+                unsigned int* tri = &result[t*3];
+                bool degenerate = tri[0] == c.to || tri[1] == c.to || tri[2] == c.to;
+                for(size_t k=0; k<3; k++) if(tri[k] == c.from) tri[k] = c.to;
+                if(degenerate) remaining--;
+            }
+            for(auto t: adjacency[c.from]) touched[result[t*3]] = touched[result[t*3+1]] = touched[result[t*3+2]] = true;
+            quadrics[c.to] += quadrics[c.from];
+            touched[c.from] = touched[c.to] = true;
+            max_collapsed = std::max(max_collapsed, c.cost);
+            removed++;
+        }
+
+        size_t out = 0;
+        for(size_t t=0; t<triangle_count; t++) {
+            unsigned int a = result[t*3], b = result[t*3+1], c = result[t*3+2];
+            if(a == b || b == c || a == c) continue;
+            result[out++] = a;
+            result[out++] = b;
+            result[out++] = c;
+        }
+        result.resize(out);
+        if(removed == 0 || result.size() <= target_index_count) break;
+    }
+
+    result_error = std::sqrt(max_collapsed);
+    return result;
+}
+
+static float key_error(const glm::vec3& a, const glm::vec3& b) {
+    return glm::length(a-b);
+}
+
+static float key_error(const glm::quat& a, const glm::quat& b) {
+    return 2.0f*std::acos(std::min(1.0f, std::fabs(glm::dot(a, b))));
+}
+
+static glm::vec3 key_lerp(const glm::vec3& a, const glm::vec3& b, float t) { return glm::mix(a, b, t); }
+static glm::quat key_lerp(const glm::quat& a, const glm::quat& b, float t) { return glm::slerp(a, b, t); }
+
+template <typename T>
+static void reduce_keys(glp::Animation::Channel<T>& channel, float tolerance) {
+    size_t n = channel.size();
+    if(n < 2) return;
+    const auto& times = channel.times;
+    const auto& values = channel.values;
+
+    // constant channels keep a single key
+    bool constant = true;
+    for(size_t i=1; i<n && constant; i++) constant = key_error(values[0], values[i]) <= tolerance;
+    std::vector<size_t> kept {0};
+    if(!constant) {
+        // grow a segment from the last kept key until an original key in
+        // between is no longer reproduced, then keep the one before it
+        size_t start = 0;
+        for(size_t end=2; end<n; end++) {
+            for(size_t i=start+1; i<end; i++) {
+                float t = (times[i]-times[start]) / (times[end]-times[start]);
+                if(key_error(key_lerp(values[start], values[end], t), values[i]) > tolerance) {
+                    kept.push_back(end-1);
+                    start = end-1;
+                    break;
+                }
+            }
+        }
+        kept.push_back(n-1);
+    }
+
+    glp::Animation::Channel<T> reduced;
+    for(auto i: kept) reduced.add(values[i], times[i]);
+    channel = std::move(reduced);
+}
+
+// distance from the node to its farthest descendant joint, leaves use their own bone length
+static float joint_reach(const glp::Animation::Node* node) {
+    float reach = 0.0f;
+    for(auto child: node->children) {
+        float length = child->positions.size() ? glm::length(child->positions.get(0)) : 0.0f;
+        reach = std::max(reach, length + joint_reach(child));
+    }
+    if(reach == 0.0f && node->positions.size()) reach = glm::length(node->positions.get(0));
+    return reach;
+}
+
+static void compress_node(glp::Animation::Node* node, float tolerance) {
+    // a joint moves by about angle*reach when its rotation is off by angle; reach
+    // is kept at 1 or more since skinned vertices extend past short leaf bones
+    float reach = std::max(joint_reach(node), 1.0f);
+    reduce_keys(node->positions, tolerance);
+    reduce_keys(node->rotations, tolerance/reach);
+    reduce_keys(node->scales, tolerance/reach);
+    node->positions.pack();
+    node->rotations.pack();
+    node->scales.pack();
+    for(auto child: node->children) compress_node(child, tolerance);
+}
+
+size_t count_keys(const glp::Animation::Node* node) {
+    size_t keys = node->positions.size() + node->rotations.size() + node->scales.size();
+    for(auto child: node->children) keys += count_keys(child);
+    return keys;
+}
+
+size_t compress_animation(glp::Animation::Animation& anim, float tolerance) {
+    if(!anim.get_root_node()) return 0;
+    compress_node(anim.get_root_node(), tolerance);
+    return count_keys(anim.get_root_node());
+}
+
+static float joint_error(glp::Animation::Node* a, glp::Animation::Node* b,
+        const glm::mat4& parent_a, const glm::mat4& parent_b, float time) {
+    a->update(time);
+    b->update(time);
+    glm::mat4 global_a = parent_a * a->local_transform;
+    glm::mat4 global_b = parent_b * b->local_transform;
+    float error = glm::length(glm::vec3(global_a[3]) - glm::vec3(global_b[3]));
+    for(size_t i=0; i<std::min(a->children.size(), b->children.size()); i++)
+        error = std::max(error, joint_error(a->children[i], b->children[i], global_a, global_b, time));
+    return error;
+}
+
+float animation_error(const glp::Animation::Animation& a, const glp::Animation::Animation& b, size_t samples) {
+    if(!a.get_root_node() || !b.get_root_node() || samples == 0) return 0.0f;
+    float error = 0.0f;
+    for(size_t i=0; i<=samples; i++) {
+        float time = a.get_duration() * i / samples;
+        error = std::max(error, joint_error(a.get_root_node(), b.get_root_node(), glm::mat4(1.0f), glm::mat4(1.0f), time));
+    }
+    return error;
+}
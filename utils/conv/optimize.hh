@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+
+#include "model.hh"
+#include "anim.hh"
+
+// size of the fifo used to report acmr/atvr, close to what most gpus keep
+constexpr size_t REPORT_CACHE_SIZE              = 16;
+// size of the lru cache modelled while reordering triangles
+constexpr size_t OPTIMIZE_CACHE_SIZE            = 32;
+
+struct CacheStats {
+    // average cache miss ratio, transformed vertices per triangle (0.5 - 3.0)
+    float acmr;
+    // average transform to vertex ratio, 1.0 is optimal
+    float atvr;
+};
+
+CacheStats analyze_vertex_cache(const std::vector<unsigned int>& indices, size_t vertex_count,
+        size_t cache_size=REPORT_CACHE_SIZE);
+
+// reorders triangles for post-transform cache locality (Forsyth's linear-speed algorithm)
+void optimize_vertex_cache(std::vector<unsigned int>& indices, size_t vertex_count);
+
+// reorders clusters of cache optimized triangles so outward facing ones are drawn first,
+// the result is dropped when acmr gets worse than threshold times the input's
+void optimize_overdraw(std::vector<unsigned int>& indices, const std::vector<glp::Vertex>& vertices,
+        float threshold=1.05f);
+
+// reorders vertices by first use in the index buffer and drops unreferenced ones
+void optimize_vertex_fetch(std::vector<glp::Vertex>& vertices, std::vector<unsigned int>& indices);
+
+// quadric error edge collapse towards target_index_count, stops early once a collapse
+// would move the surface more than target_error; the result indexes the same vertices,
+// result_error gets the largest error introduced
+std::vector<unsigned int> simplify(const std::vector<unsigned int>& indices, const std::vector<glp::Vertex>& vertices,
+        size_t target_index_count, float target_error, float& result_error);
+
+// drops keys that interpolating their neighbours reproduces within tolerance, then
+// packs every channel; rotation and scale tolerances are divided by the distance to
+// the farthest descendant joint so each joint stays about within tolerance.
+// returns how many keys are left
+size_t compress_animation(glp::Animation::Animation& anim, float tolerance);
+
+// largest joint position difference between two animations of the same hierarchy
+float animation_error(const glp::Animation::Animation& a, const glp::Animation::Animation& b, size_t samples=256);
+
+size_t count_keys(const glp::Animation::Node* node);
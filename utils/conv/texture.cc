@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "format.hh"
+#include "blocks.hh"
+#include "texture.hh"
+
+// kaiser window parameters, radius in texels of the destination
+static constexpr float KAISER_RADIUS = 3.0f;
+static constexpr float KAISER_ALPHA = 4.0f;
+
+struct Image {
+    int width, height, components;
+    std::vector<float> data;
+};
+
+static float srgb_to_linear(float c) {
+    return c <= 0.04045f ? c/12.92f : std::pow((c+0.055f)/1.055f, 2.4f);
+}
+
+static float linear_to_srgb(float c) {
+    return c <= 0.0031308f ? c*12.92f : 1.055f*std::pow(c, 1.0f/2.4f) - 0.055f;
+}
+
+// modified bessel function of the first kind, order 0
+static float bessel_i0(float x) {
+    float sum = 1.0f, term = 1.0f;
+    for(int k=1; k<32 && term > sum*1e-7f; k++) {
+        term *= (x/(2.0f*k))*(x/(2.0f*k));
+        sum += term;
+    }
+    return sum;
+}
+
+static float filter_radius(MipFilter filter) {
+    return filter == MipFilter::BOX ? 0.5f : KAISER_RADIUS;
+}
+
+static float filter_weight(MipFilter filter, float t) {
+    t = std::abs(t);
+    if(filter == MipFilter::BOX) return t <= 0.5f ? 1.0f : 0.0f;
+    if(t >= KAISER_RADIUS) return 0.0f;
+    float x = t/KAISER_RADIUS;
+    float window = bessel_i0(KAISER_ALPHA*std::sqrt(1.0f - x*x))/bessel_i0(KAISER_ALPHA);
+    float sinc = t < 1e-6f ? 1.0f : std::sin(float(M_PI)*t)/(float(M_PI)*t);
+    return sinc*window;
+}
+
+// color channels are linear in the working image, alpha never is
+static bool is_color(int channel, int components) {
+    return components < 4 || channel < 3;
+}
+
+static Image to_float(const unsigned char* pixels, int width, int height, int components, bool srgb) {
+    Image image{width, height, components, std::vector<float>(size_t(width)*height*components)};
+    float lut[256];
+    for(int i=0; i<256; i++) lut[i] = srgb ? srgb_to_linear(i/255.0f) : i/255.0f;
+    for(size_t i=0; i<image.data.size(); i++) {
+        int channel = i%components;
+        image.data[i] = is_color(channel, components) ? lut[pixels[i]] : pixels[i]/255.0f;
+    }
+    return image;
+}
+
+static std::vector<unsigned char> to_bytes(const Image& image, bool srgb) {
+    std::vector<unsigned char> out(image.data.size());
+    for(size_t i=0; i<image.data.size(); i++) {
+        float c = std::clamp(image.data[i], 0.0f, 1.0f);
+        if(srgb && is_color(i%image.components, image.components)) c = linear_to_srgb(c);
+        out[i] = static_cast<unsigned char>(std::lround(c*255.0f));
+    }
+    return out;
+}
+
+// block encoders read rgba
+static std::vector<unsigned char> to_rgba(const std::vector<unsigned char>& pixels, int components) {
+    if(components == 4) return pixels;
+    std::vector<unsigned char> rgba(pixels.size()/3*4);
+    for(size_t i=0; i<pixels.size()/3; i++) {
+        std::copy_n(&pixels[i*3], 3, &rgba[i*4]);
+        rgba[i*4+3] = 255;
+    }
+    return rgba;
+}
+
+static uint32_t select_format(TextureCompression compression, TextureRole role, bool alpha) {
+    switch(compression) {
+        case TextureCompression::BC: return alpha ? glp::format::TEXTURE_BC3 : glp::format::TEXTURE_BC1;
+        // two channels would drop the blue of color and data maps
+        case TextureCompression::BC5:
+            if(role == TextureRole::NORMAL) return glp::format::TEXTURE_BC5;
+            return alpha ? glp::format::TEXTURE_BC3 : glp::format::TEXTURE_BC1;
+        case TextureCompression::BC7: return glp::format::TEXTURE_BC7;
+        case TextureCompression::ETC2: return alpha ? glp::format::TEXTURE_ETC2_RGBA : glp::format::TEXTURE_ETC2_RGB;
+        default: return alpha ? glp::format::TEXTURE_RGBA8 : glp::format::TEXTURE_RGB8;
+    }
+}
+
+// one separable pass, the filter is stretched by the scale so downsampling
+// covers every source texel, samples outside the image clamp to the edge
+static Image resample_axis(const Image& src, int new_size, bool horizontal, MipFilter filter) {
+    int size = horizontal ? src.width : src.height;
+    int lines = horizontal ? src.height : src.width;
+    int comps = src.components;
+    float scale = float(size)/new_size;
+    float stretch = std::max(scale, 1.0f);
+    float support = filter_radius(filter)*stretch;
+
+    Image dst{horizontal ? new_size : src.width, horizontal ? src.height : new_size, comps, {}};
+    dst.data.assign(size_t(dst.width)*dst.height*comps, 0.0f);
+
+    std::vector<std::pair<int, float>> taps;
+    for(int i=0; i<new_size; i++) {
+        float center = (i+0.5f)*scale - 0.5f;
+        int first = static_cast<int>(std::ceil(center-support));
+        int last = static_cast<int>(std::floor(center+support));
+        taps.clear();
+        float total = 0.0f;
+        for(int j=first; j<=last; j++) {
+            float w = filter_weight(filter, (j-center)/stretch);
+            if(w == 0.0f) continue;
+            taps.emplace_back(std::clamp(j, 0, size-1), w);
+            total += w;
+        }
+        if(total == 0.0f) continue;
+
+        for(int line=0; line<lines; line++) {
+            float* out = horizontal
+                ? &dst.data[(size_t(line)*dst.width + i)*comps]
+                : &dst.data[(size_t(i)*dst.width + line)*comps];
+            for(auto [j, w]: taps) {
+                const float* in = horizontal
+                    ? &src.data[(size_t(line)*src.width + j)*comps]
+                    : &src.data[(size_t(j)*src.width + line)*comps];
+                for(int c=0; c<comps; c++) out[c] += in[c]*w;
+            }
+            for(int c=0; c<comps; c++) out[c] /= total;
+        }
+    }
+    return dst;
+}
+
+static Image resample(const Image& src, int new_width, int new_height, MipFilter filter) {
+    Image image = new_width == src.width ? src : resample_axis(src, new_width, true, filter);
+    if(new_height != image.height) image = resample_axis(image, new_height, false, filter);
+    return image;
+}
+
+std::string build_texture(const unsigned char* pixels, int width, int height, int components,
+        TextureRole role, MipFilter filter, size_t max_size, TextureCompression compression) {
+    bool srgb = role == TextureRole::COLOR;
+    // 1 and 2 components become rgb and rgba, gl has no sized format for them on gles2
+    std::vector<unsigned char> expanded;
+    if(components <= 2) {
+        int comps = components + 2;
+        expanded.resize(size_t(width)*height*comps);
+        for(size_t i=0; i<size_t(width)*height; i++) {
+            const unsigned char* in = &pixels[i*components];
+            unsigned char* out = &expanded[i*comps];
+            out[0] = out[1] = out[2] = in[0];
+            if(components == 2) out[3] = in[1];
+        }
+        pixels = expanded.data();
+        components = comps;
+    }
+
+    // rgba images with every texel opaque are stored without alpha when compressed
+    bool alpha = components == 4;
+    if(alpha && compression != TextureCompression::NONE) {
+        alpha = false;
+        for(size_t i=0; i<size_t(width)*height && !alpha; i++) alpha = pixels[i*4+3] != 255;
+    }
+    uint32_t format = select_format(compression, role, alpha);
+    bool compressed = glp::format::texture_block_size(format) != 0;
+
+    Image image = to_float(pixels, width, height, components, srgb);
+    int largest = std::max(width, height);
+    if(max_size && size_t(largest) > max_size) {
+        float scale = float(max_size)/largest;
+        image = resample(image,
+            std::max(1, static_cast<int>(std::lround(width*scale))),
+            std::max(1, static_cast<int>(std::lround(height*scale))), filter);
+    }
+
+    std::vector<glp::format::TextureLevel> levels;
+    std::string data;
+    for(;;) {
+        glp::format::TextureLevel level {};
+        level.width = image.width;
+        level.height = image.height;
+        level.offset = data.size();
+        auto bytes = to_bytes(image, srgb);
+        if(compressed) {
+            auto rgba = to_rgba(bytes, components);
+            data += encode_blocks(format, rgba.data(), image.width, image.height);
+        } else {
+            data.append(bytes.begin(), bytes.end());
+        }
+        level.size = data.size() - level.offset;
+        levels.push_back(level);
+        if(image.width == 1 && image.height == 1) break;
+        image = resample(image, std::max(1, image.width/2), std::max(1, image.height/2), filter);
+    }
+
+    glp::format::TextureHeader header {};
+    std::memcpy(header.magic, glp::format::TEXTURE_MAGIC, sizeof(header.magic));
+    header.version = glp::format::TEXTURE_VERSION;
+    header.format = format;
+    header.flags = srgb ? uint32_t{glp::format::TEXTURE_SRGB} : 0u;
+    header.width = levels[0].width;
+    header.height = levels[0].height;
+    header.level_count = levels.size();
+
+    std::string s;
+    glp::format::write(s, header);
+    glp::format::write(s, levels.data(), levels.size());
+    glp::format::align(s);
+    header.data_offset = s.size();
+    std::memcpy(s.data(), &header, sizeof(header));
+    s += data;
+    return s;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+
+enum class MipFilter {
+    BOX,
+    // windowed sinc, sharper than box at the cost of slight ringing
+    KAISER,
+};
+
+enum class TextureCompression {
+    NONE,
+    // bc1, or bc3 when the texture has alpha
+    BC,
+    // like BC, but normal maps are stored as red and green only in bc5 and the
+    // shaders rebuild blue
+    BC5,
+    BC7,
+    // etc2 rgb, or with eac alpha when the texture has alpha
+    ETC2,
+};
+
+// what a texture holds, which decides its color space and compressed format
+enum class TextureRole {
+    // diffuse maps and other srgb color
+    COLOR,
+    // tangent space normal maps
+    NORMAL,
+    // roughness, metallic, ao and other linear data
+    DATA,
+};
+
+// .tex container holding every mip level down to 1x1, each level filtered from the
+// previous one; color textures are srgb and have their color channels filtered in
+// linear space and alpha as it is. 1 and 2 component images are expanded to rgb and rgba, and the largest
+// side is scaled down to max_size unless it is 0. compressed levels are encoded
+// after filtering
+std::string build_texture(const unsigned char* pixels, int width, int height, int components,
+        TextureRole role, MipFilter filter, size_t max_size, TextureCompression compression);
@@ -4,6 +4,7 @@
 #include "model.hh"
 #include "shader.hh"
 #include "anim.hh"
+#include "watcher.hh"
 #include "obj/scene.hh"
 
 #include "external/glm/glm.hpp"
@@ -103,6 +104,8 @@ int main(int argc, char* argv[]) {
 
     auto scene = glp::Object::PhysicsScene{WIDTH, HEIGHT, nullptr, shader, &camera, false};
     scene.set_debug(true);
+    // imported models reload when their files are re-exported
+    glp::AssetWatcher watcher;
 
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
@@ -110,6 +113,7 @@ int main(int argc, char* argv[]) {
 
     while(sdl.is_running()) {
         sdl.loop_start();
+        watcher.process();
         for(auto& e: sdl.events) {
             ImGui_ImplSDL2_ProcessEvent(&e);
             if(e.type == SDL_KEYUP) {
@@ -135,6 +139,19 @@ int main(int argc, char* argv[]) {
         ImGui::SetNextWindowSize(ImVec2(250, 680));
         ImGui::Begin("glp");
 
+        if(ImGui::TreeNode("Render")) {
+            auto& stats = scene.get_world()->get_render_stats();
+            ImGui::Text("visible %zu, culled %zu", stats.visible_objects, stats.culled_objects);
+            ImGui::Text("culled meshes %zu", stats.culled_meshes);
+            ImGui::Text("draws %zu/%zu items", stats.draw_calls, stats.items);
+            ImGui::Text("programs %zu", stats.program_changes);
+            ImGui::Text("materials %zu", stats.material_changes);
+            ImGui::Text("meshes %zu", stats.mesh_changes);
+            ImGui::Text("objects %zu", stats.object_changes);
+            ImGui::Text("instanced %zu draws, %zu objects", stats.instanced_draws, stats.instances);
+            ImGui::TreePop();
+        }
+
         if(ImGui::TreeNode("Fog")) {
             if(ImGui::TreeNode("Color")) {
                 if(ImGui::InputFloat("R", &fr, 0.1f) || ImGui::InputFloat("G", &fg, 0.1f)
@@ -230,6 +247,7 @@ int main(int argc, char* argv[]) {
                 std::string sbuf = buf;
                 scene.get_objects().back()->get_model()->set_name(sbuf.substr(sbuf.find_last_of('/'), sbuf.length())+std::to_string(scene.get_objects().size()));
                 transforms.push_back(new transform);
+                watcher.watch(scene.get_objects().back()->get_model());
             }
             ImGui::TreePop();
         }
@@ -254,10 +272,9 @@ int main(int argc, char* argv[]) {
                     name = std::string(buf1) +std::to_string(i)+".model";
                     auto path = std::string(buf0) + '/' + name;
                     glp_logv("exporting model %s...", name.c_str());
-                    std::fstream output(path, std::ios::out | std::ios::trunc);
+                    std::fstream output(path, std::ios::out | std::ios::trunc | std::ios::binary);
                     model->set_directory(name);
-                    std::stringstream data = model->serialize_data();
-                    auto compressed = glp::util::compress(data.str(), 90);
+                    auto compressed = glp::util::compress(model->serialize_binary(), glp::util::DEFAULT_COMPRESS_LEVEL);
                     output << compressed;
                     for(auto& tex: model->get_textures())
                         std::filesystem::copy_file(tex->path, std::string(buf0)+'/'+tex->path.substr(tex->path.find_last_of('/')+1));
@@ -265,9 +282,8 @@ int main(int argc, char* argv[]) {
                 {
                     auto name =std::string(buf0) + '/' + std::string(buf1) + ".scene";
                     glp_logv("exporting scene %s...", name.c_str());
-                    std::fstream output(name, std::ios::out | std::ios::trunc);
-                    std::stringstream data = scene.serialize_data();
-                    auto compressed = glp::util::compress(data.str(), 90);
+                    std::fstream output(name, std::ios::out | std::ios::trunc | std::ios::binary);
+                    auto compressed = glp::util::compress(scene.serialize_binary(), glp::util::DEFAULT_COMPRESS_LEVEL);
                     output << compressed;
                 }
                 glp_log("exported!");
@@ -279,44 +295,33 @@ int main(int argc, char* argv[]) {
         ImGui::SameLine();
         ImGui::RadioButton("PBR", &is_phong, 0);
 
-        if(is_phong) {
-            shader = phong;
-            shader->bind();
-            for(auto& obj: scene.get_objects()) obj->set_shader(shader, shading_t);
-            shader->set("fog.color", glm::vec3(fr, fg, fb));
-            shader->set("fog.near", fn);
-            shader->set("fog.far", ff);
-            if(is_directional) {
-                scene.get_light().set_type(glp::Object::LightType::DIRECTIONAL);
-                shader->set("light.direction", glm::vec3(dirx, diry, dirz));
-                shader->set("light.directional", 1);
-            } else {
-                scene.get_light().set_type(glp::Object::LightType::POINT);
-                shader->set("light.position", glm::vec3(posx, posy, posz));
-                shader->set("light.directional", 0);
-                shader->set("light.linear", linear);
-                shader->set("light.quadratic", quadratic);
-            }
-            shader->set("light.ambient", glm::vec3(ax, ay, az));
-            shader->set("light.diffuse", glm::vec3(difx, dify, difz));
-            shader->set("light.specular", glm::vec3(sx, sy, sz));
+        if(is_phong) shader = phong;
+        else shader = pbr;
+        for(auto& obj: scene.get_objects()) obj->set_shader(shader, shading_t);
+
+        // setters skip unchanged values, the blocks are only rewritten on edits
+        auto& fog = scene.get_fog();
+        auto& light = scene.get_light();
+        fog.set_color(glm::vec3(fr, fg, fb));
+        fog.set_near(fn);
+        fog.set_far(ff);
+        if(is_directional) {
+            light.set_type(glp::Object::LightType::DIRECTIONAL);
+            light.set_direction(glm::vec3(dirx, diry, dirz));
         } else {
-            shader = pbr;
-            shader->bind();
-            for(auto& obj: scene.get_objects()) obj->set_shader(shader, shading_t);
-            shader->set("fog.color", glm::vec3(fr, fg, fb));
-            shader->set("fog.near", fn);
-            shader->set("fog.far", ff);
-            if(is_directional) {
-                scene.get_light().set_type(glp::Object::LightType::DIRECTIONAL);
-                shader->set("light.direction", glm::vec3(dirx, diry, dirz));
-                shader->set("light.directional", 1);
-            } else {
-                scene.get_light().set_type(glp::Object::LightType::POINT);
-                shader->set("light.position", glm::vec3(posx, posy, posz));
-                shader->set("light.directional", 0);
+            light.set_type(glp::Object::LightType::POINT);
+            light.set_position(glm::vec3(posx, posy, posz));
+            if(is_phong) {
+                light.set_linear(linear);
+                light.set_quadratic(quadratic);
             }
-            shader->set("light.color", glm::vec3(cx, cy, cz));
+        }
+        if(is_phong) {
+            light.set_ambient(glm::vec3(ax, ay, az));
+            light.set_diffuse(glm::vec3(difx, dify, difz));
+            light.set_specular(glm::vec3(sx, sy, sz));
+        } else {
+            light.set_color(glm::vec3(cx, cy, cz));
         }
 
         ImGui::End();